@@ -0,0 +1,435 @@
+//
+//  BatchBinarizer.cpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "BatchBinarizer.hpp"
+#import "BenchmarkUtilities.hpp"
+#import "Binarization.hpp"
+#import "CannyEdgeDetector.hpp"
+#import "WorkerPool.hpp"
+#import <algorithm>
+#import <cstdio>
+#import <deque>
+#import <dirent.h>
+#import <sys/resource.h>
+
+struct BatchBinarizer::Page {
+    size_t index;                   // into inputPaths
+    IplImage* image;                // decoded or binarized
+};
+
+// A bounded FIFO that blocks producers while it is full and consumers while it is empty, until it is closed
+template <typename T>
+class BatchBinarizer::BlockingQueue {
+public:
+    explicit BlockingQueue(size_t capacity)
+        : capacity (MAX(capacity, (size_t)1)), closed (false)
+    {
+        pthread_mutex_init(&mutex, NULL);
+        pthread_cond_init(&notEmpty, NULL);
+        pthread_cond_init(&notFull, NULL);
+    }
+    
+    ~BlockingQueue()
+    {
+        pthread_cond_destroy(&notFull);
+        pthread_cond_destroy(&notEmpty);
+        pthread_mutex_destroy(&mutex);
+    }
+    
+    void push(const T& item)
+    {
+        pthread_mutex_lock(&mutex);
+        while (items.size() >= capacity) {
+            pthread_cond_wait(&notFull, &mutex);
+        }
+        items.push_back(item);
+        pthread_cond_signal(&notEmpty);
+        pthread_mutex_unlock(&mutex);
+    }
+    
+    // Returns false once the queue is closed and drained
+    bool pop(T& item)
+    {
+        pthread_mutex_lock(&mutex);
+        while (items.empty() && !closed) {
+            pthread_cond_wait(&notEmpty, &mutex);
+        }
+        bool popped = !items.empty();
+        if (popped) {
+            item = items.front();
+            items.pop_front();
+            pthread_cond_signal(&notFull);
+        }
+        pthread_mutex_unlock(&mutex);
+        return popped;
+    }
+    
+    // No more items will be pushed
+    void close()
+    {
+        pthread_mutex_lock(&mutex);
+        closed = true;
+        pthread_cond_broadcast(&notEmpty);
+        pthread_mutex_unlock(&mutex);
+    }
+
+private:
+    BlockingQueue(const BlockingQueue&);
+    BlockingQueue& operator=(const BlockingQueue&);
+    
+    std::deque<T> items;
+    size_t capacity;
+    bool closed;
+    pthread_mutex_t mutex;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+};
+
+static long peakResidentBytes()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return usage.ru_maxrss;                 // bytes
+#else
+    return usage.ru_maxrss * 1024L;         // kilobytes
+#endif
+}
+
+BatchBinarizer::Options::Options()
+    : binarizingThreads (0), prefetchDepth (4), writeDepth (4), cannyLowThreshold (50.0), cannyHighThreshold (100.0),
+      outputExtension (".pbm"), decode (decodePNM), encode (encodePBM), info (NULL)
+{
+}
+
+BatchBinarizer::BatchBinarizer(const Options& options)
+    : options (options), inputPaths (NULL), decodedPages (NULL), binarizedPages (NULL), pages (0), failures (0)
+{
+    if (this->options.binarizingThreads <= 0) {
+        this->options.binarizingThreads = WorkerPool::processorCount();
+    }
+    std::fill(stageTicks, stageTicks + StageCount, 0);
+}
+
+BatchBinarizer::Report BatchBinarizer::run(const std::vector<std::string>& inputPaths)
+{
+    this->inputPaths = &inputPaths;
+    std::fill(stageTicks, stageTicks + StageCount, 0);
+    pages = 0;
+    failures = 0;
+    pthread_mutex_init(&statisticsMutex, NULL);
+    decodedPages = new BlockingQueue<Page>(options.prefetchDepth);
+    binarizedPages = new BlockingQueue<Page>(options.writeDepth);
+    
+    int64 start = cvGetTickCount();
+    pthread_t decoder, writer;
+    std::vector<pthread_t> binarizers(options.binarizingThreads);
+    pthread_create(&decoder, NULL, runDecoder, this);
+    for (size_t i = 0; i < binarizers.size(); i++) {
+        pthread_create(&binarizers[i], NULL, runBinarizer, this);
+    }
+    pthread_create(&writer, NULL, runWriter, this);
+    
+    // Each stage closes the queue it consumes from once its producers have all finished
+    pthread_join(decoder, NULL);
+    for (size_t i = 0; i < binarizers.size(); i++) {
+        pthread_join(binarizers[i], NULL);
+    }
+    binarizedPages->close();
+    pthread_join(writer, NULL);
+    int64 end = cvGetTickCount();
+    
+    delete binarizedPages;
+    delete decodedPages;
+    binarizedPages = decodedPages = NULL;
+    pthread_mutex_destroy(&statisticsMutex);
+    this->inputPaths = NULL;
+    
+    Report report;
+    report.pages = pages;
+    report.failures = failures;
+    report.seconds = ticksToSeconds(end - start);
+    report.pagesPerSecond = (report.seconds > 0.0) ? pages / report.seconds : 0.0;
+    for (int stage = 0; stage < StageCount; stage++) {
+        report.stageSeconds[stage] = ticksToSeconds(stageTicks[stage]);
+    }
+    report.peakResidentBytes = peakResidentBytes();
+    return report;
+}
+
+void* BatchBinarizer::runDecoder(void* binarizer)
+{
+    BatchBinarizer* self = (BatchBinarizer*)binarizer;
+    for (size_t i = 0; i < self->inputPaths->size(); i++) {
+        int64 start = cvGetTickCount();
+        IplImage* image = self->options.decode(self->options.info, (*self->inputPaths)[i]);
+        self->addStageTime(StageDecode, cvGetTickCount() - start);
+        
+        if (!image || image->depth != IPL_DEPTH_8U || image->nChannels == 2) {
+            if (image) {
+                cvReleaseImage(&image);
+            }
+            pthread_mutex_lock(&self->statisticsMutex);
+            self->failures++;
+            pthread_mutex_unlock(&self->statisticsMutex);
+            continue;
+        }
+        
+        Page page = { i, image };
+        self->decodedPages->push(page);
+    }
+    self->decodedPages->close();
+    return NULL;
+}
+
+void* BatchBinarizer::runBinarizer(void* binarizer)
+{
+    BatchBinarizer* self = (BatchBinarizer*)binarizer;
+    const Options& options = self->options;
+    
+    // Each thread keeps its own detector so that its buffers are reused from page to page
+    CannyEdgeDetector detector;
+    IplImage* edges = NULL;
+    
+    Page page;
+    while (self->decodedPages->pop(page)) {
+        IplImage* image = page.image;
+        if (!edges || edges->width != image->width || edges->height != image->height) {
+            if (edges) {
+                cvReleaseImage(&edges);
+            }
+            edges = cvCreateImage(cvGetSize(image), IPL_DEPTH_8U, 1);
+        }
+        
+        int64 ticks[4];
+        ticks[0] = cvGetTickCount();
+        if (image->nChannels >= 3) {
+            detector.detectColorEdges(image, edges, options.cannyLowThreshold, options.cannyHighThreshold,
+                                      CannyEdgeDetector::ChannelCombinationOr);
+        } else {
+            detector.detectEdges(image, edges, options.cannyLowThreshold, options.cannyHighThreshold);
+        }
+        ticks[1] = cvGetTickCount();
+        CvContour* firstContour = NULL;
+        CvMemStorage* storage = createStorageWithContours(edges, &firstContour);        // modifies edges
+        ticks[2] = cvGetTickCount();
+        IplImage* result = binarizeContours(image, firstContour, 8, 4, false, true, 1);
+        ticks[3] = cvGetTickCount();
+        cvReleaseMemStorage(&storage);
+        cvReleaseImage(&page.image);
+        
+        pthread_mutex_lock(&self->statisticsMutex);
+        self->stageTicks[StageCanny] += ticks[1] - ticks[0];
+        self->stageTicks[StageContours] += ticks[2] - ticks[1];
+        self->stageTicks[StageBinarize] += ticks[3] - ticks[2];
+        pthread_mutex_unlock(&self->statisticsMutex);
+        
+        page.image = result;
+        self->binarizedPages->push(page);
+    }
+    
+    if (edges) {
+        cvReleaseImage(&edges);
+    }
+    return NULL;
+}
+
+void* BatchBinarizer::runWriter(void* binarizer)
+{
+    BatchBinarizer* self = (BatchBinarizer*)binarizer;
+    Page page;
+    while (self->binarizedPages->pop(page)) {
+        std::string path = self->outputPath((*self->inputPaths)[page.index]);
+        int64 start = cvGetTickCount();
+        bool written = self->options.encode(self->options.info, path, page.image);
+        int64 ticks = cvGetTickCount() - start;
+        cvReleaseImage(&page.image);
+        
+        pthread_mutex_lock(&self->statisticsMutex);
+        self->stageTicks[StageEncode] += ticks;
+        if (written) {
+            self->pages++;
+        } else {
+            self->failures++;
+        }
+        pthread_mutex_unlock(&self->statisticsMutex);
+    }
+    return NULL;
+}
+
+void BatchBinarizer::addStageTime(Stage stage, int64 ticks)
+{
+    pthread_mutex_lock(&statisticsMutex);
+    stageTicks[stage] += ticks;
+    pthread_mutex_unlock(&statisticsMutex);
+}
+
+std::string BatchBinarizer::outputPath(const std::string& inputPath) const
+{
+    size_t slash = inputPath.rfind('/');
+    size_t nameStart = (slash == std::string::npos) ? 0 : slash + 1;
+    size_t dot = inputPath.rfind('.');
+    size_t nameEnd = (dot == std::string::npos || dot < nameStart) ? inputPath.size() : dot;
+    
+    std::string directory = options.outputDirectory.empty() ? inputPath.substr(0, nameStart) : options.outputDirectory + "/";
+    return directory + inputPath.substr(nameStart, nameEnd - nameStart) + options.outputExtension;
+}
+
+static std::string lowercase(std::string string)
+{
+    for (size_t i = 0; i < string.size(); i++) {
+        string[i] = tolower((unsigned char)string[i]);
+    }
+    return string;
+}
+
+std::vector<std::string> BatchBinarizer::pathsInDirectory(const std::string& directory, const std::vector<std::string>& extensions)
+{
+    std::vector<std::string> paths;
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) {
+        return paths;
+    }
+    
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        std::string name = lowercase(entry->d_name);
+        for (size_t i = 0; i < extensions.size(); i++) {
+            std::string extension = lowercase(extensions[i]);
+            if (name.size() > extension.size() && name.compare(name.size() - extension.size(), extension.size(), extension) == 0) {
+                paths.push_back(directory + "/" + entry->d_name);
+                break;
+            }
+        }
+    }
+    closedir(dir);
+    
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+// Reads a PNM header field, skipping whitespace and comments
+static bool readPNMValue(FILE* file, int* value)
+{
+    int c;
+    while ((c = fgetc(file)) != EOF) {
+        if (c == '#') {
+            while ((c = fgetc(file)) != EOF && c != '\n') {
+            }
+        } else if (!isspace(c)) {
+            break;
+        }
+    }
+    if (c == EOF || !isdigit(c)) {
+        return false;
+    }
+    
+    *value = 0;
+    while (c != EOF && isdigit(c)) {
+        if (*value > INT_MAX / 10 - 1) {
+            return false;
+        }
+        *value = *value * 10 + (c - '0');
+        c = fgetc(file);
+    }
+    return isspace(c);      // a single whitespace character ends the header
+}
+
+IplImage* BatchBinarizer::decodePNM(void*, const std::string& path)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return NULL;
+    }
+    
+    char magic[2];
+    int width, height, maxValue;
+    if (fread(magic, 1, 2, file) != 2 || magic[0] != 'P' || (magic[1] != '5' && magic[1] != '6') ||
+        !readPNMValue(file, &width) || !readPNMValue(file, &height) || !readPNMValue(file, &maxValue) ||
+        width <= 0 || height <= 0 || maxValue != 255) {
+        fclose(file);
+        return NULL;
+    }
+    
+    int channels = (magic[1] == '6') ? 3 : 1;
+    IplImage* image = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, channels);
+    size_t rowBytes = (size_t)width * channels;
+    for (int y = 0; y < height; y++) {
+        uchar* row = (uchar*)image->imageData + y * image->widthStep;
+        if (fread(row, 1, rowBytes, file) != rowBytes) {
+            cvReleaseImage(&image);
+            break;
+        }
+        if (channels == 3) {
+            // RGB to BGR
+            for (size_t x = 0; x < rowBytes; x += 3) {
+                std::swap(row[x], row[x + 2]);
+            }
+        }
+    }
+    fclose(file);
+    return image;
+}
+
+bool BatchBinarizer::encodePBM(void*, const std::string& path, const IplImage* binarized)
+{
+    assert(binarized->nChannels == 1 && binarized->depth == IPL_DEPTH_8U);
+    
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    
+    bool written = fprintf(file, "P4\n%d %d\n", binarized->width, binarized->height) > 0;
+    std::vector<uchar> packed((binarized->width + 7) / 8);
+    for (int y = 0; y < binarized->height && written; y++) {
+        const uchar* row = (const uchar*)binarized->imageData + y * binarized->widthStep;
+        std::fill(packed.begin(), packed.end(), 0);
+        for (int x = 0; x < binarized->width; x++) {
+            if (row[x] == 0) {
+                packed[x >> 3] |= 0x80 >> (x & 7);
+            }
+        }
+        written = fwrite(&packed[0], 1, packed.size(), file) == packed.size();
+    }
+    return (fclose(file) == 0) && written;
+}
+
+std::string BatchBinarizer::json(const Report& report)
+{
+    std::string string;
+    appendFormat(string, "{\"pages\": %d, \"failures\": %d, \"ms\": %.3f, \"pages_per_second\": %.3f, \"stages\": {",
+                 report.pages, report.failures, report.seconds * 1000.0, report.pagesPerSecond);
+    for (int stage = 0; stage < StageCount; stage++) {
+        double perPage = (report.pages > 0) ? report.stageSeconds[stage] / report.pages : 0.0;
+        appendFormat(string, "%s\"%s\": {\"ms\": %.3f, \"ms_per_page\": %.3f}", (stage == 0) ? "" : ", ",
+                     stageName((Stage)stage), report.stageSeconds[stage] * 1000.0, perPage * 1000.0);
+    }
+    appendFormat(string, "}, \"peak_resident_bytes\": %ld}\n", report.peakResidentBytes);
+    return string;
+}
+
+const char* BatchBinarizer::stageName(Stage stage)
+{
+    switch (stage) {
+        case StageDecode:
+            return "decode";
+        case StageCanny:
+            return "canny";
+        case StageContours:
+            return "contours";
+        case StageBinarize:
+            return "binarize";
+        case StageEncode:
+            return "encode";
+        default:
+            return "unknown";
+    }
+}
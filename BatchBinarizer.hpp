@@ -0,0 +1,99 @@
+//
+//  BatchBinarizer.hpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import <pthread.h>
+#import <string>
+#import <vector>
+#import "opencv2/opencv.hpp"
+
+// Binarizes a batch of page images as createBinarizedImage() does, overlapping the stages across threads:
+//
+//     decode thread -> [prefetch queue] -> binarizing threads -> [write queue] -> writer thread
+//
+// Pages are decoded and written by pluggable functions, which default to reading binary PNM (PPM and PGM) files and writing
+// 1 bit PBM files, since no image codecs are built with the app. The report gives the throughput and the time spent in
+// each stage so that preprocessing capacity can be planned.
+class BatchBinarizer {
+public:
+    // Returns a new 8-bit BGR or gray image, or NULL if the file cannot be decoded
+    typedef IplImage* (*DecodeFunction)(void* info, const std::string& path);
+    // Writes the 0/255 binarized image, returning false on failure
+    typedef bool (*EncodeFunction)(void* info, const std::string& path, const IplImage* binarized);
+    
+    struct Options {
+        Options();
+        
+        int binarizingThreads;          // 0 for one per processor
+        int prefetchDepth;              // decoded pages waiting to be binarized
+        int writeDepth;                 // binarized pages waiting to be written
+        double cannyLowThreshold;
+        double cannyHighThreshold;
+        std::string outputDirectory;    // each output is named after its input with outputExtension
+        std::string outputExtension;
+        DecodeFunction decode;
+        EncodeFunction encode;
+        void* info;                     // passed to decode and encode
+    };
+    
+    enum Stage {
+        StageDecode,
+        StageCanny,
+        StageContours,
+        StageBinarize,
+        StageEncode,
+        StageCount
+    };
+    
+    struct Report {
+        int pages;                      // binarized and written successfully
+        int failures;                   // pages that could not be decoded or written
+        double seconds;                 // wall clock time for the whole batch
+        double pagesPerSecond;
+        double stageSeconds[StageCount];    // summed over every page, so may exceed seconds when stages overlap
+        long peakResidentBytes;         // of the whole process
+    };
+    
+    explicit BatchBinarizer(const Options& options = Options());
+    
+    // Binarizes every file, returning once all have been written
+    Report run(const std::vector<std::string>& inputPaths);
+    
+    // The paths of the files in directory with the given extensions (compared case insensitively), sorted by name
+    static std::vector<std::string> pathsInDirectory(const std::string& directory, const std::vector<std::string>& extensions);
+    
+    // Reads binary PPM (P6) files as BGR and PGM (P5) files as gray, with 8-bit samples
+    static IplImage* decodePNM(void* info, const std::string& path);
+    // Writes a raw PBM (P4) file with black as 1, for pixels that are 0
+    static bool encodePBM(void* info, const std::string& path, const IplImage* binarized);
+    
+    // Formats the report as JSON with times in milliseconds
+    static std::string json(const Report& report);
+    static const char* stageName(Stage stage);
+
+private:
+    BatchBinarizer(const BatchBinarizer&);
+    BatchBinarizer& operator=(const BatchBinarizer&);
+    
+    struct Page;
+    template <typename T> class BlockingQueue;
+    
+    static void* runDecoder(void* binarizer);
+    static void* runBinarizer(void* binarizer);
+    static void* runWriter(void* binarizer);
+    void addStageTime(Stage stage, int64 ticks);
+    std::string outputPath(const std::string& inputPath) const;
+    
+    Options options;
+    const std::vector<std::string>* inputPaths;
+    BlockingQueue<Page>* decodedPages;
+    BlockingQueue<Page>* binarizedPages;
+    pthread_mutex_t statisticsMutex;
+    int64 stageTicks[StageCount];
+    int pages;
+    int failures;
+};
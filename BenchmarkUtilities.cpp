@@ -0,0 +1,49 @@
+//
+//  BenchmarkUtilities.cpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "BenchmarkUtilities.hpp"
+#import <algorithm>
+#import <cstdarg>
+#import <cstdio>
+
+BenchmarkPercentiles percentiles(std::vector<double>& samples)
+{
+    BenchmarkPercentiles result = { 0.0, 0.0, 0.0 };
+    if (!samples.empty()) {
+        std::sort(samples.begin(), samples.end());
+        size_t count = samples.size();
+        result.p50 = samples[MAX((size_t)ceil(0.50 * count), (size_t)1) - 1];
+        result.p95 = samples[MAX((size_t)ceil(0.95 * count), (size_t)1) - 1];
+        result.p99 = samples[MAX((size_t)ceil(0.99 * count), (size_t)1) - 1];
+    }
+    return result;
+}
+
+void appendFormat(std::string& string, const char* format, ...)
+{
+    va_list arguments, sizingArguments;
+    va_start(arguments, format);
+    va_copy(sizingArguments, arguments);
+    int length = vsnprintf(NULL, 0, format, sizingArguments);
+    va_end(sizingArguments);
+    
+    if (length > 0) {
+        // vsnprintf() writes a terminating null, which the extra byte holds until it is trimmed
+        size_t start = string.size();
+        string.resize(start + length + 1);
+        vsnprintf(&string[start], length + 1, format, arguments);
+        string.resize(start + length);
+    }
+    va_end(arguments);
+}
+
+void appendPercentiles(std::string& string, const char* name, const BenchmarkPercentiles& percentiles)
+{
+    appendFormat(string, "\"%s\": {\"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f}", name,
+                 percentiles.p50 * 1000.0, percentiles.p95 * 1000.0, percentiles.p99 * 1000.0);
+}
@@ -0,0 +1,33 @@
+//
+//  BenchmarkUtilities.hpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "opencv2/opencv.hpp"
+#import <string>
+#import <vector>
+
+// Timing and JSON formatting shared by the benchmarks, checks and batch binarizer
+
+struct BenchmarkPercentiles {
+    double p50;                 // seconds
+    double p95;
+    double p99;
+};
+
+static inline double ticksToSeconds(int64 ticks)
+{
+    return ticks / (cvGetTickFrequency() * 1.0e6);       // cvGetTickFrequency() is in ticks per microsecond
+}
+
+// Nearest rank percentiles of the samples, which are sorted in place
+BenchmarkPercentiles percentiles(std::vector<double>& samples);
+
+// Appends printf style formatted text of any length to string
+void appendFormat(std::string& string, const char* format, ...);
+
+// Appends a JSON member named name holding the percentiles in milliseconds
+void appendPercentiles(std::string& string, const char* name, const BenchmarkPercentiles& percentiles);
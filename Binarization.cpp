@@ -9,44 +9,66 @@
 #import "Binarization.hpp"
 #import "CvRectUtilities.hpp"
 #import "Bvh.hpp"
+#import "ContourFeatureTable.hpp"
+#import "WorkerPool.hpp"
+#import "BinaryImage.hpp"
 #import <vector>
 
-static inline bool aspectRatioIsWithinTenthToTen(const CvRect& rect);
-static int countOfContainedChildrenWithMinSize(CvContour* contour, int maxChildrenToCount, int minSize);
-static int meanIntensityOfPixelsInContourInSubimage(IplImage* grayImg, CvContour* contour);
+#if defined(__SSE2__)
+#import <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#import <arm_neon.h>
+#endif
+
+static int countOfContainedChildrenWithMinSize(const ContourFeatureTable& table, int index, int maxChildrenToCount, int minSize);
+static void selectTextContours(const ContourFeatureTable& table, CvSize imageSize, int largerDimensionMinimum, int maxChildrenCount,
+                               std::vector<int>& accepted);
+static void binarizeAcceptedContours(IplImage* img, const ContourFeatureTable& table, const std::vector<int>& accepted,
+                                     IplImage* result, uchar* packed, int packedStride, bool drawRects, int threadCount);
+static int meanIntensityOfPixelsInContourInSubimage(const CvMat* grayImg, CvContour* contour, const CvRect& rect);
+static int meanIntensityOfPoints(const CvMat* grayImg, const CvPoint* points, int count, CvPoint origin);
+static int meanIntensityOfTableContourInSubimage(const CvMat* grayImg, const ContourFeatureTable& table, int index);
+static int medianIntensityAroundRect(IplImage* img, const CvRect& rect);
 static inline uchar* pixelAddr(IplImage *img, CvPoint pt);
 static inline uchar bgr2Gray(uchar bgr[3]);
-static int median(std::vector<int> values);
+static int median(int* values, int count);
 static CvScalar randomRGBColor();
 
 // Based on "Font and Background Color Independent Text Binarization", T Kasar, J Kumar and A G Ramakrishnan, 2007.
-IplImage* createBinarizedImage(IplImage *img, double cannyLowThreshold, double cannyHighThreshold, int apertureSize)
+IplImage* createBinarizedImage(IplImage *img, double cannyLowThreshold, double cannyHighThreshold, int apertureSize,
+                               CannyEdgeDetector::ChannelCombination channelCombination, int threadCount, bool denseChainPoints)
 {
     assert(img->nChannels >= 3);    // BGR image is required
     
-    // Perform edge detection on each channel separately
-    IplImage* channelImage = cvCreateImage(cvGetSize(img), img->depth, 1);
     IplImage* cannyEdgeOr = cvCreateImage(cvGetSize(img), IPL_DEPTH_8U, 1);
-    IplImage* temp = cvCreateImage(cvGetSize(img), IPL_DEPTH_8U, 1);
-    for (int i = 1; i <= 3; i++) {
-        // Extract the channel data for this channel
-        cvSetImageCOI(img, i);
-        cvCopy(img, channelImage);
-        cvResetImageROI(img);
-        
-        // Populate destination on first pass, then use 'temp' and logically OR the results
-        cvCanny(channelImage, (i == 1) ? cannyEdgeOr : temp, cannyLowThreshold, cannyHighThreshold, apertureSize | CV_CANNY_L2_GRADIENT);
-        if (i > 1) {
-            cvOr(cannyEdgeOr, temp, cannyEdgeOr);
+    if (apertureSize == 3 && img->depth == IPL_DEPTH_8U && !img->roi) {
+        // Read the interleaved channels in place
+        CannyEdgeDetector detector;
+        detector.detectColorEdges(img, cannyEdgeOr, cannyLowThreshold, cannyHighThreshold, channelCombination);
+    } else {
+        // Perform edge detection on each channel separately
+        IplImage* channelImage = cvCreateImage(cvGetSize(img), img->depth, 1);
+        IplImage* temp = cvCreateImage(cvGetSize(img), IPL_DEPTH_8U, 1);
+        for (int i = 1; i <= 3; i++) {
+            // Extract the channel data for this channel
+            cvSetImageCOI(img, i);
+            cvCopy(img, channelImage);
+            cvResetImageROI(img);
+            
+            // Populate destination on first pass, then use 'temp' and logically OR the results
+            cvCanny(channelImage, (i == 1) ? cannyEdgeOr : temp, cannyLowThreshold, cannyHighThreshold, apertureSize | CV_CANNY_L2_GRADIENT);
+            if (i > 1) {
+                cvOr(cannyEdgeOr, temp, cannyEdgeOr);
+            }
         }
+        cvReleaseImage(&temp);
+        cvReleaseImage(&channelImage);
     }
-    cvReleaseImage(&temp);
-    cvReleaseImage(&channelImage);
     
     // Get the contours and binarize the image
     CvContour* firstContour = NULL;
-    CvMemStorage* storage = createStorageWithContours(cannyEdgeOr, &firstContour);      // modifies image
-    IplImage* result = binarizeContours(img, firstContour);
+    CvMemStorage* storage = createStorageWithContours(cannyEdgeOr, &firstContour, NULL, false, denseChainPoints);     // modifies image
+    IplImage* result = binarizeContours(img, firstContour, 8, 4, false, true, threadCount, denseChainPoints);
     cvReleaseMemStorage(&storage);
     
     cvReleaseImage(&cannyEdgeOr);
@@ -54,12 +76,51 @@ IplImage* createBinarizedImage(IplImage *img, double cannyLowThreshold, double c
     return result;
 }
 
-CvMemStorage* createStorageWithContours(IplImage* cannyEdgeImg, CvContour** firstContour, IplImage* debugContourImage, bool drawRects)
+IplImage* createHybridBinarizedImage(IplImage* img, double cannyLowThreshold, double cannyHighThreshold,
+                                     LocalThresholdMethod method, int windowSize, double k, int threadCount)
+{
+    IplImage* edges = cvCreateImage(cvGetSize(img), IPL_DEPTH_8U, 1);
+    CannyEdgeDetector detector;
+    if (img->nChannels == 1) {
+        detector.detectEdges(img, edges, cannyLowThreshold, cannyHighThreshold);
+    } else {
+        detector.detectColorEdges(img, edges, cannyLowThreshold, cannyHighThreshold, CannyEdgeDetector::ChannelCombinationOr);
+    }
+    
+    CvContour* firstContour = NULL;
+    CvMemStorage* storage = createStorageWithContours(edges, &firstContour);      // modifies image
+    ContourFeatureTable table;
+    table.build(firstContour);
+    std::vector<int> acceptedContours;
+    selectTextContours(table, cvGetSize(img), 8, 4, acceptedContours);
+    
+    IplImage* result = cvCreateImage(cvGetSize(img), IPL_DEPTH_8U, 1);
+    memset(result->imageData, UCHAR_MAX, result->imageSize);
+    binarizeAcceptedContours(img, table, acceptedContours, result, NULL, 0, false, threadCount);
+    
+    // Reuse the edge image to mark the text rects, which localThreshold() leaves alone
+    fastSetZero(edges);
+    for (size_t i = 0; i < acceptedContours.size(); i++) {
+        const CvRect& rect = table.rects[acceptedContours[i]];
+        for (int y = rect.y; y < rect.y + rect.height; y++) {
+            memset(edges->imageData + edges->widthStep * y + rect.x, UCHAR_MAX, rect.width);
+        }
+    }
+    localThreshold(img, result, method, windowSize, k, 128.0, edges, threadCount);
+    
+    cvReleaseMemStorage(&storage);
+    cvReleaseImage(&edges);
+    return result;
+}
+
+CvMemStorage* createStorageWithContours(IplImage* cannyEdgeImg, CvContour** firstContour, IplImage* debugContourImage, bool drawRects,
+                                        bool denseChainPoints)
 {
     // Find all of the conneted components in the image
     CvMemStorage* storage = cvCreateMemStorage();
     *firstContour = NULL;
-    cvFindContours(cannyEdgeImg, storage, (CvSeq**)firstContour, sizeof(CvContour), CV_RETR_TREE);      // modifies image
+    cvFindContours(cannyEdgeImg, storage, (CvSeq**)firstContour, sizeof(CvContour), CV_RETR_TREE,
+                   denseChainPoints ? CV_CHAIN_APPROX_NONE : CV_CHAIN_APPROX_SIMPLE);      // modifies image
     
     if (debugContourImage) {
         fastSetZero(debugContourImage);
@@ -88,7 +149,10 @@ IplImage* binarizeContours(IplImage* originalImg,
                            CvContour* firstContour,
                            int largerDimensionMinimum,
                            int maxChildrenCount,
-                           bool drawRects)
+                           bool drawRects,
+                           bool convertToGrayOnce,
+                           int threadCount,
+                           bool denseChainPoints)
 {
     // Iterate through the tree and locate all contours satisfying ALL of the following (in approx. optimized order):
     // 1. Largest dimension at least 8 pixels
@@ -97,63 +161,27 @@ IplImage* binarizeContours(IplImage* originalImg,
     // 4. Have a bounding box that does not intersect image border
     // 5. Has at most 4 components within that meet conditions 1-3 (since no Roman character has more than 2 interior components)
     // 6. Not contained by a contour that satisfies all other conditions
-    // Note that condition 6 is satisifed if the tree is searched parent before child and the child branches pruned
+    // Note that condition 6 is satisifed if the tree is searched parent before child and the child branches skipped
     // when conditions 1-5 are matched.
     
-    std::vector<CvContour*> acceptedContours;
-    acceptedContours.reserve(1024);
-    
-    int imageLargerDimension = MAX(originalImg->width, originalImg->height);
-    
-    if (firstContour) {
-        CvTreeNodeIterator iterator;
-        cvInitTreeNodeIterator(&iterator, firstContour, INT_MAX);
-        CvContour* contour;
-        while ((contour = (CvContour*)cvNextTreeNode(&iterator)) != NULL) {
-            // Condition 1
-            CvRect rect = cvBoundingRect(contour);
-            int largerDimension = MAX(rect.width, rect.height);
-            if (largerDimension < largerDimensionMinimum) {
-                continue;
-            }
-            
-            // Condition 2
-            if (!aspectRatioIsWithinTenthToTen(rect)) {
-                continue;
-            }
-            
-            // Condition 3
-            if (largerDimension > imageLargerDimension / 5) {
-                continue;
-            }
-            
-            // Condition 4
-            if (rect.x <= 1 || rect.x + rect.width >= originalImg->width - 1 || rect.y <= 1 || rect.y + rect.height >= originalImg->height - 1) {
-                continue;
-            }
-            
-            // Condition 5 (ensures children also satifies condition 1-4)
-            if (countOfContainedChildrenWithMinSize(contour, maxChildrenCount + 1, largerDimensionMinimum) > maxChildrenCount) {
-                continue;
-            }
-            
-            // At this point, condition 6 has been satisfied since this node was reached.
-            // To ensure this, we must delete all of our children nodes
-            acceptedContours.push_back(contour);
-            
-            cvPrevTreeNode(&iterator);      // returned the next (potentially child) node, now pointing at current
-            contour->v_next = NULL;
-            cvNextTreeNode(&iterator);      // returned current, now pointing at next valid node            
-        }
-    }
+    // The conditions are evaluated on a table of each contour's features, so that each bounding rect is found once
+    ContourFeatureTable table;
+    table.build(firstContour, denseChainPoints);
+    
+    std::vector<int> acceptedContours;
+    selectTextContours(table, cvGetSize(originalImg), largerDimensionMinimum, maxChildrenCount, acceptedContours);
     
     IplImage* result = cvCreateImage(cvGetSize(originalImg), IPL_DEPTH_8U, 1);
     memset(result->imageData, UCHAR_MAX, result->imageSize);
     
+    if (convertToGrayOnce) {
+        binarizeTextContours(originalImg, table, acceptedContours, result, drawRects, threadCount);
+        return result;
+    }
+    
     // Iterate through all of the accepted contours
     for (size_t i = 0; i < acceptedContours.size(); i++) {
-        CvContour* contour = acceptedContours[i];
-        CvRect rect = cvBoundingRect(contour);
+        const CvRect& rect = table.rects[acceptedContours[i]];
         
         // Create a grayscale subimage
         cvSetImageROI(originalImg, rect);
@@ -162,26 +190,13 @@ IplImage* binarizeContours(IplImage* originalImg,
         cvResetImageROI(originalImg);    
         
         // Estimate the foreground intensity of each box using the mean gray-level intensity of the pixels corresponding to the contour
-        int foregroundIntensity = meanIntensityOfPixelsInContourInSubimage(graySubimage, contour);
+        CvMat graySubimageHeader;
+        int foregroundIntensity = meanIntensityOfTableContourInSubimage(cvGetMat(graySubimage, &graySubimageHeader), table,
+                                                                        acceptedContours[i]);
         
         // Estimate the background intensity by sampling the 3 pixels at each corner of the bounding box.
         // Use the entire image since these points fall outside of the subimage rect.
-        // This is safe because we exlcuded all rects that were within a pixel of the border in the selection phase.
-        int cornerPoints[12] = {
-            bgr2Gray(pixelAddr(originalImg, cvPoint(rect.x - 1, rect.y - 1))),                              // ul
-            bgr2Gray(pixelAddr(originalImg, cvPoint(rect.x - 1, rect.y))),
-            bgr2Gray(pixelAddr(originalImg, cvPoint(rect.x, rect.y - 1))),
-            bgr2Gray(pixelAddr(originalImg, cvPoint(rect.x + rect.width + 1, rect.y - 1))),                 // ur
-            bgr2Gray(pixelAddr(originalImg, cvPoint(rect.x + rect.width, rect.y - 1))),
-            bgr2Gray(pixelAddr(originalImg, cvPoint(rect.x + rect.width + 1, rect.y))),
-            bgr2Gray(pixelAddr(originalImg, cvPoint(rect.x - 1, rect.y + rect.height + 1))),                // ll
-            bgr2Gray(pixelAddr(originalImg, cvPoint(rect.x - 1, rect.y + rect.height))),
-            bgr2Gray(pixelAddr(originalImg, cvPoint(rect.x, rect.y + rect.height + 1))),
-            bgr2Gray(pixelAddr(originalImg, cvPoint(rect.x + rect.width + 1, rect.y + rect.height + 1))),   // lr
-            bgr2Gray(pixelAddr(originalImg, cvPoint(rect.x + rect.width, rect.y + rect.height + 1))),
-            bgr2Gray(pixelAddr(originalImg, cvPoint(rect.x + rect.width + 1, rect.y + rect.height)))
-        };
-        int backgroundIntensity = median(std::vector<int>(cornerPoints, cornerPoints + 12));
+        int backgroundIntensity = medianIntensityAroundRect(originalImg, rect);
         
         // Threshold and copy to the destination bitmap and invert the output if the background has a higher intensity than the foreground
         IplImage* bwSubimage = cvCreateImage(cvGetSize(graySubimage), IPL_DEPTH_8U, 1);
@@ -204,28 +219,99 @@ IplImage* binarizeContours(IplImage* originalImg,
     return result;
 }
 
-static inline bool aspectRatioIsWithinTenthToTen(const CvRect& rect)
+void binarizeContoursPacked(IplImage* originalImg, CvContour* firstContour, uchar* packed, int packedStride,
+                            int largerDimensionMinimum, int maxChildrenCount, int threadCount, bool denseChainPoints)
+{
+    assert(packedStride >= (originalImg->width + 7) / 8);
+    
+    ContourFeatureTable table;
+    table.build(firstContour, denseChainPoints);
+    std::vector<int> acceptedContours;
+    selectTextContours(table, cvGetSize(originalImg), largerDimensionMinimum, maxChildrenCount, acceptedContours);
+    
+    for (int y = 0; y < originalImg->height; y++) {
+        memset(packed + y * packedStride, 0, (originalImg->width + 7) / 8);
+    }
+    binarizeAcceptedContours(originalImg, table, acceptedContours, NULL, packed, packedStride, false, threadCount);
+}
+
+void binarizeContoursToRuns(IplImage* originalImg, CvContour* firstContour, BinaryRuns& runs,
+                            int largerDimensionMinimum, int maxChildrenCount, int threadCount, bool denseChainPoints)
+{
+    int stride = (originalImg->width + 7) / 8;
+    std::vector<uchar> packed(stride * originalImg->height + 1);
+    binarizeContoursPacked(originalImg, firstContour, &packed[0], stride, largerDimensionMinimum, maxChildrenCount,
+                           threadCount, denseChainPoints);
+    
+    runs.reset(originalImg->width);
+    for (int y = 0; y < originalImg->height; y++) {
+        runs.appendPackedRow(&packed[y * stride]);
+    }
+}
+
+// Accepts the contours satisfying conditions 1-6 of binarizeContours() in table order
+static void selectTextContours(const ContourFeatureTable& table, CvSize imageSize, int largerDimensionMinimum, int maxChildrenCount,
+                               std::vector<int>& accepted)
 {
-    const int thousand = 1 << 10;
-    int aspectRatioTimesThousand = thousand * rect.width / rect.height;
-    return aspectRatioTimesThousand >= thousand / 10 && aspectRatioTimesThousand <= thousand * 10;
+    accepted.clear();
+    accepted.reserve(1024);
+    
+    int next;
+    for (int i = 0; i < table.size(); i = next) {
+        next = i + 1;
+        if (contourSatisfiesTextConditions(table, i, imageSize, cvPoint(0, 0), largerDimensionMinimum, maxChildrenCount)) {
+            // At this point, condition 6 has been satisfied since this node was reached.
+            // To ensure this, we must skip all of its descendants, which directly follow it in the table.
+            accepted.push_back(i);
+            next = table.subtreeEnds[i];
+        }
+    }
+}
+
+bool contourSatisfiesTextConditions(const ContourFeatureTable& table, int index, CvSize imageSize, CvPoint origin,
+                                    int largerDimensionMinimum, int maxChildrenCount)
+{
+    // Condition 1
+    CvRect rect = table.rects[index];
+    int largerDimension = table.largerDimensions[index];
+    if (largerDimension < largerDimensionMinimum) {
+        return false;
+    }
+    
+    // Condition 2
+    if (!table.aspectRatiosWithinTenthToTen[index]) {
+        return false;
+    }
+    
+    // Condition 3
+    if (largerDimension > MAX(imageSize.width, imageSize.height) / 5) {
+        return false;
+    }
+    
+    // Condition 4
+    rect.x += origin.x;
+    rect.y += origin.y;
+    if (rect.x <= 1 || rect.x + rect.width >= imageSize.width - 1 || rect.y <= 1 || rect.y + rect.height >= imageSize.height - 1) {
+        return false;
+    }
+    
+    // Condition 5 (ensures children also satifies condition 1-4)
+    return countOfContainedChildrenWithMinSize(table, index, maxChildrenCount + 1, largerDimensionMinimum) <= maxChildrenCount;
 }
 
-static int countOfContainedChildrenWithMinSize(CvContour* contour, int maxChildrenToCount, int minSize)
+static int countOfContainedChildrenWithMinSize(const ContourFeatureTable& table, int index, int maxChildrenToCount, int minSize)
 {
     int count = 0;
     
-    for (CvContour* child = (CvContour*)contour->v_next; child && count < maxChildrenToCount; child = (CvContour*)child->h_next) {
-        CvRect childRect = cvBoundingRect(child);
-        int largerDimension = MAX(childRect.width, childRect.height);
+    for (int child = table.firstChild(index); child >= 0 && count < maxChildrenToCount; child = table.nextSibling(child)) {
         // Child must satisfy conditions 1-4 to be included in count. Conditions 3-4 are implicitly satisfied by the parent and do
         // not need to be checked. The child edge box must be completely cotained with the parent edge box.
-        if (largerDimension > minSize &&
-            aspectRatioIsWithinTenthToTen(childRect) &&
-            rectContainsRect(cvBoundingRect(contour), childRect)) {
+        if (table.largerDimensions[child] > minSize &&
+            table.aspectRatiosWithinTenthToTen[child] &&
+            rectContainsRect(table.rects[index], table.rects[child])) {
             count++;
             if (count < maxChildrenToCount) {
-                count += countOfContainedChildrenWithMinSize(child, maxChildrenToCount - count, minSize);
+                count += countOfContainedChildrenWithMinSize(table, child, maxChildrenToCount - count, minSize);
             }
         }
     }
@@ -233,8 +319,8 @@ static int countOfContainedChildrenWithMinSize(CvContour* contour, int maxChildr
     return count;
 }
 
-// grayImg's origin is the origin of the cvBoundingRect(contour) subimage
-static int meanIntensityOfPixelsInContourInSubimage(IplImage* grayImg, CvContour* contour)
+// grayImg's origin is the origin of rect, the cvBoundingRect(contour) subimage
+static int meanIntensityOfPixelsInContourInSubimage(const CvMat* grayImg, CvContour* contour, const CvRect& rect)
 {
     int intensitySum = 0;
     int totalPointsSampled = 0;
@@ -245,8 +331,6 @@ static int meanIntensityOfPixelsInContourInSubimage(IplImage* grayImg, CvContour
     int count = contour->total - !CV_IS_SEQ_CLOSED(contour);
     CV_READ_SEQ_ELEM(pt1, reader);
     // move pt1 into the subrect coordinate frame
-    
-    CvRect rect = cvBoundingRect(contour);
     pt1.x -= rect.x;
     pt1.y -= rect.y;
     for (int i = 0; i < count; i++) {
@@ -256,7 +340,7 @@ static int meanIntensityOfPixelsInContourInSubimage(IplImage* grayImg, CvContour
         pt2.y -= rect.y;
         
         // Add pt1's intensity
-        intensitySum += *pixelAddr(grayImg, pt1);
+        intensitySum += CV_MAT_ELEM(*grayImg, uchar, pt1.y, pt1.x);
         totalPointsSampled++;
         
         // Iterate through the points in the line exclusive of pt1 and pt2, summing the grayscale intensity
@@ -273,13 +357,69 @@ static int meanIntensityOfPixelsInContourInSubimage(IplImage* grayImg, CvContour
     
     // Add final pt2 value if the contour is not closed
     if (!CV_IS_SEQ_CLOSED(contour)) {
-        intensitySum += *pixelAddr(grayImg, pt2);
+        intensitySum += CV_MAT_ELEM(*grayImg, uchar, pt2.y, pt2.x);
         totalPointsSampled++;
     }
     
     return totalPointsSampled ? (intensitySum / totalPointsSampled) : -1;
 }
 
+// grayImg's origin is at origin in the coordinate frame of the points. The pixels are gathered 16 at a time and summed with
+// SIMD where available.
+static int meanIntensityOfPoints(const CvMat* grayImg, const CvPoint* points, int count, CvPoint origin)
+{
+    if (count <= 0) {
+        return -1;
+    }
+    const uchar* data = grayImg->data.ptr - origin.y * grayImg->step - origin.x;
+    int step = grayImg->step;
+    int intensitySum = 0;
+    int i = 0;
+
+#if defined(__SSE2__) || defined(__ARM_NEON__) || defined(__ARM_NEON)
+    uchar gathered[16];
+#if defined(__SSE2__)
+    __m128i sums = _mm_setzero_si128();
+#else
+    uint32x4_t sums = vdupq_n_u32(0);
+#endif
+    for (; i + 16 <= count; i += 16) {
+        for (int j = 0; j < 16; j++) {
+            gathered[j] = data[points[i + j].y * step + points[i + j].x];
+        }
+#if defined(__SSE2__)
+        sums = _mm_add_epi64(sums, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)gathered), _mm_setzero_si128()));
+#else
+        sums = vpadalq_u16(sums, vpaddlq_u8(vld1q_u8(gathered)));
+#endif
+    }
+#if defined(__SSE2__)
+    intensitySum = _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+#else
+    uint64x2_t pairSums = vpaddlq_u32(sums);
+    intensitySum = (int)(vgetq_lane_u64(pairSums, 0) + vgetq_lane_u64(pairSums, 1));
+#endif
+#endif
+
+    for (; i < count; i++) {
+        intensitySum += data[points[i].y * step + points[i].x];
+    }
+    return intensitySum / count;
+}
+
+// grayImg's origin is the origin of the contour's bounding rect. If the table gathered the contours' points, which must
+// then be dense chain points, each pixel of the contour is read once from the table; otherwise the contour's polygon is
+// walked.
+static int meanIntensityOfTableContourInSubimage(const CvMat* grayImg, const ContourFeatureTable& table, int index)
+{
+    const CvRect& rect = table.rects[index];
+    if (table.points.empty()) {
+        return meanIntensityOfPixelsInContourInSubimage(grayImg, table.contours[index], rect);
+    }
+    return meanIntensityOfPoints(grayImg, &table.points[table.pointOffsets[index]], table.pointCounts[index],
+                                 cvPoint(rect.x, rect.y));
+}
+
 static inline uchar* pixelAddr(IplImage* img, CvPoint pt)
 {
     assert(pt.x >= 0 && pt.x < img->width && pt.y >= 0 && pt.y < img->height);
@@ -291,15 +431,299 @@ static inline uchar bgr2Gray(uchar bgr[3])
     return ((bgr[0] * 114 + bgr[1] * 587 + bgr[2] * 299) + 500) / 1000;
 }
 
-static int median(std::vector<int> values)
+// img is a gray or BGR(A) image
+static inline uchar grayPixel(IplImage* img, CvPoint pt)
+{
+    uchar* pixel = pixelAddr(img, pt);
+    return (img->nChannels == 1) ? *pixel : bgr2Gray(pixel);
+}
+
+// Samples the 3 pixels outside each corner of rect, which is safe because all rects within a pixel of the border are
+// excluded in the selection phase
+static int medianIntensityAroundRect(IplImage* img, const CvRect& rect)
+{
+    int cornerPoints[12] = {
+        grayPixel(img, cvPoint(rect.x - 1, rect.y - 1)),                              // ul
+        grayPixel(img, cvPoint(rect.x - 1, rect.y)),
+        grayPixel(img, cvPoint(rect.x, rect.y - 1)),
+        grayPixel(img, cvPoint(rect.x + rect.width + 1, rect.y - 1)),                 // ur
+        grayPixel(img, cvPoint(rect.x + rect.width, rect.y - 1)),
+        grayPixel(img, cvPoint(rect.x + rect.width + 1, rect.y)),
+        grayPixel(img, cvPoint(rect.x - 1, rect.y + rect.height + 1)),                // ll
+        grayPixel(img, cvPoint(rect.x - 1, rect.y + rect.height)),
+        grayPixel(img, cvPoint(rect.x, rect.y + rect.height + 1)),
+        grayPixel(img, cvPoint(rect.x + rect.width + 1, rect.y + rect.height + 1)),   // lr
+        grayPixel(img, cvPoint(rect.x + rect.width, rect.y + rect.height + 1)),
+        grayPixel(img, cvPoint(rect.x + rect.width + 1, rect.y + rect.height))
+    };
+    return median(cornerPoints, 12);
+}
+
+// The state shared by the tasks that binarize the accepted contours from a gray plane
+struct ContourBinarization {
+    enum {
+        blockSize = 8,                          // granularity of the gray conversion
+        contoursPerTask = 64,
+        bandHeight = 64
+    };
+    
+    IplImage* originalImg;
+    IplImage* grayImg;
+    IplImage* result;                           // NULL when writing packed rows
+    uchar* packed;
+    int packedStride;
+    CvSize size;
+    const ContourFeatureTable* table;
+    const std::vector<int>* accepted;           // indices into the table
+    std::vector<CvRect> rects;                  // of the accepted contours
+    std::vector<int> thresholds;
+    std::vector<uchar> inverted;
+    std::vector<uchar> blockNeeded;             // per block of blockSize x blockSize pixels
+    int blockColumns;
+    int bandCount;
+    bool drawRects;
+};
+
+// Converts the horizontal runs of needed blocks in a row of blocks
+static void convertBlockRowToGray(void* context, int row)
+{
+    ContourBinarization* binarization = (ContourBinarization*)context;
+    IplImage* img = binarization->originalImg;
+    IplImage* grayImg = binarization->grayImg;
+    int blockSize = ContourBinarization::blockSize;
+    int columns = binarization->blockColumns;
+    const uchar* blockNeeded = &binarization->blockNeeded[row * columns];
+    
+    int column = 0;
+    while (column < columns) {
+        if (!blockNeeded[column]) {
+            column++;
+            continue;
+        }
+        int runStart = column;
+        while (column < columns && blockNeeded[column]) {
+            column++;
+        }
+        
+        int x = runStart * blockSize;
+        int y = row * blockSize;
+        CvRect runRect = cvRect(x, y, MIN(column * blockSize, img->width) - x, MIN(y + blockSize, img->height) - y);
+        CvMat subimage, graySubimage;
+        cvGetSubRect(img, &subimage, runRect);
+        cvGetSubRect(grayImg, &graySubimage, runRect);
+        cvCvtColor(&subimage, &graySubimage, (img->nChannels == 3) ? CV_BGR2GRAY : CV_BGRA2GRAY);
+    }
+}
+
+// Estimates the foreground and background intensities of a range of contours
+static void estimateContourThresholds(void* context, int task)
+{
+    ContourBinarization* binarization = (ContourBinarization*)context;
+    size_t end = MIN((size_t)(task + 1) * ContourBinarization::contoursPerTask, binarization->rects.size());
+    for (size_t i = (size_t)task * ContourBinarization::contoursPerTask; i < end; i++) {
+        CvMat graySubimage;
+        cvGetSubRect(binarization->grayImg, &graySubimage, binarization->rects[i]);
+        
+        int foregroundIntensity = meanIntensityOfTableContourInSubimage(&graySubimage, *binarization->table,
+                                                                        (*binarization->accepted)[i]);
+        int backgroundIntensity = medianIntensityAroundRect(binarization->grayImg, binarization->rects[i]);
+        binarization->thresholds[i] = foregroundIntensity;
+        binarization->inverted[i] = foregroundIntensity > backgroundIntensity;
+    }
+}
+
+// Sets mask to 0xFF for each of count pixels that cvThreshold() would make black (0), and to 0 for the others
+static inline void thresholdRowToMask(const uchar* gray, int count, int threshold, bool inverted, uchar* mask)
 {
-    std::sort(values.begin(), values.end());
-    int middle = (int)(values.size() / 2);
-    return (values.size() % 2) ? values[middle] : (values[middle - 1] + values[middle] + 1) / 2;
+    // CV_THRESH_BINARY makes the pixels at or below the threshold black and CV_THRESH_BINARY_INV those above it
+    if (threshold < 0 || threshold >= UCHAR_MAX) {
+        bool above = threshold < 0;
+        memset(mask, (above == inverted) ? 0xFF : 0, count);
+        return;
+    }
+    
+    int x = 0;
+#if defined(__SSE2__)
+    __m128i signBits = _mm_set1_epi8((char)0x80);
+    __m128i signedThreshold = _mm_set1_epi8((char)(threshold ^ 0x80));
+    __m128i flip = inverted ? _mm_setzero_si128() : _mm_set1_epi8((char)0xFF);
+    for (; x + 16 <= count; x += 16) {
+        __m128i pixels = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(gray + x)), signBits);
+        _mm_storeu_si128((__m128i*)(mask + x), _mm_xor_si128(_mm_cmpgt_epi8(pixels, signedThreshold), flip));
+    }
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+    uint8x16_t thresholds = vdupq_n_u8((uchar)threshold);
+    uint8x16_t flip = vdupq_n_u8(inverted ? 0 : 0xFF);
+    for (; x + 16 <= count; x += 16) {
+        vst1q_u8(mask + x, veorq_u8(vcgtq_u8(vld1q_u8(gray + x), thresholds), flip));
+    }
+#endif
+    for (; x < count; x++) {
+        mask[x] = ((gray[x] > threshold) == inverted) ? 0xFF : 0;
+    }
 }
 
-std::vector<CvRect> findContigousIslands(CvContour* firstContour, int borderPadding, int minSize)
+// Thresholds the contours into the packed rows of a band. Each row segment is thresholded into a mask that is padded to
+// whole bytes and packed, and the bits outside the segment in its first and last bytes are kept.
+static void thresholdBandIntoPackedRows(ContourBinarization* binarization, int bandTop, int bandBottom)
 {
+    const IplImage* grayImg = binarization->grayImg;
+    std::vector<uchar> mask(binarization->size.width + 16);
+    std::vector<uchar> bits((binarization->size.width + 15) / 8);
+    
+    for (size_t i = 0; i < binarization->rects.size(); i++) {
+        const CvRect& rect = binarization->rects[i];
+        int top = MAX(rect.y, bandTop);
+        int bottom = MIN(rect.y + rect.height, bandBottom);
+        if (top >= bottom || rect.width <= 0) {
+            continue;
+        }
+        
+        int alignedX = rect.x & ~7;
+        int lead = rect.x - alignedX;
+        int alignedWidth = (lead + rect.width + 7) & ~7;
+        int firstByte = alignedX >> 3;
+        int byteCount = alignedWidth >> 3;
+        uchar firstByteMask = 0xFF >> lead;
+        uchar lastByteMask = (uchar)(0xFF << (alignedWidth - lead - rect.width));
+        if (byteCount == 1) {
+            firstByteMask &= lastByteMask;
+        }
+        memset(&mask[0], 0, lead);
+        memset(&mask[lead + rect.width], 0, alignedWidth - lead - rect.width);
+        
+        for (int y = top; y < bottom; y++) {
+            const uchar* gray = (const uchar*)grayImg->imageData + grayImg->widthStep * y + rect.x;
+            thresholdRowToMask(gray, rect.width, binarization->thresholds[i], binarization->inverted[i], &mask[lead]);
+            packBinaryRow(&mask[0], alignedWidth, &bits[0]);
+            
+            uchar* row = binarization->packed + binarization->packedStride * y + firstByte;
+            row[0] = (row[0] & ~firstByteMask) | (bits[0] & firstByteMask);
+            if (byteCount > 1) {
+                memcpy(row + 1, &bits[1], byteCount - 2);
+                row[byteCount - 1] = (row[byteCount - 1] & ~lastByteMask) | (bits[byteCount - 1] & lastByteMask);
+            }
+        }
+    }
+}
+
+// Thresholds every contour that intersects a band of rows into the result, clipped to the band. Since the contours are
+// applied in order within each band, overlapping rects resolve exactly as they would serially.
+static void thresholdBand(void* context, int band)
+{
+    ContourBinarization* binarization = (ContourBinarization*)context;
+    IplImage* result = binarization->result;
+    int bandHeight = (binarization->bandCount == 1) ? binarization->size.height : (int)ContourBinarization::bandHeight;
+    int bandTop = band * bandHeight;
+    int bandBottom = MIN(bandTop + bandHeight, binarization->size.height);
+    
+    if (binarization->packed) {
+        thresholdBandIntoPackedRows(binarization, bandTop, bandBottom);
+        return;
+    }
+    
+    for (size_t i = 0; i < binarization->rects.size(); i++) {
+        const CvRect& rect = binarization->rects[i];
+        int top = MAX(rect.y, bandTop);
+        int bottom = MIN(rect.y + rect.height, bandBottom);
+        if (top >= bottom) {
+            continue;
+        }
+        
+        CvRect clippedRect = cvRect(rect.x, top, rect.width, bottom - top);
+        CvMat graySubimage, resultSubimage;
+        cvGetSubRect(binarization->grayImg, &graySubimage, clippedRect);
+        cvGetSubRect(result, &resultSubimage, clippedRect);
+        cvThreshold(&graySubimage, &resultSubimage, binarization->thresholds[i], 255,
+                    binarization->inverted[i] ? CV_THRESH_BINARY_INV : CV_THRESH_BINARY);
+        
+        if (binarization->drawRects) {
+            cvRectangle(result, cvPoint(rect.x, rect.y), cvPoint(rect.x + rect.width, rect.y + rect.height), CV_RGB(255, 255, 0));
+        }
+    }
+}
+
+// Converts img to gray once, only within the blocks that are within a pixel of an accepted contour's bounding rect since
+// text rarely covers most of a page, and then thresholds each contour from a view of the gray plane straight into the result
+void binarizeTextContours(IplImage* img, const ContourFeatureTable& table, const std::vector<int>& accepted,
+                          IplImage* result, bool drawRects, int threadCount)
+{
+    binarizeAcceptedContours(img, table, accepted, result, NULL, 0, drawRects, threadCount);
+}
+
+// Writes into either the 8-bit result or the packed rows
+static void binarizeAcceptedContours(IplImage* img, const ContourFeatureTable& table, const std::vector<int>& accepted,
+                                     IplImage* result, uchar* packed, int packedStride, bool drawRects, int threadCount)
+{
+    if (accepted.empty()) {
+        return;
+    }
+    WorkerPool pool(threadCount);
+    
+    ContourBinarization binarization;
+    binarization.originalImg = img;
+    binarization.grayImg = img;
+    binarization.result = result;
+    binarization.packed = packed;
+    binarization.packedStride = packedStride;
+    binarization.size = cvGetSize(img);
+    binarization.table = &table;
+    binarization.accepted = &accepted;
+    binarization.drawRects = drawRects;
+    binarization.rects.resize(accepted.size());
+    for (size_t i = 0; i < accepted.size(); i++) {
+        binarization.rects[i] = table.rects[accepted[i]];
+    }
+    
+    if (img->nChannels != 1) {
+        int blockSize = ContourBinarization::blockSize;
+        int columns = (img->width + blockSize - 1) / blockSize;
+        int rows = (img->height + blockSize - 1) / blockSize;
+        binarization.blockColumns = columns;
+        binarization.blockNeeded.assign(columns * rows, 0);
+        for (size_t i = 0; i < accepted.size(); i++) {
+            CvRect rect = outsetRect(binarization.rects[i], 1, 1);
+            int firstColumn = MAX(rect.x, 0) / blockSize;
+            int lastColumn = MIN(rect.x + rect.width, img->width - 1) / blockSize;
+            int firstRow = MAX(rect.y, 0) / blockSize;
+            int lastRow = MIN(rect.y + rect.height, img->height - 1) / blockSize;
+            for (int row = firstRow; row <= lastRow; row++) {
+                memset(&binarization.blockNeeded[row * columns + firstColumn], 1, lastColumn - firstColumn + 1);
+            }
+        }
+        
+        binarization.grayImg = cvCreateImage(cvGetSize(img), IPL_DEPTH_8U, 1);
+        pool.run(rows, convertBlockRowToGray, &binarization);
+    }
+    
+    binarization.thresholds.resize(accepted.size());
+    binarization.inverted.resize(accepted.size());
+    int contourTasks = (int)((accepted.size() + ContourBinarization::contoursPerTask - 1) / ContourBinarization::contoursPerTask);
+    pool.run(contourTasks, estimateContourThresholds, &binarization);
+    
+    // Rects are drawn over the pixels of the contours before them, so drawing requires a single band
+    bool singleBand = pool.threadCount() == 1 || drawRects;
+    binarization.bandCount = singleBand ? 1 : (img->height + ContourBinarization::bandHeight - 1) / ContourBinarization::bandHeight;
+    pool.run(binarization.bandCount, thresholdBand, &binarization);
+    
+    if (binarization.grayImg != img) {
+        cvReleaseImage(&binarization.grayImg);
+    }
+}
+
+static int median(int* values, int count)
+{
+    std::sort(values, values + count);
+    int middle = count / 2;
+    return (count % 2) ? values[middle] : (values[middle - 1] + values[middle] + 1) / 2;
+}
+
+std::vector<CvRect> findContigousIslands(CvContour* firstContour, int borderPadding, int minSize,
+                                         std::vector<std::vector<CvContour*> >* islandContours)
+{
+    if (islandContours) {
+        islandContours->clear();
+    }
     if (!firstContour) {
         return std::vector<CvRect>();
     }
@@ -307,33 +731,49 @@ std::vector<CvRect> findContigousIslands(CvContour* firstContour, int borderPadd
     Bvh bvh;
     std::vector<CvRect> islands;
 
-    // Iterate over every contour and create the bounding volume hierarchy    
+    // Gather the rects of every contour and build the bounding volume hierarchy from them at once, so that the value of
+    // each rect is the index of its contour
+    std::vector<CvContour*> contours;
+    std::vector<CvRect> rects;
     CvTreeNodeIterator iterator;
     cvInitTreeNodeIterator(&iterator, firstContour, INT_MAX);
     CvContour* contour;
     while ((contour = (CvContour*)cvNextTreeNode(&iterator)) != NULL) {
-        bvh.insert(cvBoundingRect(contour), true);
+        contours.push_back(contour);
+        rects.push_back(cvBoundingRect(contour));
     }
+    bvh.build(rects);
     
     // Iterate through all remaining contour rects, making each a new island
     std::vector<CvRect> intersecting;
+    std::vector<uint32_t> members;
     while (!bvh.empty()) {
         // Get an arbitary rect and remove it from the BVH
-        CvRect rect = bvh.getAnyRect(true);
+        uint32_t member;
+        CvRect rect = bvh.getAnyRect(true, &member);
         
         intersecting.clear();
         intersecting.push_back(rect);
+        members.clear();
+        members.push_back(member);
         CvRect boundingBox = rect;
-        // Collect all transitively itersecting rects, iteratively, removing them from the BVH
+        // Collect all transitively itersecting rects and their contours, iteratively, removing them from the BVH
         for (size_t i = 0; i < intersecting.size(); i++) {
             CvRect outset = outsetRect(intersecting[i], borderPadding, borderPadding);
-            bvh.allMembersIntersecting(outset, intersecting, true);
+            bvh.allMembersIntersecting(outset, intersecting, members, true);
             boundingBox = rectUnion(boundingBox, intersecting[i]);
         }
         
         // Add the bounding box to islands if it is large enough
         if (boundingBox.width > minSize || boundingBox.height > minSize) {
             islands.push_back(boundingBox);
+            if (islandContours) {
+                islandContours->push_back(std::vector<CvContour*>(members.size()));
+                std::vector<CvContour*>& islandMembers = islandContours->back();
+                for (size_t i = 0; i < members.size(); i++) {
+                    islandMembers[i] = contours[members[i]];
+                }
+            }
         }
     }
     
@@ -7,23 +7,96 @@
 //
 
 #import "opencv2/opencv.hpp"
+#import "CannyEdgeDetector.hpp"
+#import "ContourFeatureTable.hpp"
+#import "BinaryImage.hpp"
+#import "LocalThreshold.hpp"
 
+// The edges of the color channels are found in a single pass with a 3x3 aperture. channelCombination is ignored for other
+// aperture sizes, whose per channel cvCanny() edges are always ORed. denseChainPoints is passed to
+// createStorageWithContours() and binarizeContours().
 IplImage* createBinarizedImage(IplImage *img,
                                double cannyLowThreshold = 50.0,
                                double cannyHighThreshold = 100.0,
-                               int apertureSize = 3);
+                               int apertureSize = 3,
+                               CannyEdgeDetector::ChannelCombination channelCombination = CannyEdgeDetector::ChannelCombinationOr,
+                               int threadCount = 1,
+                               bool denseChainPoints = false);
 
+// Binarizes the text contours of img, which may be gray or BGR(A), as createBinarizedImage() does, and every pixel outside
+// their bounding rects with localThreshold(), so that what the contour conditions reject, such as large glyphs, rules and
+// figures, is kept rather than left white
+IplImage* createHybridBinarizedImage(IplImage* img,
+                                     double cannyLowThreshold = 50.0,
+                                     double cannyHighThreshold = 100.0,
+                                     LocalThresholdMethod method = LocalThresholdMethodSauvola,
+                                     int windowSize = 25,
+                                     double k = 0.2,
+                                     int threadCount = 1);
+
+// If denseChainPoints is set, every pixel of each contour is kept (CV_CHAIN_APPROX_NONE) rather than only the vertices of
+// its horizontal, vertical and diagonal runs.
 CvMemStorage* createStorageWithContours(IplImage* cannyEdgeImg,     // modifies cannyEdgeImg
                                         CvContour** firstContour,
                                         IplImage* debugContourImage = NULL,
-                                        bool drawRects = false);
+                                        bool drawRects = false,
+                                        bool denseChainPoints = false);
+// If convertToGrayOnce is set, originalImg is converted to gray once and each contour is thresholded from a view of it
+// straight into the result, and originalImg may also be gray. Otherwise each contour's BGR(A) subimage is converted and
+// thresholded into intermediate images, which is slightly faster on one thread since only the contours' rects are
+// converted rather than the blocks around them. The background is estimated from the gray plane in the first case and by
+// bgr2Gray() in the second, whose rounding can differ by one.
+// With convertToGrayOnce, the contours are binarized by threadCount threads (0 for one per processor), and the result is
+// identical for any thread count.
+// denseChainPoints may only be set if the contours were found with it. The foreground intensity of each contour is
+// then the mean of its gathered chain pixels, each counted once, rather than the mean along the segments of its polygon,
+// which counts the vertices more than once, so the thresholds can differ slightly.
 IplImage* binarizeContours(IplImage* originalImg,
                            CvContour* firstContour,
                            int largerDimensionMinimum = 8,
                            int maxChildrenCount = 4,
-                           bool drawRects = false);
+                           bool drawRects = false,
+                           bool convertToGrayOnce = false,
+                           int threadCount = 1,
+                           bool denseChainPoints = false);
+
+// As binarizeContours() with convertToGrayOnce, but writes 1 bit per pixel rows of packedStride bytes into packed instead of
+// returning an 8-bit image (see BinaryImage.hpp). packedStride must be at least (width + 7) / 8, and the bytes past that in
+// each row are left unchanged.
+void binarizeContoursPacked(IplImage* originalImg,
+                            CvContour* firstContour,
+                            uchar* packed,
+                            int packedStride,
+                            int largerDimensionMinimum = 8,
+                            int maxChildrenCount = 4,
+                            int threadCount = 1,
+                            bool denseChainPoints = false);
+
+// As binarizeContoursPacked(), but replaces runs with the run lengths of each row
+void binarizeContoursToRuns(IplImage* originalImg,
+                            CvContour* firstContour,
+                            BinaryRuns& runs,
+                            int largerDimensionMinimum = 8,
+                            int maxChildrenCount = 4,
+                            int threadCount = 1,
+                            bool denseChainPoints = false);
+
+// Whether the contour at index satisfies conditions 1-5 of binarizeContours() in an image of imageSize. The table's
+// rects are offset by origin within the image, so that the contours found in a band of the image may be tested.
+bool contourSatisfiesTextConditions(const ContourFeatureTable& table, int index, CvSize imageSize, CvPoint origin,
+                                    int largerDimensionMinimum = 8, int maxChildrenCount = 4);
+
+// Thresholds the accepted contours, given as table indices in table order, from img into result as binarizeContours()
+// does with convertToGrayOnce. If the table gathered its points, they are taken to be dense chain points. Pixels of
+// result outside the accepted contours' rects are left unchanged.
+void binarizeTextContours(IplImage* img, const ContourFeatureTable& table, const std::vector<int>& accepted,
+                          IplImage* result, bool drawRects = false, int threadCount = 1);
 
-std::vector<CvRect> findContigousIslands(CvContour* firstContour, int borderPadding, int minSize);
+// Returns the bounding boxes of the groups of contours whose rects, outset by borderPadding, transitively intersect, where
+// the box is wider or taller than minSize. If islandContours is not NULL, it is set to the contours of each island, in the
+// same order as the islands.
+std::vector<CvRect> findContigousIslands(CvContour* firstContour, int borderPadding, int minSize,
+                                         std::vector<std::vector<CvContour*> >* islandContours = NULL);
 
 static inline void fastSetZero(IplImage *image)
 {
@@ -0,0 +1,331 @@
+//
+//  BinarizationBenchmark.cpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "BinarizationBenchmark.hpp"
+#import "Binarization.hpp"
+#import "CannyEdgeDetector.hpp"
+#import "LocalThreshold.hpp"
+#import "StreamingBinarizer.hpp"
+
+// Draws rows of randomly colored text on a tinted page with a few colored blocks, which approximates a color document scan
+static IplImage* createSyntheticPage(int width, int height)
+{
+    IplImage* page = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 3);
+    cvSet(page, cvScalar(225, 235, 240));
+    
+    CvRNG rng = cvRNG(1);
+    CvFont font;
+    double scale = height / 1400.0;
+    cvInitFont(&font, CV_FONT_HERSHEY_SIMPLEX, scale, scale, 0.0, MAX((int)scale * 2, 1));
+    int lineHeight = (int)(40 * scale);
+    
+    for (int i = 0; i < 4; i++) {
+        CvPoint origin = cvPoint(cvRandInt(&rng) % width, cvRandInt(&rng) % height);
+        CvPoint corner = cvPoint(origin.x + width / 4, origin.y + height / 10);
+        cvRectangle(page, origin, corner, cvScalar(cvRandInt(&rng) % 256, cvRandInt(&rng) % 256, cvRandInt(&rng) % 256), CV_FILLED);
+    }
+    
+    char line[64];
+    for (int y = lineHeight * 2; y < height - lineHeight; y += lineHeight) {
+        for (size_t k = 0; k + 1 < sizeof(line); k++) {
+            line[k] = (cvRandInt(&rng) % 6) ? (char)('a' + cvRandInt(&rng) % 26) : ' ';
+        }
+        line[sizeof(line) - 1] = '\0';
+        CvScalar color = cvScalar(cvRandInt(&rng) % 160, cvRandInt(&rng) % 160, cvRandInt(&rng) % 160);
+        cvPutText(page, line, cvPoint(lineHeight, y), &font, color);
+    }
+    return page;
+}
+
+BinarizationBenchmark::ColorEdgeResult BinarizationBenchmark::runColorEdgeComparison(int width, int height, int iterations)
+{
+    static const double lowThreshold = 50.0;
+    static const double highThreshold = 100.0;
+    
+    IplImage* page = createSyntheticPage(width, height);
+    IplImage* channelImage = cvCreateImage(cvGetSize(page), IPL_DEPTH_8U, 1);
+    IplImage* temp = cvCreateImage(cvGetSize(page), IPL_DEPTH_8U, 1);
+    IplImage* perChannelEdges = cvCreateImage(cvGetSize(page), IPL_DEPTH_8U, 1);
+    IplImage* singlePassEdges = cvCreateImage(cvGetSize(page), IPL_DEPTH_8U, 1);
+    CannyEdgeDetector detector;
+    
+    ColorEdgeResult result;
+    result.width = width;
+    result.height = height;
+    result.iterations = iterations;
+    result.mismatchedPixels = 0;
+    
+    std::vector<double> perChannelSamples;
+    std::vector<double> singlePassSamples[3];
+    
+    // The first iteration warms up the caches and the detector's buffers, and is not timed
+    for (int iteration = 0; iteration <= iterations; iteration++) {
+        int64 start = cvGetTickCount();
+        for (int i = 1; i <= 3; i++) {
+            cvSetImageCOI(page, i);
+            cvCopy(page, channelImage);
+            cvResetImageROI(page);
+            cvCanny(channelImage, (i == 1) ? perChannelEdges : temp, lowThreshold, highThreshold, 3 | CV_CANNY_L2_GRADIENT);
+            if (i > 1) {
+                cvOr(perChannelEdges, temp, perChannelEdges);
+            }
+        }
+        if (iteration > 0) {
+            perChannelSamples.push_back(ticksToSeconds(cvGetTickCount() - start));
+        }
+        
+        for (int combination = 0; combination < 3; combination++) {
+            start = cvGetTickCount();
+            detector.detectColorEdges(page, singlePassEdges, lowThreshold, highThreshold,
+                                      (CannyEdgeDetector::ChannelCombination)combination);
+            if (iteration > 0) {
+                singlePassSamples[combination].push_back(ticksToSeconds(cvGetTickCount() - start));
+            }
+            
+            if (combination == CannyEdgeDetector::ChannelCombinationOr && iteration == 0) {
+                cvXor(perChannelEdges, singlePassEdges, temp);
+                result.mismatchedPixels = cvCountNonZero(temp);
+            }
+        }
+    }
+    
+    result.perChannelCanny = percentiles(perChannelSamples);
+    for (int combination = 0; combination < 3; combination++) {
+        result.singlePass[combination] = percentiles(singlePassSamples[combination]);
+    }
+    
+    cvReleaseImage(&singlePassEdges);
+    cvReleaseImage(&perChannelEdges);
+    cvReleaseImage(&temp);
+    cvReleaseImage(&channelImage);
+    cvReleaseImage(&page);
+    return result;
+}
+
+BinarizationBenchmark::ScalingResult BinarizationBenchmark::runScaling(int dpi, const std::vector<int>& threadCounts,
+                                                                      int iterations)
+{
+    // A4 is 8.27 x 11.69 inches
+    IplImage* page = createSyntheticPage(dpi * 827 / 100, dpi * 1169 / 100);
+    IplImage* edges = cvCreateImage(cvGetSize(page), IPL_DEPTH_8U, 1);
+    IplImage* difference = cvCreateImage(cvGetSize(page), IPL_DEPTH_8U, 1);
+    IplImage* firstResult = NULL;
+    CannyEdgeDetector detector;
+    detector.detectColorEdges(page, edges, 50.0, 100.0, CannyEdgeDetector::ChannelCombinationOr);
+    CvContour* firstContour = NULL;
+    CvMemStorage* storage = createStorageWithContours(edges, &firstContour);
+    
+    ScalingResult result;
+    result.width = page->width;
+    result.height = page->height;
+    result.iterations = iterations;
+    result.threadCounts = threadCounts;
+    result.identical = true;
+    
+    for (size_t i = 0; i < threadCounts.size(); i++) {
+        std::vector<double> samples;
+        for (int iteration = 0; iteration <= iterations; iteration++) {
+            int64 start = cvGetTickCount();
+            IplImage* binarized = binarizeContours(page, firstContour, 8, 4, false, true, threadCounts[i]);
+            if (iteration > 0) {
+                samples.push_back(ticksToSeconds(cvGetTickCount() - start));
+            }
+            
+            if (!firstResult) {
+                firstResult = binarized;
+                continue;
+            }
+            cvXor(firstResult, binarized, difference);
+            result.identical = result.identical && !cvCountNonZero(difference);
+            cvReleaseImage(&binarized);
+        }
+        result.times.push_back(percentiles(samples));
+    }
+    
+    cvReleaseMemStorage(&storage);
+    cvReleaseImage(&firstResult);
+    cvReleaseImage(&difference);
+    cvReleaseImage(&edges);
+    cvReleaseImage(&page);
+    return result;
+}
+
+BinarizationBenchmark::LocalThresholdResult BinarizationBenchmark::runLocalThresholdComparison(int width, int height, int iterations)
+{
+    IplImage* page = createSyntheticPage(width, height);
+    IplImage* binarized = cvCreateImage(cvGetSize(page), IPL_DEPTH_8U, 1);
+    IplImage* contoursOnly = NULL;
+    IplImage* hybrid = NULL;
+    std::vector<double> samples[4];
+    
+    for (int iteration = 0; iteration <= iterations; iteration++) {
+        int64 ticks[5];
+        ticks[0] = cvGetTickCount();
+        IplImage* contourResult = createBinarizedImage(page);
+        ticks[1] = cvGetTickCount();
+        localThreshold(page, binarized, LocalThresholdMethodSauvola);
+        ticks[2] = cvGetTickCount();
+        localThreshold(page, binarized, LocalThresholdMethodNiblack, 25, -0.2);
+        ticks[3] = cvGetTickCount();
+        IplImage* hybridResult = createHybridBinarizedImage(page);
+        ticks[4] = cvGetTickCount();
+        
+        // The first iteration warms up the allocator and caches
+        if (iteration > 0) {
+            for (int i = 0; i < 4; i++) {
+                samples[i].push_back(ticksToSeconds(ticks[i + 1] - ticks[i]));
+            }
+        }
+        if (contoursOnly) {
+            cvReleaseImage(&contoursOnly);
+            cvReleaseImage(&hybrid);
+        }
+        contoursOnly = contourResult;
+        hybrid = hybridResult;
+    }
+    
+    LocalThresholdResult result;
+    result.width = width;
+    result.height = height;
+    result.iterations = iterations;
+    result.contours = percentiles(samples[0]);
+    result.sauvola = percentiles(samples[1]);
+    result.niblack = percentiles(samples[2]);
+    result.hybrid = percentiles(samples[3]);
+    cvXor(contoursOnly, hybrid, binarized);
+    result.hybridFilledPixels = cvCountNonZero(binarized);
+    
+    cvReleaseImage(&hybrid);
+    cvReleaseImage(&contoursOnly);
+    cvReleaseImage(&binarized);
+    cvReleaseImage(&page);
+    return result;
+}
+
+// Collects the bands emitted by a StreamingBinarizer into a whole image
+struct StreamedPage {
+    IplImage* result;
+    int nextRow;
+    bool inOrder;                   // whether each band began where the previous one ended
+};
+
+static void collectStreamedRows(void* info, const IplImage* rows, int firstRow)
+{
+    StreamedPage* page = (StreamedPage*)info;
+    page->inOrder = page->inOrder && firstRow == page->nextRow && firstRow + rows->height <= page->result->height;
+    for (int y = 0; y < rows->height && firstRow + y < page->result->height; y++) {
+        memcpy(page->result->imageData + page->result->widthStep * (firstRow + y), rows->imageData + rows->widthStep * y,
+               rows->width);
+    }
+    page->nextRow = firstRow + rows->height;
+}
+
+BinarizationBenchmark::StreamingResult BinarizationBenchmark::runStreamingCheck(const std::vector<int>& bandHeights,
+                                                                                const std::vector<int>& overlaps,
+                                                                                int width, int height)
+{
+    assert(bandHeights.size() == overlaps.size());
+    IplImage* page = createSyntheticPage(width, height);
+    IplImage* binarized = createBinarizedImage(page);
+    IplImage* difference = cvCreateImage(cvGetSize(page), IPL_DEPTH_8U, 1);
+    
+    StreamingResult result;
+    result.width = width;
+    result.height = height;
+    result.bandHeights = bandHeights;
+    result.overlaps = overlaps;
+    result.passed = true;
+    
+    for (size_t i = 0; i < bandHeights.size(); i++) {
+        StreamedPage streamed;
+        streamed.result = cvCreateImage(cvGetSize(page), IPL_DEPTH_8U, 1);
+        streamed.nextRow = 0;
+        streamed.inOrder = true;
+        StreamingBinarizer binarizer(cvGetSize(page), page->nChannels, collectStreamedRows, &streamed, bandHeights[i],
+                                     overlaps[i]);
+        
+        // Push an odd number of rows at a time, so that the pushes straddle the bands and windows
+        for (int y = 0; y < height; y += 37) {
+            IplImage rows;
+            cvInitImageHeader(&rows, cvSize(width, MIN(37, height - y)), IPL_DEPTH_8U, page->nChannels);
+            cvSetData(&rows, page->imageData + page->widthStep * y, page->widthStep);
+            binarizer.pushRows(&rows);
+        }
+        
+        cvXor(binarized, streamed.result, difference);
+        int mismatchedPixels = cvCountNonZero(difference);
+        result.mismatchedPixels.push_back(mismatchedPixels);
+        result.passed = result.passed && binarizer.finished() && streamed.inOrder && streamed.nextRow == height &&
+                        mismatchedPixels == 0;
+        cvReleaseImage(&streamed.result);
+    }
+    
+    cvReleaseImage(&difference);
+    cvReleaseImage(&binarized);
+    cvReleaseImage(&page);
+    return result;
+}
+
+std::string BinarizationBenchmark::json(const ColorEdgeResult& result)
+{
+    std::string string;
+    appendFormat(string, "{\"width\": %d, \"height\": %d, \"iterations\": %d, \"mismatched_pixels\": %d,\n ",
+                 result.width, result.height, result.iterations, result.mismatchedPixels);
+    appendPercentiles(string, "per_channel_canny_ms", result.perChannelCanny);
+    string += ",\n ";
+    appendPercentiles(string, "maximum_ms", result.singlePass[CannyEdgeDetector::ChannelCombinationMaximum]);
+    string += ",\n ";
+    appendPercentiles(string, "sum_ms", result.singlePass[CannyEdgeDetector::ChannelCombinationSum]);
+    string += ",\n ";
+    appendPercentiles(string, "or_ms", result.singlePass[CannyEdgeDetector::ChannelCombinationOr]);
+    string += "}\n";
+    return string;
+}
+
+std::string BinarizationBenchmark::json(const ScalingResult& result)
+{
+    std::string string;
+    appendFormat(string, "{\"width\": %d, \"height\": %d, \"iterations\": %d, \"identical\": %s, \"threads\": [",
+                 result.width, result.height, result.iterations, result.identical ? "true" : "false");
+    for (size_t i = 0; i < result.threadCounts.size(); i++) {
+        appendFormat(string, "%s\n  {\"count\": %d, ", (i == 0) ? "" : ",", result.threadCounts[i]);
+        appendPercentiles(string, "ms", result.times[i]);
+        string += "}";
+    }
+    string += "]}\n";
+    return string;
+}
+
+std::string BinarizationBenchmark::json(const LocalThresholdResult& result)
+{
+    std::string string;
+    appendFormat(string, "{\"width\": %d, \"height\": %d, \"iterations\": %d, \"hybrid_filled_pixels\": %d,\n ",
+                 result.width, result.height, result.iterations, result.hybridFilledPixels);
+    appendPercentiles(string, "contours_ms", result.contours);
+    string += ",\n ";
+    appendPercentiles(string, "sauvola_ms", result.sauvola);
+    string += ",\n ";
+    appendPercentiles(string, "niblack_ms", result.niblack);
+    string += ",\n ";
+    appendPercentiles(string, "hybrid_ms", result.hybrid);
+    string += "}\n";
+    return string;
+}
+
+std::string BinarizationBenchmark::json(const StreamingResult& result)
+{
+    std::string string;
+    appendFormat(string, "{\"width\": %d, \"height\": %d, \"passed\": %s, \"bands\": [", result.width, result.height,
+                 result.passed ? "true" : "false");
+    for (size_t i = 0; i < result.bandHeights.size(); i++) {
+        appendFormat(string, "%s\n  {\"band_height\": %d, \"overlap\": %d, \"mismatched_pixels\": %d}", (i == 0) ? "" : ",",
+                     result.bandHeights[i], result.overlaps[i], result.mismatchedPixels[i]);
+    }
+    string += "]}\n";
+    return string;
+}
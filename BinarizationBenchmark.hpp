@@ -0,0 +1,79 @@
+//
+//  BinarizationBenchmark.hpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "opencv2/opencv.hpp"
+#import "BenchmarkUtilities.hpp"
+#import <string>
+#import <vector>
+
+// Times the stages of binarizing color document pages against the approaches they replaced, on synthetic pages
+class BinarizationBenchmark {
+public:
+    typedef BenchmarkPercentiles Percentiles;
+    
+    // Compares the time to detect the edges of a color page of the given size, A4 at 300 dpi by default, using cvCanny() on
+    // each channel combined with cvOr() as createBinarizedImage() once did, against a single pass of
+    // CannyEdgeDetector::detectColorEdges() with each of its channel combinations
+    struct ColorEdgeResult {
+        int width;
+        int height;
+        int iterations;
+        Percentiles perChannelCanny;
+        Percentiles singlePass[3];  // indexed by CannyEdgeDetector::ChannelCombination
+        int mismatchedPixels;       // between the per channel edges and ChannelCombinationOr, which should be 0
+    };
+    static ColorEdgeResult runColorEdgeComparison(int width = 2480, int height = 3508, int iterations = 10);
+    
+    // Times binarizeContours() on a synthetic color A4 page scanned at dpi with each of the thread counts
+    struct ScalingResult {
+        int width;
+        int height;
+        int iterations;
+        std::vector<int> threadCounts;
+        std::vector<Percentiles> times;
+        bool identical;             // whether every thread count produced the same image as the first
+    };
+    static ScalingResult runScaling(int dpi, const std::vector<int>& threadCounts, int iterations = 5);
+    
+    // Times createBinarizedImage() against localThreshold() with each method and createHybridBinarizedImage() on the same
+    // synthetic color page, A4 at 300 dpi by default
+    struct LocalThresholdResult {
+        int width;
+        int height;
+        int iterations;
+        Percentiles contours;       // createBinarizedImage()
+        Percentiles sauvola;
+        Percentiles niblack;
+        Percentiles hybrid;
+        int hybridFilledPixels;     // black pixels that the hybrid adds outside the accepted contours
+    };
+    static LocalThresholdResult runLocalThresholdComparison(int width = 2480, int height = 3508, int iterations = 5);
+    
+    // Streams a synthetic color page through a StreamingBinarizer with each band height and overlap, pushing a few rows at
+    // a time, and compares the emitted rows with createBinarizedImage() on the whole page. Checks that every row is emitted
+    // once and in order, including when the overlap exceeds the band height, and that the results are identical.
+    struct StreamingResult {
+        int width;
+        int height;
+        std::vector<int> bandHeights;
+        std::vector<int> overlaps;
+        std::vector<int> mismatchedPixels;  // against createBinarizedImage()
+        bool passed;
+    };
+    static StreamingResult runStreamingCheck(const std::vector<int>& bandHeights, const std::vector<int>& overlaps,
+                                             int width = 600, int height = 800);
+    
+    // Formats the results as JSON with times in milliseconds
+    static std::string json(const ColorEdgeResult& result);
+    static std::string json(const ScalingResult& result);
+    static std::string json(const LocalThresholdResult& result);
+    static std::string json(const StreamingResult& result);
+    
+private:
+    BinarizationBenchmark();
+};
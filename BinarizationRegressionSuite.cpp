@@ -0,0 +1,223 @@
+//
+//  BinarizationRegressionSuite.cpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "BinarizationRegressionSuite.hpp"
+#import "Binarization.hpp"
+#import "BenchmarkUtilities.hpp"
+
+static BinarizationRegressionSuite::PageSpec pageSpec(const char* name, int font, double scale, bool lightTextOnDark,
+                                                      bool gradientBackground, double noiseDeviation, int blurAperture,
+                                                      int seed, double minimumFMeasure, double minimumIslandCoverage)
+{
+    BinarizationRegressionSuite::PageSpec spec;
+    spec.name = name;
+    spec.width = 1000;
+    spec.height = 1300;
+    spec.font = font;
+    spec.scale = scale;
+    spec.lightTextOnDark = lightTextOnDark;
+    spec.gradientBackground = gradientBackground;
+    spec.noiseDeviation = noiseDeviation;
+    spec.blurAperture = blurAperture;
+    spec.seed = seed;
+    spec.minimumFMeasure = minimumFMeasure;
+    spec.minimumIslandCoverage = minimumIslandCoverage;
+    return spec;
+}
+
+std::vector<BinarizationRegressionSuite::PageSpec> BinarizationRegressionSuite::defaultPages()
+{
+    std::vector<PageSpec> pages;
+    pages.push_back(pageSpec("simplex", CV_FONT_HERSHEY_SIMPLEX, 1.0, false, false, 0.0, 1, 1, 0.97, 0.99));
+    pages.push_back(pageSpec("duplex_small", CV_FONT_HERSHEY_DUPLEX, 0.7, false, false, 0.0, 1, 2, 0.82, 0.99));
+    pages.push_back(pageSpec("complex_large", CV_FONT_HERSHEY_COMPLEX, 1.6, false, false, 0.0, 1, 3, 0.96, 0.99));
+    pages.push_back(pageSpec("triplex_gradient", CV_FONT_HERSHEY_TRIPLEX, 1.2, false, true, 0.0, 1, 4, 0.97, 0.99));
+    pages.push_back(pageSpec("italic_inverted", CV_FONT_HERSHEY_SIMPLEX | CV_FONT_ITALIC, 1.0, true, false, 0.0, 1, 5, 0.97, 0.99));
+    pages.push_back(pageSpec("duplex_noise", CV_FONT_HERSHEY_DUPLEX, 1.0, false, false, 8.0, 1, 6, 0.93, 0.99));
+    pages.push_back(pageSpec("complex_blur", CV_FONT_HERSHEY_COMPLEX, 1.2, false, false, 0.0, 3, 7, 0.96, 0.99));
+    pages.push_back(pageSpec("inverted_gradient_noise_blur", CV_FONT_HERSHEY_DUPLEX, 1.2, true, true, 6.0, 3, 8, 0.96, 0.99));
+    return pages;
+}
+
+IplImage* BinarizationRegressionSuite::renderPage(const PageSpec& spec, IplImage** groundTruth)
+{
+    CvRNG rng = cvRNG(spec.seed);
+    IplImage* page = cvCreateImage(cvSize(spec.width, spec.height), IPL_DEPTH_8U, 3);
+    IplImage* truth = cvCreateImage(cvGetSize(page), IPL_DEPTH_8U, 1);
+    memset(truth->imageData, UCHAR_MAX, truth->imageSize);
+    
+    // Paper and ink colors with at least 120 levels of contrast in each channel
+    int paper = 200 + cvRandInt(&rng) % 40;
+    int ink = 20 + cvRandInt(&rng) % 60;
+    if (spec.lightTextOnDark) {
+        std::swap(paper, ink);
+    }
+    CvScalar paperColor = cvScalar(paper, paper - 5, paper + 5);
+    CvScalar inkColor = cvScalar(ink + 10, ink, ink + 5);
+    if (spec.gradientBackground) {
+        // Fade the paper by up to 60 levels toward the ink from left to right
+        double direction = spec.lightTextOnDark ? 1.0 : -1.0;
+        for (int x = 0; x < page->width; x++) {
+            double offset = direction * 60.0 * x / page->width;
+            cvLine(page, cvPoint(x, 0), cvPoint(x, page->height - 1),
+                   cvScalar(paperColor.val[0] + offset, paperColor.val[1] + offset, paperColor.val[2] + offset));
+        }
+    } else {
+        cvSet(page, paperColor);
+    }
+    
+    // Lines of random characters drawn identically into the page and the ground truth
+    CvFont font;
+    cvInitFont(&font, spec.font, spec.scale, spec.scale, 0.0, MAX((int)(spec.scale * 2.0), 1));
+    int lineHeight = (int)(48 * spec.scale);
+    int margin = lineHeight;
+    char line[128];
+    for (int y = margin * 2; y < page->height - margin; y += lineHeight) {
+        int length = 0;
+        CvSize size;
+        int baseline;
+        do {
+            line[length++] = (cvRandInt(&rng) % 6) ? '!' + cvRandInt(&rng) % 94 : ' ';
+            line[length] = '\0';
+            cvGetTextSize(line, &font, &size, &baseline);
+        } while (size.width < page->width - 2 * margin - lineHeight && length < (int)sizeof(line) - 1);
+        line[--length] = '\0';
+        
+        cvPutText(page, line, cvPoint(margin, y), &font, inkColor);
+        cvPutText(truth, line, cvPoint(margin, y), &font, cvScalarAll(0));
+    }
+    
+    if (spec.blurAperture > 1) {
+        cvSmooth(page, page, CV_GAUSSIAN, spec.blurAperture, spec.blurAperture);
+    }
+    if (spec.noiseDeviation > 0.0) {
+        IplImage* noisy = cvCreateImage(cvGetSize(page), IPL_DEPTH_32F, 3);
+        IplImage* noise = cvCreateImage(cvGetSize(page), IPL_DEPTH_32F, 3);
+        cvConvert(page, noisy);
+        cvRandArr(&rng, noise, CV_RAND_NORMAL, cvScalarAll(0.0), cvScalarAll(spec.noiseDeviation));
+        cvAdd(noisy, noise, noisy);
+        cvConvert(noisy, page);         // saturates
+        cvReleaseImage(&noise);
+        cvReleaseImage(&noisy);
+    }
+    
+    if (groundTruth) {
+        *groundTruth = truth;
+    } else {
+        cvReleaseImage(&truth);
+    }
+    return page;
+}
+
+BinarizationRegressionSuite::PageResult BinarizationRegressionSuite::runPage(const PageSpec& spec)
+{
+    IplImage* truth = NULL;
+    IplImage* page = renderPage(spec, &truth);
+    
+    PageResult result;
+    result.name = spec.name;
+    
+    int64 start = cvGetTickCount();
+    IplImage* binarized = createBinarizedImage(page);
+    result.binarizedImageSeconds = ticksToSeconds(cvGetTickCount() - start);
+    
+    // Time the later stages separately on their own contours
+    IplImage* edges = cvCreateImage(cvGetSize(page), IPL_DEPTH_8U, 1);
+    CannyEdgeDetector detector;
+    detector.detectColorEdges(page, edges, 50.0, 100.0, CannyEdgeDetector::ChannelCombinationOr);
+    CvContour* firstContour = NULL;
+    CvMemStorage* storage = createStorageWithContours(edges, &firstContour);
+    
+    // With the arguments createBinarizedImage() passes, so that the results can be compared
+    start = cvGetTickCount();
+    IplImage* contoursBinarized = binarizeContours(page, firstContour, 8, 4, false, true, 1);
+    result.binarizeContoursSeconds = ticksToSeconds(cvGetTickCount() - start);
+    cvXor(binarized, contoursBinarized, contoursBinarized);
+    result.contoursMismatchedPixels = cvCountNonZero(contoursBinarized);
+    
+    start = cvGetTickCount();
+    std::vector<CvRect> islands = findContigousIslands(firstContour, 4, 8);
+    result.islandsSeconds = ticksToSeconds(cvGetTickCount() - start);
+    result.islands = (int)islands.size();
+    
+    // Reuse the edge image to mark the islands
+    fastSetZero(edges);
+    for (size_t i = 0; i < islands.size(); i++) {
+        cvRectangle(edges, cvPoint(islands[i].x, islands[i].y),
+                    cvPoint(islands[i].x + islands[i].width - 1, islands[i].y + islands[i].height - 1), cvScalarAll(UCHAR_MAX), CV_FILLED);
+    }
+    
+    // Score the black pixels against the glyph pixels, and count the glyph pixels within islands
+    long truePositives = 0, falsePositives = 0, falseNegatives = 0, glyphsInIslands = 0;
+    for (int y = 0; y < page->height; y++) {
+        const uchar* binarizedRow = (const uchar*)binarized->imageData + binarized->widthStep * y;
+        const uchar* truthRow = (const uchar*)truth->imageData + truth->widthStep * y;
+        const uchar* islandRow = (const uchar*)edges->imageData + edges->widthStep * y;
+        for (int x = 0; x < page->width; x++) {
+            bool black = binarizedRow[x] == 0;
+            bool glyph = truthRow[x] == 0;
+            truePositives += black && glyph;
+            falsePositives += black && !glyph;
+            falseNegatives += !black && glyph;
+            glyphsInIslands += glyph && islandRow[x];
+        }
+    }
+    result.precision = truePositives ? (double)truePositives / (truePositives + falsePositives) : 0.0;
+    result.recall = truePositives ? (double)truePositives / (truePositives + falseNegatives) : 0.0;
+    result.fMeasure = (result.precision + result.recall > 0.0) ?
+        2.0 * result.precision * result.recall / (result.precision + result.recall) : 0.0;
+    
+    long glyphs = truePositives + falseNegatives;
+    result.islandCoverage = glyphs ? (double)glyphsInIslands / glyphs : 1.0;
+    result.passed = result.fMeasure >= spec.minimumFMeasure && result.islandCoverage >= spec.minimumIslandCoverage &&
+                    result.contoursMismatchedPixels == 0;
+    
+    cvReleaseMemStorage(&storage);
+    cvReleaseImage(&contoursBinarized);
+    cvReleaseImage(&edges);
+    cvReleaseImage(&binarized);
+    cvReleaseImage(&truth);
+    cvReleaseImage(&page);
+    return result;
+}
+
+std::vector<BinarizationRegressionSuite::PageResult> BinarizationRegressionSuite::run(const std::vector<PageSpec>& pages)
+{
+    std::vector<PageResult> results;
+    for (size_t i = 0; i < pages.size(); i++) {
+        results.push_back(runPage(pages[i]));
+    }
+    return results;
+}
+
+bool BinarizationRegressionSuite::allPassed(const std::vector<PageResult>& results)
+{
+    for (size_t i = 0; i < results.size(); i++) {
+        if (!results[i].passed) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string BinarizationRegressionSuite::json(const std::vector<PageResult>& results)
+{
+    std::string string = "[\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const PageResult& result = results[i];
+        appendFormat(string, " {\"name\": \"%s\", \"passed\": %s, \"precision\": %.4f, \"recall\": %.4f, \"f_measure\": %.4f,\n",
+                     result.name.c_str(), result.passed ? "true" : "false", result.precision, result.recall, result.fMeasure);
+        appendFormat(string, "  \"island_coverage\": %.4f, \"islands\": %d, \"contours_mismatched_pixels\": %d, "
+                     "\"binarized_image_ms\": %.3f,\n  \"binarize_contours_ms\": %.3f, \"islands_ms\": %.3f}%s\n",
+                     result.islandCoverage, result.islands, result.contoursMismatchedPixels,
+                     result.binarizedImageSeconds * 1000.0, result.binarizeContoursSeconds * 1000.0,
+                     result.islandsSeconds * 1000.0, (i + 1 < results.size()) ? "," : "");
+    }
+    string += "]\n";
+    return string;
+}
@@ -0,0 +1,60 @@
+//
+//  BinarizationRegressionSuite.hpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "opencv2/opencv.hpp"
+#import <string>
+#import <vector>
+
+// Renders synthetic color pages of text whose glyph pixels are known exactly, binarizes them, and scores the result against
+// that ground truth while timing createBinarizedImage(), binarizeContours() and findContigousIslands(). Each page has
+// minimum scores, so that performance work on those functions cannot silently degrade their output, and the separately
+// timed binarizeContours() must reproduce createBinarizedImage() exactly.
+class BinarizationRegressionSuite {
+public:
+    struct PageSpec {
+        std::string name;
+        int width;
+        int height;
+        int font;                       // CV_FONT_HERSHEY_*, optionally with CV_FONT_ITALIC
+        double scale;                   // of the font
+        bool lightTextOnDark;
+        bool gradientBackground;        // a horizontal gradient rather than a flat color
+        double noiseDeviation;          // of the Gaussian noise added to each channel
+        int blurAperture;               // of the Gaussian blur, or 1 for none
+        int seed;
+        double minimumFMeasure;         // of the black pixels against the glyph pixels
+        double minimumIslandCoverage;   // fraction of the glyph pixels that fall within an island
+    };
+    
+    struct PageResult {
+        std::string name;
+        double precision;               // of the black pixels
+        double recall;                  // of the glyph pixels
+        double fMeasure;
+        double islandCoverage;
+        int islands;
+        double binarizedImageSeconds;   // createBinarizedImage()
+        double binarizeContoursSeconds;
+        double islandsSeconds;          // findContigousIslands()
+        int contoursMismatchedPixels;   // between binarizeContours() and createBinarizedImage(), which should be 0
+        bool passed;
+    };
+    
+    // Pages of varied fonts, sizes, polarities, backgrounds, noise and blur, with minimums a little below the current scores
+    static std::vector<PageSpec> defaultPages();
+    
+    // Returns the BGR page, and if groundTruth is not NULL, a new 0/255 image that is 0 at the glyph pixels
+    static IplImage* renderPage(const PageSpec& spec, IplImage** groundTruth = NULL);
+    
+    static PageResult runPage(const PageSpec& spec);
+    static std::vector<PageResult> run(const std::vector<PageSpec>& pages = defaultPages());
+    static bool allPassed(const std::vector<PageResult>& results);
+    
+    // Formats the results as a JSON array with times in milliseconds
+    static std::string json(const std::vector<PageResult>& results);
+};
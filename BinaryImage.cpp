@@ -0,0 +1,91 @@
+//
+//  BinaryImage.cpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "BinaryImage.hpp"
+
+#if defined(__SSE2__)
+#import <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#import <arm_neon.h>
+#endif
+
+#if defined(__SSE2__)
+// Reverses the bits of a byte, since _mm_movemask_epi8() puts the first pixel in the least significant bit
+static inline uchar reverseBits(unsigned value)
+{
+    return (uchar)((((value * 0x80200802ULL) & 0x0884422110ULL) * 0x0101010101ULL) >> 32);
+}
+#endif
+
+void packBinaryRow(const uchar* mask, int count, uchar* packed)
+{
+    int x = 0;
+
+#if defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+    for (; x + 16 <= count; x += 16) {
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(mask + x));
+        int bits = _mm_movemask_epi8(_mm_cmpeq_epi8(pixels, zero)) ^ 0xFFFF;
+        packed[x >> 3] = reverseBits(bits & 0xFF);
+        packed[(x >> 3) + 1] = reverseBits(bits >> 8);
+    }
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+    static const uchar bitWeights[16] = { 128, 64, 32, 16, 8, 4, 2, 1, 128, 64, 32, 16, 8, 4, 2, 1 };
+    uint8x16_t weights = vld1q_u8(bitWeights);
+    for (; x + 16 <= count; x += 16) {
+        // Weight each set pixel by its bit and add adjacent pixels until each byte's 8 pixels are summed
+        uint8x16_t bits = vandq_u8(vtstq_u8(vld1q_u8(mask + x), vld1q_u8(mask + x)), weights);
+        uint8x8_t sums = vpadd_u8(vget_low_u8(bits), vget_high_u8(bits));
+        sums = vpadd_u8(sums, sums);
+        sums = vpadd_u8(sums, sums);
+        packed[x >> 3] = vget_lane_u8(sums, 0);
+        packed[(x >> 3) + 1] = vget_lane_u8(sums, 1);
+    }
+#endif
+
+    for (; x < count; x += 8) {
+        uchar byte = 0;
+        int end = MIN(x + 8, count);
+        for (int i = x; i < end; i++) {
+            if (mask[i]) {
+                byte |= 0x80 >> (i - x);
+            }
+        }
+        packed[x >> 3] = byte;
+    }
+}
+
+void BinaryRuns::reset(int newWidth)
+{
+    width = newWidth;
+    rowStarts.assign(1, 0);
+    lengths.clear();
+}
+
+void BinaryRuns::appendPackedRow(const uchar* packed)
+{
+    bool black = false;
+    int runStart = 0;
+    int x = 0;
+    while (x < width) {
+        uchar byte = packed[x >> 3];
+        // Skip whole bytes of the current color
+        if ((x & 7) == 0 && x + 8 <= width && byte == (black ? 0xFF : 0x00)) {
+            x += 8;
+            continue;
+        }
+        if (((byte >> (7 - (x & 7))) & 1) != black) {
+            lengths.push_back(x - runStart);
+            runStart = x;
+            black = !black;
+        }
+        x++;
+    }
+    lengths.push_back(width - runStart);
+    rowStarts.push_back((int)lengths.size());
+}
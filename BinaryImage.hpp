@@ -0,0 +1,36 @@
+//
+//  BinaryImage.hpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "opencv2/opencv.hpp"
+#import <vector>
+
+// Compact representations of a binarized page, in which black is a pixel that is 0 in the 8-bit result. Packed rows hold 8
+// pixels per byte, most significant bit first, with set bits for black pixels as in PBM and TIFF with MinIsWhite, and any
+// bits past the width of a row are clear.
+
+// Sets the bit of each of count pixels of packed whose mask byte is nonzero, and clears the others. packed must have
+// (count + 7) / 8 bytes.
+void packBinaryRow(const uchar* mask, int count, uchar* packed);
+
+// Rows of alternating white and black run lengths, starting with a white run that may be empty, as CCITT encoders take them
+struct BinaryRuns {
+    BinaryRuns() : width (0) {}
+    
+    // Empties the runs for rows of width pixels
+    void reset(int newWidth);
+    // Appends a row of width packed pixels
+    void appendPackedRow(const uchar* packed);
+    
+    int height() const { return (int)rowStarts.size() - 1; }
+    int runCount(int row) const { return rowStarts[row + 1] - rowStarts[row]; }
+    const int* runs(int row) const { return &lengths[rowStarts[row]]; }
+    
+    int width;
+    std::vector<int> rowStarts;         // the runs of row y are [rowStarts[y], rowStarts[y + 1])
+    std::vector<int> lengths;
+};
@@ -9,152 +9,804 @@
 #import "opencv2/opencv.hpp"
 #import "CvRectUtilities.hpp"
 #import "Bvh.hpp"
+#import "WorkerPool.hpp"
+#import <algorithm>
 
-BvhNode& BvhNode::operator=(const BvhNode& node)
-{
-    if (this != &node) {
-        rect = node.rect;
-        BvhNode *l = NULL;
-        BvhNode *r = NULL;
-        if (node.left) {
-            try {
-                l = new BvhNode(*node.left);
-                r = new BvhNode(*node.right);
-            } catch (...) {
-                delete l;
-                delete r;
-                throw;
-            }
-        }
-        delete left;
-        left = l;
-        delete right;
-        right = r;
+#if defined(__SSE2__)
+#import <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#import <arm_neon.h>
+#endif
+
+void Bvh::swap(Bvh& bvh)
+{
+    nodes.swap(bvh.nodes);
+    std::swap(root, bvh.root);
+    std::swap(freeList, bvh.freeList);
+}
+
+uint32_t Bvh::allocateNode(const CvRect& rect, uint32_t left, uint32_t right)
+{
+    uint32_t index;
+    if (freeList != nullIndex) {
+        index = freeList;
+        freeList = nodes[index].left;
+    } else {
+        index = (uint32_t)nodes.size();
+        nodes.push_back(Node());
     }
-    return *this;
+    Node& node = nodes[index];
+    node.rect = rect;
+    node.left = left;
+    node.right = right;
+    return index;
+}
+
+void Bvh::freeNode(uint32_t index)
+{
+    nodes[index].left = freeList;
+    freeList = index;
 }
 
-void BvhNode::insert(const CvRect& newRect, bool skipContainedRects)
+void Bvh::insert(const CvRect& newRect, bool skipContainedRects, uint32_t value)
 {
-    if (skipContainedRects && !left && rectContainsRect(rect, newRect)) {
+    if (root == nullIndex) {
+        root = allocateNode(newRect, nullIndex, value);
         return;
     }
     
-    CvRect newBoundingBox = rectUnion(rect, newRect);
-    
-    if (!left) {
-        assert(!right);
-        left = new BvhNode(rect);
-        right = new BvhNode(newRect);
-        rect = newBoundingBox;
-    } else {        
+    // Descend iteratively, taking care not to hold references into nodes across allocations
+    uint32_t index = root;
+    for (;;) {
+        CvRect rect = nodes[index].rect;
+        uint32_t left = nodes[index].left;
+        uint32_t right = nodes[index].right;
+        
+        if (skipContainedRects && left == nullIndex && rectContainsRect(rect, newRect)) {
+            return;
+        }
+        
+        CvRect newBoundingBox = rectUnion(rect, newRect);
+        
+        if (left == nullIndex) {
+            // The leaf becomes the parent of its old rect and value and the new ones
+            left = allocateNode(rect, nullIndex, right);
+            right = allocateNode(newRect, nullIndex, value);
+            Node& node = nodes[index];
+            node.rect = newBoundingBox;
+            node.left = left;
+            node.right = right;
+            return;
+        }
+        
         int perimeter = rectPerimeter(newBoundingBox);
-        CvRect ifLeftRect = rectUnion(left->rect, newRect);
-        int ifLeftDifference = rectPerimeter(ifLeftRect) - rectPerimeter(left->rect);
-        CvRect ifRightRect = rectUnion(right->rect, newRect);
-        int ifRightDifference = rectPerimeter(ifRightRect) - rectPerimeter(right->rect);
+        CvRect ifLeftRect = rectUnion(nodes[left].rect, newRect);
+        int ifLeftDifference = rectPerimeter(ifLeftRect) - rectPerimeter(nodes[left].rect);
+        CvRect ifRightRect = rectUnion(nodes[right].rect, newRect);
+        int ifRightDifference = rectPerimeter(ifRightRect) - rectPerimeter(nodes[right].rect);
         
-        rect = newBoundingBox;
+        nodes[index].rect = newBoundingBox;
         
         if (ifLeftDifference < ifRightDifference && ifLeftDifference < perimeter / 8) {
-            assert(left);       // silence spurious clang warning 1/8/2015
-            left->insert(newRect, skipContainedRects);
+            index = left;
         } else if (ifRightDifference < perimeter / 8) {
-            right->insert(newRect, skipContainedRects);
+            index = right;
         } else if (ifLeftDifference < ifRightDifference) {
-            BvhNode *temp = left;
-            left = new BvhNode(ifLeftRect);
-            left->left = temp;
-            left->right = new BvhNode(newRect);
+            uint32_t leaf = allocateNode(newRect, nullIndex, value);
+            uint32_t parent = allocateNode(ifLeftRect, left, leaf);
+            nodes[index].left = parent;
+            return;
         } else {
-            BvhNode *temp = right;
-            right = new BvhNode(ifRightRect);
-            right->left = temp;
-            right->right = new BvhNode(newRect);
+            uint32_t leaf = allocateNode(newRect, nullIndex, value);
+            uint32_t parent = allocateNode(ifRightRect, right, leaf);
+            nodes[index].right = parent;
+            return;
         }
     }
 }
 
-bool BvhNode::memberContains(int x, int y)
+// A rect being sorted into the subtrees of a bulk build, with the doubled coordinates of its center
+struct BvhBuildItem {
+    CvRect rect;
+    int centerX;
+    int centerY;
+    int index;                          // in the array the tree is built from
+};
+
+// A subtree of the top of a parallel build that is left to a task
+struct BvhBuildTask {
+    uint32_t index;
+    BvhBuildItem* items;
+    int count;
+};
+
+// The subtree of count items at node index fills the nodes [index, index + 2 * count - 1) in preorder, with its left
+// subtree of leftCount items at index + 1 and its right subtree at index + 2 * leftCount. Since the nodes of every subtree
+// are known once its items are, subtrees can be built concurrently without sharing an allocator.
+struct BvhBuilder {
+    enum {
+        binCount = 16,
+        parallelRectCount = 8192,       // smaller builds run on the calling thread
+        minimumTaskRectCount = 1024
+    };
+    
+    Bvh::Node* nodes;
+    std::vector<BvhBuildTask> tasks;
+    std::vector<uint32_t> topNodes;     // the internal nodes above the tasks, in postorder
+    
+    static int binOf(int center, int minimum, int extent) {
+        return (int)((int64)(center - minimum) * binCount / (extent + 1));
+    }
+    static int partition(BvhBuildItem* items, int count);
+    void buildSubtree(uint32_t index, BvhBuildItem* items, int count);
+    void splitTop(uint32_t index, BvhBuildItem* items, int count, int maximumTaskRectCount);
+    static void runTask(void* context, int task);
+    
+    static void initializeItems(const std::vector<CvRect>& rects, std::vector<BvhBuildItem>& items);
+    static uint32_t buildQuadNode(QuadBvh& bvh, BvhBuildItem* items, int count, uint32_t parent, int parentLane, int level);
+};
+
+// Whether an item's center falls in one of the bins up to and including bin
+struct BinIsAtMost {
+    BinIsAtMost(bool vertical, int minimum, int extent, int bin)
+        : vertical (vertical), minimum (minimum), extent (extent), bin (bin) { }
+    bool operator()(const BvhBuildItem& item) const {
+        int center = vertical ? item.centerY : item.centerX;
+        return BvhBuilder::binOf(center, minimum, extent) <= bin;
+    }
+    
+    bool vertical;
+    int minimum;
+    int extent;
+    int bin;
+};
+
+// Reorders the items into two nonempty groups where the perimeter of each group's bounding box weighted by its count is
+// least, among the binCount - 1 splits of the bins along the longer axis of the centers, and returns the size of the first
+int BvhBuilder::partition(BvhBuildItem* items, int count)
 {
-    if (!rectContainsPoint(rect, x, y)) {
+    if (count == 2) {
+        return 1;
+    }
+    
+    int minX = INT_MAX, minY = INT_MAX, maxX = INT_MIN, maxY = INT_MIN;
+    for (int i = 0; i < count; i++) {
+        minX = MIN(minX, items[i].centerX);
+        maxX = MAX(maxX, items[i].centerX);
+        minY = MIN(minY, items[i].centerY);
+        maxY = MAX(maxY, items[i].centerY);
+    }
+    bool vertical = maxY - minY > maxX - minX;
+    int minimum = vertical ? minY : minX;
+    int extent = vertical ? maxY - minY : maxX - minX;
+    if (extent == 0) {
+        // Every center coincides, so any split is as good as another
+        return count / 2;
+    }
+    
+    CvRect bounds[binCount];
+    int counts[binCount] = { 0 };
+    for (int i = 0; i < count; i++) {
+        int center = vertical ? items[i].centerY : items[i].centerX;
+        int bin = BvhBuilder::binOf(center, minimum, extent);
+        bounds[bin] = counts[bin] ? rectUnion(bounds[bin], items[i].rect) : items[i].rect;
+        counts[bin]++;
+    }
+    
+    // Sweep from the right to find the cost of each right group, then from the left to find the cheapest split
+    int64 rightCosts[binCount];
+    CvRect rightBounds = cvRect(0, 0, 0, 0);
+    int rightCount = 0;
+    for (int bin = binCount - 1; bin > 0; bin--) {
+        if (counts[bin]) {
+            rightBounds = rightCount ? rectUnion(rightBounds, bounds[bin]) : bounds[bin];
+            rightCount += counts[bin];
+        }
+        rightCosts[bin] = rightCount ? (int64)rectPerimeter(rightBounds) * rightCount : -1;
+    }
+    
+    int64 bestCost = -1;
+    int bestBin = 0;
+    CvRect leftBounds = cvRect(0, 0, 0, 0);
+    int leftCount = 0;
+    for (int bin = 0; bin < binCount - 1; bin++) {
+        if (counts[bin]) {
+            leftBounds = leftCount ? rectUnion(leftBounds, bounds[bin]) : bounds[bin];
+            leftCount += counts[bin];
+        }
+        if (leftCount && rightCosts[bin + 1] >= 0) {
+            int64 cost = (int64)rectPerimeter(leftBounds) * leftCount + rightCosts[bin + 1];
+            if (bestCost < 0 || cost < bestCost) {
+                bestCost = cost;
+                bestBin = bin;
+            }
+        }
+    }
+    
+    // The smallest and largest centers fall in the first and last bins, so there is always a split with both groups nonempty
+    BvhBuildItem* middle = std::partition(items, items + count, BinIsAtMost(vertical, minimum, extent, bestBin));
+    return (int)(middle - items);
+}
+
+void BvhBuilder::buildSubtree(uint32_t index, BvhBuildItem* items, int count)
+{
+    Bvh::Node& node = nodes[index];
+    if (count == 1) {
+        node.rect = items->rect;
+        node.left = Bvh::nullIndex;
+        node.right = items->index;
+        return;
+    }
+    int leftCount = partition(items, count);
+    node.left = index + 1;
+    node.right = index + 2 * leftCount;
+    buildSubtree(node.left, items, leftCount);
+    buildSubtree(node.right, items + leftCount, count - leftCount);
+    node.rect = rectUnion(nodes[node.left].rect, nodes[node.right].rect);
+}
+
+void BvhBuilder::splitTop(uint32_t index, BvhBuildItem* items, int count, int maximumTaskRectCount)
+{
+    if (count <= maximumTaskRectCount) {
+        BvhBuildTask task = { index, items, count };
+        tasks.push_back(task);
+        return;
+    }
+    Bvh::Node& node = nodes[index];
+    int leftCount = partition(items, count);
+    node.left = index + 1;
+    node.right = index + 2 * leftCount;
+    splitTop(node.left, items, leftCount, maximumTaskRectCount);
+    splitTop(node.right, items + leftCount, count - leftCount, maximumTaskRectCount);
+    topNodes.push_back(index);
+}
+
+void BvhBuilder::runTask(void* context, int task)
+{
+    BvhBuilder* builder = (BvhBuilder*)context;
+    const BvhBuildTask& buildTask = builder->tasks[task];
+    builder->buildSubtree(buildTask.index, buildTask.items, buildTask.count);
+}
+
+void BvhBuilder::initializeItems(const std::vector<CvRect>& rects, std::vector<BvhBuildItem>& items)
+{
+    items.resize(rects.size());
+    for (size_t i = 0; i < rects.size(); i++) {
+        items[i].rect = rects[i];
+        items[i].centerX = rects[i].x * 2 + rects[i].width;
+        items[i].centerY = rects[i].y * 2 + rects[i].height;
+        items[i].index = (int)i;
+    }
+}
+
+void Bvh::build(const std::vector<CvRect>& rects, int threadCount)
+{
+    clear();
+    if (rects.empty()) {
+        return;
+    }
+    
+    int count = (int)rects.size();
+    std::vector<BvhBuildItem> items;
+    BvhBuilder::initializeItems(rects, items);
+    nodes.resize(2 * count - 1);
+    root = 0;
+    
+    BvhBuilder builder;
+    builder.nodes = &nodes[0];
+    if (threadCount != 1 && count >= BvhBuilder::parallelRectCount) {
+        // Split the top of the tree on this thread into a few subtrees per thread, build those concurrently, and then
+        // bound the nodes above them from the bottom up
+        WorkerPool pool(threadCount);
+        int maximumTaskRectCount = MAX(count / (pool.threadCount() * 4), (int)BvhBuilder::minimumTaskRectCount);
+        builder.splitTop(root, &items[0], count, maximumTaskRectCount);
+        pool.run((int)builder.tasks.size(), BvhBuilder::runTask, &builder);
+        for (size_t i = 0; i < builder.topNodes.size(); i++) {
+            Node& node = nodes[builder.topNodes[i]];
+            node.rect = rectUnion(nodes[node.left].rect, nodes[node.right].rect);
+        }
+    } else {
+        builder.buildSubtree(root, &items[0], count);
+    }
+}
+
+bool Bvh::memberContains(uint32_t index, int x, int y) const
+{
+    const Node& node = nodes[index];
+    if (!rectContainsPoint(node.rect, x, y)) {
         return false;
     }
-    return !left || left->memberContains(x, y) || right->memberContains(x, y);
+    return node.left == nullIndex || memberContains(node.left, x, y) || memberContains(node.right, x, y);
 }
 
-bool BvhNode::allMembersContaining(int x, int y, std::vector<CvRect>& members, bool remove)
+bool Bvh::allMembersContaining(uint32_t index, int x, int y, std::vector<CvRect>* members,
+                               std::vector<uint32_t>* values, bool remove)
 {
-    if (!rectContainsPoint(rect, x, y)) {
+    // Removal only frees nodes, so the array is not reallocated during the traversal
+    const Node& node = nodes[index];
+    if (!rectContainsPoint(node.rect, x, y)) {
         return false;
     }
-    if (!left) {
-        members.push_back(rect);
+    if (node.left == nullIndex) {
+        members->push_back(node.rect);
+        if (values) {
+            values->push_back(node.right);
+        }
         return remove;
     }
-    bool removeLeft = left->allMembersContaining(x, y, members, remove);
-    bool removeRight = right->allMembersContaining(x, y, members, remove);
+    uint32_t left = node.left;
+    uint32_t right = node.right;
+    bool removeLeft = allMembersContaining(left, x, y, members, values, remove);
+    bool removeRight = allMembersContaining(right, x, y, members, values, remove);
     if (removeLeft && removeRight) {
+        // Every rect below this node is removed, so free its children and leave the node itself to the parent
+        freeNode(left);
+        freeNode(right);
         return true;
     } else if (removeLeft) {
-        removeChild(left);
+        removeChild(index, left);
     } else if (removeRight) {
-        removeChild(right);
+        removeChild(index, right);
     }
     return false;
 }
 
-bool BvhNode::allMembersIntersecting(const CvRect& aRect, std::vector<CvRect>& members, bool remove)
+bool Bvh::allMembersIntersecting(uint32_t index, const CvRect& aRect, std::vector<CvRect>* members,
+                                 std::vector<uint32_t>* values, bool remove)
 {
-    if (!rectIntersectsRect(rect, aRect)) {
+    const Node& node = nodes[index];
+    if (!rectIntersectsRect(node.rect, aRect)) {
         return false;
     }
-    if (!left) {
-        members.push_back(rect);
+    if (node.left == nullIndex) {
+        members->push_back(node.rect);
+        if (values) {
+            values->push_back(node.right);
+        }
         return remove;
     }
-    bool removeLeft = left->allMembersIntersecting(aRect, members, remove);
-    bool removeRight = right->allMembersIntersecting(aRect, members, remove);
+    uint32_t left = node.left;
+    uint32_t right = node.right;
+    bool removeLeft = allMembersIntersecting(left, aRect, members, values, remove);
+    bool removeRight = allMembersIntersecting(right, aRect, members, values, remove);
     if (removeLeft && removeRight) {
+        // Every rect below this node is removed, so free its children and leave the node itself to the parent
+        freeNode(left);
+        freeNode(right);
         return true;
     } else if (removeLeft) {
-        removeChild(left);
+        removeChild(index, left);
     } else if (removeRight) {
-        removeChild(right);
+        removeChild(index, right);
     }
     return false;
 }
 
-bool BvhNode::getAnyRect(CvRect& rect, bool remove)
+void Bvh::appendIntersectingValues(uint32_t index, const CvRect& rect, std::vector<uint32_t>& values) const
+{
+    const Node& node = nodes[index];
+    if (!rectIntersectsRect(node.rect, rect)) {
+        return;
+    }
+    if (node.left == nullIndex) {
+        values.push_back(node.right);
+        return;
+    }
+    appendIntersectingValues(node.left, rect, values);
+    appendIntersectingValues(node.right, rect, values);
+}
+
+CvRect Bvh::getAnyRect(bool remove, uint32_t* value)
+{
+    if (root == nullIndex) {
+        throw std::exception();
+    }
+    
+    uint32_t index = root;
+    uint32_t prev = nullIndex;
+    while (nodes[index].left != nullIndex) {
+        prev = index;
+        index = nodes[index].left;
+    }
+    CvRect rect = nodes[index].rect;
+    if (value) {
+        *value = nodes[index].right;
+    }
+    
+    if (remove) {
+        if (prev != nullIndex) {
+            removeChild(prev, index);
+        } else {
+            clear();
+        }
+    }
+    return rect;
+}
+
+void Bvh::removeChild(uint32_t index, uint32_t child)
+{
+    // Replace the node with its remaining child, whose children are adopted
+    Node& node = nodes[index];
+    assert(child == node.left || child == node.right);
+    uint32_t remaining = (child == node.left) ? node.right : node.left;
+    node = nodes[remaining];
+    
+    freeNode(child);
+    freeNode(remaining);
+}
+
+void QuadBvh::clear()
+{
+    nodes.clear();
+    rects.clear();
+    rectLanes.clear();
+    removed.clear();
+    root = nullIndex;
+    liveCount = 0;
+    nextRect = 0;
+    depth = 0;
+}
+
+// Splits the items in two, and each half in two again, into up to four children, and returns the index of the node
+uint32_t BvhBuilder::buildQuadNode(QuadBvh& bvh, BvhBuildItem* items, int count, uint32_t parent, int parentLane, int level)
+{
+    BvhBuildItem* groups[4];
+    int groupCounts[4];
+    int groupCount = 0;
+    int halfCounts[2];
+    halfCounts[0] = (count > 1) ? partition(items, count) : count;
+    halfCounts[1] = count - halfCounts[0];
+    BvhBuildItem* half = items;
+    for (int i = 0; i < 2; i++) {
+        if (halfCounts[i] > 1) {
+            int quarterCount = partition(half, halfCounts[i]);
+            groups[groupCount] = half;
+            groupCounts[groupCount++] = quarterCount;
+            groups[groupCount] = half + quarterCount;
+            groupCounts[groupCount++] = halfCounts[i] - quarterCount;
+        } else if (halfCounts[i] == 1) {
+            groups[groupCount] = half;
+            groupCounts[groupCount++] = 1;
+        }
+        half += halfCounts[i];
+    }
+    
+    uint32_t index = (uint32_t)bvh.nodes.size();
+    QuadBvh::Node newNode;
+    for (int lane = 0; lane < 4; lane++) {
+        newNode.minX[lane] = INT_MAX;
+        newNode.minY[lane] = INT_MAX;
+        newNode.maxX[lane] = INT_MIN;
+        newNode.maxY[lane] = INT_MIN;
+        newNode.children[lane] = QuadBvh::nullIndex;
+    }
+    newNode.parent = parent;
+    newNode.parentLane = parentLane;
+    newNode.liveLanes = groupCount;
+    bvh.nodes.push_back(newNode);
+    bvh.depth = MAX(bvh.depth, level);
+    
+    for (int lane = 0; lane < groupCount; lane++) {
+        CvRect bounds;
+        uint32_t child;
+        if (groupCounts[lane] == 1) {
+            bounds = groups[lane]->rect;
+            child = groups[lane]->index | QuadBvh::leafFlag;
+            bvh.rectLanes[groups[lane]->index] = index * 4 + lane;
+        } else {
+            child = buildQuadNode(bvh, groups[lane], groupCounts[lane], index, lane, level + 1);
+            const QuadBvh::Node& childNode = bvh.nodes[child];
+            bounds = cvRect(childNode.minX[0], childNode.minY[0],
+                            childNode.maxX[0] - childNode.minX[0], childNode.maxY[0] - childNode.minY[0]);
+            for (int childLane = 1; childLane < childNode.liveLanes; childLane++) {
+                bounds = rectUnion(bounds, cvRect(childNode.minX[childLane], childNode.minY[childLane],
+                                                  childNode.maxX[childLane] - childNode.minX[childLane],
+                                                  childNode.maxY[childLane] - childNode.minY[childLane]));
+            }
+        }
+        
+        // The recursion may have reallocated the nodes
+        QuadBvh::Node& node = bvh.nodes[index];
+        node.minX[lane] = bounds.x;
+        node.minY[lane] = bounds.y;
+        node.maxX[lane] = bounds.x + bounds.width;
+        node.maxY[lane] = bounds.y + bounds.height;
+        node.children[lane] = child;
+    }
+    return index;
+}
+
+void QuadBvh::build(const std::vector<CvRect>& newRects)
 {
-    BvhNode *node = this;
-    BvhNode *prev = NULL;
-    while (node->left) {
-        prev = node;
-        node = node->left;
+    clear();
+    if (newRects.empty()) {
+        return;
     }
-    rect = node->rect;
     
-    if (remove && prev) {
-        prev->removeChild(node);
+    std::vector<BvhBuildItem> items;
+    BvhBuilder::initializeItems(newRects, items);
+    rects = newRects;
+    rectLanes.resize(rects.size());
+    removed.assign(rects.size(), false);
+    liveCount = (int)rects.size();
+    nodes.reserve(rects.size() / 2 + 1);
+    root = BvhBuilder::buildQuadNode(*this, &items[0], (int)items.size(), nullIndex, 0, 1);
+}
+
+int QuadBvh::matchingLanes(const Node& node, int minX, int minY, int maxX, int maxY)
+{
+#if defined(__SSE2__)
+    __m128i outside = _mm_or_si128(_mm_cmpgt_epi32(_mm_loadu_si128((const __m128i*)node.minX), _mm_set1_epi32(maxX)),
+                                   _mm_cmpgt_epi32(_mm_set1_epi32(minX), _mm_loadu_si128((const __m128i*)node.maxX)));
+    outside = _mm_or_si128(outside, _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i*)node.minY), _mm_set1_epi32(maxY)));
+    outside = _mm_or_si128(outside, _mm_cmpgt_epi32(_mm_set1_epi32(minY), _mm_loadu_si128((const __m128i*)node.maxY)));
+    return ~_mm_movemask_ps(_mm_castsi128_ps(outside)) & 0xF;
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+    static const uint32_t laneBits[4] = { 1, 2, 4, 8 };
+    uint32x4_t inside = vandq_u32(vcleq_s32(vld1q_s32(node.minX), vdupq_n_s32(maxX)),
+                                  vcgeq_s32(vld1q_s32(node.maxX), vdupq_n_s32(minX)));
+    inside = vandq_u32(inside, vcleq_s32(vld1q_s32(node.minY), vdupq_n_s32(maxY)));
+    inside = vandq_u32(inside, vcgeq_s32(vld1q_s32(node.maxY), vdupq_n_s32(minY)));
+    uint32x4_t bits = vandq_u32(inside, vld1q_u32(laneBits));
+    uint32x2_t sums = vpadd_u32(vget_low_u32(bits), vget_high_u32(bits));
+    return (int)vget_lane_u32(vpadd_u32(sums, sums), 0);
+#else
+    int lanes = 0;
+    for (int lane = 0; lane < 4; lane++) {
+        if (node.minX[lane] <= maxX && node.maxX[lane] >= minX && node.minY[lane] <= maxY && node.maxY[lane] >= minY) {
+            lanes |= 1 << lane;
+        }
+    }
+    return lanes;
+#endif
+}
+
+bool QuadBvh::memberContains(int x, int y) const
+{
+    // Without members or removal the traversal does not modify the tree
+    return const_cast<QuadBvh*>(this)->collectMembers(x + 1, y + 1, x, y, NULL, NULL, false);
+}
+
+bool QuadBvh::collectMembers(int minX, int minY, int maxX, int maxY, std::vector<CvRect>* members,
+                             std::vector<uint32_t>* values, bool remove)
+{
+    if (liveCount == 0) {
         return false;
     }
-    return remove;
+    
+    // Each level pops one node and pushes at most four
+    uint32_t stackBuffer[stackCapacity];
+    std::vector<uint32_t> stackVector;
+    uint32_t* stack = stackBuffer;
+    if (depth * 3 + 1 > (int)stackCapacity) {
+        stackVector.resize(depth * 3 + 1);
+        stack = &stackVector[0];
+    }
+    
+    bool found = false;
+    int size = 0;
+    stack[size++] = root;
+    while (size > 0) {
+        uint32_t index = stack[--size];
+        int lanes = matchingLanes(nodes[index], minX, minY, maxX, maxY);
+        
+        // Push the child nodes in reverse so that they are visited in order, as Bvh visits them
+        for (int lane = 3; lane >= 0; lane--) {
+            if (!(lanes & (1 << lane))) {
+                continue;
+            }
+            uint32_t child = nodes[index].children[lane];
+            if (!(child & leafFlag)) {
+                stack[size++] = child;
+                continue;
+            }
+            if (!members) {
+                return true;
+            }
+            found = true;
+            members->push_back(rects[child & ~leafFlag]);
+            if (values) {
+                values->push_back(child & ~leafFlag);
+            }
+            if (remove) {
+                removed[child & ~leafFlag] = true;
+                liveCount--;
+                removeLane(index, lane);
+            }
+        }
+    }
+    return found;
 }
 
-void BvhNode::removeChild(BvhNode *leaf)
+void QuadBvh::appendIntersectingValues(const CvRect& rect, std::vector<uint32_t>& values) const
 {
-    assert(leaf == this->left || leaf == this->right);
-    BvhNode *remaining = (leaf == this->left) ? right : left;
-    rect = remaining->rect;
+    if (liveCount == 0) {
+        return;
+    }
     
-    BvhNode* l = remaining->left;
-    BvhNode* r = remaining->right;
-    remaining->left = NULL;     // avoid double deallocation
-    remaining->right = NULL;
+    uint32_t stackBuffer[stackCapacity];
+    std::vector<uint32_t> stackVector;
+    uint32_t* stack = stackBuffer;
+    if (depth * 3 + 1 > (int)stackCapacity) {
+        stackVector.resize(depth * 3 + 1);
+        stack = &stackVector[0];
+    }
     
-    delete left;
-    delete right;
-    left = l;
-    right = r;
+    int size = 0;
+    stack[size++] = root;
+    while (size > 0) {
+        const Node& node = nodes[stack[--size]];
+        int lanes = matchingLanes(node, rect.x, rect.y, rect.x + rect.width, rect.y + rect.height);
+        for (int lane = 3; lane >= 0; lane--) {
+            if (lanes & (1 << lane)) {
+                uint32_t child = node.children[lane];
+                if (child & leafFlag) {
+                    values.push_back(child & ~leafFlag);
+                } else {
+                    stack[size++] = child;
+                }
+            }
+        }
+    }
+}
+
+void QuadBvh::removeLane(uint32_t index, int lane)
+{
+    // Empty the lane, and the lanes of any ancestors that are left without children. Refitting the remaining lanes of the
+    // ancestors was measured to cost more than it saved when draining the tree.
+    for (;;) {
+        Node& node = nodes[index];
+        node.minX[lane] = INT_MAX;
+        node.minY[lane] = INT_MAX;
+        node.maxX[lane] = INT_MIN;
+        node.maxY[lane] = INT_MIN;
+        if (--node.liveLanes > 0 || node.parent == nullIndex) {
+            return;
+        }
+        lane = node.parentLane;
+        index = node.parent;
+    }
+}
+
+CvRect QuadBvh::getAnyRect(bool remove, uint32_t* value)
+{
+    if (liveCount == 0) {
+        throw std::exception();
+    }
+    
+    while (removed[nextRect]) {
+        nextRect++;
+    }
+    if (value) {
+        *value = (uint32_t)nextRect;
+    }
+    if (remove) {
+        removed[nextRect] = true;
+        liveCount--;
+        removeLane(rectLanes[nextRect] / 4, rectLanes[nextRect] % 4);
+    }
+    return rects[nextRect];
+}
+
+// Spreads the low 16 bits of value to the even bits of the result
+static inline uint32_t spreadBits(uint32_t value)
+{
+    value &= 0xFFFF;
+    value = (value | (value << 8)) & 0x00FF00FF;
+    value = (value | (value << 4)) & 0x0F0F0F0F;
+    value = (value | (value << 2)) & 0x33333333;
+    value = (value | (value << 1)) & 0x55555555;
+    return value;
+}
+
+// The state shared by the tasks of a batch query. Each task queries a chunk of consecutive queries in Morton order into
+// its own values, and once every task has counted its hits, copies its values to their place in the results.
+template <typename Tree>
+struct BvhBatchQuery {
+    enum {
+        chunkSize = 1024                // queries per task
+    };
+    
+    const Tree* tree;
+    const std::vector<CvRect>* rects;
+    std::vector<uint32_t> order;        // of the queries
+    std::vector<std::vector<uint32_t> > chunkValues;
+    BvhBatchResults* results;
+    
+    static void queryChunk(void* context, int chunk);
+    static void copyChunk(void* context, int chunk);
+    static void run(const Tree& tree, const std::vector<CvRect>& rects, BvhBatchResults& results, int threadCount);
+};
+
+template <typename Tree>
+void BvhBatchQuery<Tree>::queryChunk(void* context, int chunk)
+{
+    BvhBatchQuery* query = (BvhBatchQuery*)context;
+    std::vector<uint32_t>& values = query->chunkValues[chunk];
+    int* counts = &query->results->offsets[1];
+    size_t end = MIN((size_t)(chunk + 1) * chunkSize, query->order.size());
+    for (size_t i = (size_t)chunk * chunkSize; i < end; i++) {
+        uint32_t rect = query->order[i];
+        size_t start = values.size();
+        query->tree->appendIntersectingValues((*query->rects)[rect], values);
+        counts[rect] = (int)(values.size() - start);
+    }
+}
+
+template <typename Tree>
+void BvhBatchQuery<Tree>::copyChunk(void* context, int chunk)
+{
+    BvhBatchQuery* query = (BvhBatchQuery*)context;
+    const std::vector<uint32_t>& values = query->chunkValues[chunk];
+    const std::vector<int>& offsets = query->results->offsets;
+    uint32_t* destination = query->results->values.empty() ? NULL : &query->results->values[0];
+    size_t end = MIN((size_t)(chunk + 1) * chunkSize, query->order.size());
+    size_t source = 0;
+    for (size_t i = (size_t)chunk * chunkSize; i < end; i++) {
+        uint32_t rect = query->order[i];
+        int count = offsets[rect + 1] - offsets[rect];
+        if (count) {
+            memcpy(destination + offsets[rect], &values[source], count * sizeof(uint32_t));
+        }
+        source += count;
+    }
+}
+
+template <typename Tree>
+void BvhBatchQuery<Tree>::run(const Tree& tree, const std::vector<CvRect>& rects, BvhBatchResults& results, int threadCount)
+{
+    int count = (int)rects.size();
+    results.offsets.assign(count + 1, 0);
+    results.values.clear();
+    if (count == 0) {
+        return;
+    }
+    
+    // Sort the queries by the Morton codes of their centers, quantized to 16 bits in each axis
+    int minX = INT_MAX, minY = INT_MAX, maxX = INT_MIN, maxY = INT_MIN;
+    for (int i = 0; i < count; i++) {
+        minX = MIN(minX, rects[i].x * 2 + rects[i].width);
+        maxX = MAX(maxX, rects[i].x * 2 + rects[i].width);
+        minY = MIN(minY, rects[i].y * 2 + rects[i].height);
+        maxY = MAX(maxY, rects[i].y * 2 + rects[i].height);
+    }
+    int64 extentX = MAX(maxX - minX, 1);
+    int64 extentY = MAX(maxY - minY, 1);
+    std::vector<std::pair<uint32_t, uint32_t> > codes(count);
+    for (int i = 0; i < count; i++) {
+        uint32_t x = (uint32_t)((rects[i].x * 2 + rects[i].width - minX) * (int64)0xFFFF / extentX);
+        uint32_t y = (uint32_t)((rects[i].y * 2 + rects[i].height - minY) * (int64)0xFFFF / extentY);
+        codes[i] = std::make_pair(spreadBits(x) | (spreadBits(y) << 1), (uint32_t)i);
+    }
+    std::sort(codes.begin(), codes.end());
+    
+    BvhBatchQuery query;
+    query.tree = &tree;
+    query.rects = &rects;
+    query.order.resize(count);
+    for (int i = 0; i < count; i++) {
+        query.order[i] = codes[i].second;
+    }
+    int chunkCount = (count + chunkSize - 1) / chunkSize;
+    query.chunkValues.resize(chunkCount);
+    query.results = &results;
+    
+    // Count each query's hits into offsets[query + 1], then sum them into the offsets and copy the values into place
+    WorkerPool pool((chunkCount > 1) ? threadCount : 1);
+    pool.run(chunkCount, queryChunk, &query);
+    for (int i = 0; i < count; i++) {
+        results.offsets[i + 1] += results.offsets[i];
+    }
+    results.values.resize(results.offsets[count]);
+    pool.run(chunkCount, copyChunk, &query);
+}
+
+void Bvh::allMembersIntersecting(const std::vector<CvRect>& rects, BvhBatchResults& results, int threadCount) const
+{
+    BvhBatchQuery<Bvh>::run(*this, rects, results, threadCount);
+}
+
+void QuadBvh::allMembersIntersecting(const std::vector<CvRect>& rects, BvhBatchResults& results, int threadCount) const
+{
+    BvhBatchQuery<QuadBvh>::run(*this, rects, results, threadCount);
 }
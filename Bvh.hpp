@@ -8,70 +8,236 @@
 
 #import "opencv2/opencv.hpp"
 #import "CvRectUtilities.hpp"
+#import <stdint.h>
+#import <vector>
 
-class BvhNode {
-    friend class Bvh;
-private:
-    BvhNode(const CvRect& rect) : rect (rect), left (NULL), right (NULL) { }
-    ~BvhNode() { delete left; delete right; }
-    
-    BvhNode(const BvhNode& node) { *this = node; }
-    BvhNode& operator=(const BvhNode& node);
-    
-    void insert(const CvRect& newRect, bool skipContainedRects);
-    bool memberContains(int x, int y);
-    
-    // return value of true indicates that the node should be deleted by parent to achieve removal
-    bool allMembersContaining(int x, int y, std::vector<CvRect>& members, bool remove);
-    bool allMembersIntersecting(const CvRect& aRect, std::vector<CvRect>& members, bool remove);
-    bool getAnyRect(CvRect& rect, bool remove);
+// The results of a batch of queries in compressed sparse row form, where the values of the rects matching query i are
+// values[offsets[i]] up to values[offsets[i + 1]]
+struct BvhBatchResults {
+    std::vector<int> offsets;           // one more than the number of queries
+    std::vector<uint32_t> values;
     
-    void removeChild(BvhNode *leaf);
-    
-    CvRect rect;        // bounding box if children, value if leaf
-    BvhNode *left;      // left is non-NULL iff right is non-NULL
-    BvhNode *right;
+    int count(int query) const { return offsets[query + 1] - offsets[query]; }
 };
 
-// Stores hierarchies of axis-aligned rects for fast intersection and containment testing
+// Stores hierarchies of axis-aligned rects for fast intersection and containment testing. The nodes live in one contiguous
+// array and refer to their children by 32-bit index, and removed nodes are recycled through a free list, so the tree
+// costs no allocations once the array has grown. Copies are deep. Each rect carries a 32-bit value, which the queries can
+// return along with it, so that callers can map hits back to their own objects, as PayloadBvh does.
 class Bvh {
 public:
-    Bvh() : node (NULL) {};
-    ~Bvh() { delete node; }
-    Bvh(const Bvh& bvh) { *this = bvh; }
-    Bvh& operator=(const Bvh& bvh) { delete node; node = bvh.node; return *this; };
-    
-    bool empty() { return node == NULL; }
-    void clear() { delete node; node = NULL; }
-    void insert(const CvRect& rect, bool skipContainedRects = false) {
-        if (node) {
-            node->insert(rect, skipContainedRects);
-        } else {
-            node = new BvhNode(rect);
-        }
-    }
-    bool memberContains(int x, int y) { return node ? node->memberContains(x, y) : false; }
+    Bvh() : root (nullIndex), freeList (nullIndex) {};
+    
+    bool empty() const { return root == nullIndex; }
+    void clear() { nodes.clear(); root = nullIndex; freeList = nullIndex; }      // keeps the array's capacity
+    void reserve(size_t rectCount) { nodes.reserve(rectCount * 2); }
+    void swap(Bvh& bvh);                // exchanges the trees in constant time
+    size_t nodeCount() const { return nodes.size(); }       // including freed nodes, for verifying that they are reused
+    
+    void insert(const CvRect& rect, bool skipContainedRects = false, uint32_t value = 0);
+    
+    // Replaces the tree with one built top down from rects, splitting each node where the binned surface area heuristic,
+    // with perimeters for surface areas, is lowest. This is much faster than inserting the rects one at a time and gives
+    // shallower trees that do not depend on the order of the rects. For large inputs the subtrees are built by threadCount
+    // threads (0 for one per processor). The value of each rect is its index in rects.
+    void build(const std::vector<CvRect>& rects, int threadCount = 1);
+    bool memberContains(int x, int y) const { return root != nullIndex && memberContains(root, x, y); }
     void allMembersContaining(int x, int y, std::vector<CvRect>& members, bool remove = false) {
-        if (node && node->allMembersContaining(x, y, members, remove)) {
+        if (root != nullIndex && allMembersContaining(root, x, y, &members, NULL, remove)) {
             clear();
         }
     }
     void allMembersIntersecting(const CvRect& rect, std::vector<CvRect>& members, bool remove = false) {
-        if (node && node->allMembersIntersecting(rect, members, remove)) {
+        if (root != nullIndex && allMembersIntersecting(root, rect, &members, NULL, remove)) {
             clear();
         }
     }
-    CvRect getAnyRect(bool remove = false) {
-        if (!node) {
-            throw std::exception();
+    CvRect getAnyRect(bool remove = false, uint32_t* value = NULL);
+    
+    // As above, also appending the value of each member to values
+    void allMembersContaining(int x, int y, std::vector<CvRect>& members, std::vector<uint32_t>& values, bool remove = false) {
+        if (root != nullIndex && allMembersContaining(root, x, y, &members, &values, remove)) {
+            clear();
         }
-        CvRect rect;
-        if (node->getAnyRect(rect, remove)) {
+    }
+    void allMembersIntersecting(const CvRect& rect, std::vector<CvRect>& members, std::vector<uint32_t>& values,
+                                bool remove = false) {
+        if (root != nullIndex && allMembersIntersecting(root, rect, &members, &values, remove)) {
             clear();
         }
-        return rect;
     }
     
+    // Finds the values of the members intersecting each of rects, without removing them. The queries are made in the
+    // Morton order of their centers, so that consecutive queries visit mostly the same nodes, by threadCount threads
+    // (0 for one per processor) for large batches.
+    void allMembersIntersecting(const std::vector<CvRect>& rects, BvhBatchResults& results, int threadCount = 1) const;
+
 private:
-    BvhNode *node;
+    friend struct BvhBuilder;
+    template <typename Tree> friend struct BvhBatchQuery;
+    
+    enum {
+        nullIndex = 0xFFFFFFFF
+    };
+    
+    struct Node {
+        CvRect rect;        // bounding box if children, value if leaf
+        uint32_t left;      // nullIndex if leaf, and links the free list once the node is freed
+        uint32_t right;     // value if leaf
+    };
+    
+    uint32_t allocateNode(const CvRect& rect, uint32_t left = nullIndex, uint32_t right = nullIndex);
+    void freeNode(uint32_t index);
+    
+    bool memberContains(uint32_t index, int x, int y) const;
+    
+    // return value of true indicates that the node should be removed by parent to achieve removal, in which case the
+    // nodes below it have already been freed
+    bool allMembersContaining(uint32_t index, int x, int y, std::vector<CvRect>* members, std::vector<uint32_t>* values,
+                              bool remove);
+    bool allMembersIntersecting(uint32_t index, const CvRect& aRect, std::vector<CvRect>* members,
+                                std::vector<uint32_t>* values, bool remove);
+    void appendIntersectingValues(const CvRect& rect, std::vector<uint32_t>& values) const {
+        if (root != nullIndex) {
+            appendIntersectingValues(root, rect, values);
+        }
+    }
+    void appendIntersectingValues(uint32_t index, const CvRect& rect, std::vector<uint32_t>& values) const;
+    
+    void removeChild(uint32_t index, uint32_t child);       // frees child, which has no children left
+    
+    std::vector<Node> nodes;
+    uint32_t root;
+    uint32_t freeList;
+};
+
+// A four way bounding volume hierarchy built at once from an array of rects, whose nodes keep the bounds of their four
+// children in separate arrays so that one SIMD comparison tests a query against all four. It is traversed with an explicit
+// stack rather than by recursion. Rects can be removed but not inserted, and removing rects does not shrink the bounds of
+// their ancestors, which suits draining the tree as findContigousIslands() does.
+class QuadBvh {
+public:
+    QuadBvh() : root (nullIndex), liveCount (0), nextRect (0), depth (0) {};
+    
+    bool empty() const { return liveCount == 0; }
+    void clear();
+    
+    // Replaces the tree with one whose nodes split their rects by the binned surface area heuristic as Bvh::build() does,
+    // and then split each half again
+    void build(const std::vector<CvRect>& rects);
+    
+    bool memberContains(int x, int y) const;
+    void allMembersContaining(int x, int y, std::vector<CvRect>& members, bool remove = false) {
+        collectMembers(x + 1, y + 1, x, y, &members, NULL, remove);
+    }
+    void allMembersIntersecting(const CvRect& rect, std::vector<CvRect>& members, bool remove = false) {
+        collectMembers(rect.x, rect.y, rect.x + rect.width, rect.y + rect.height, &members, NULL, remove);
+    }
+    CvRect getAnyRect(bool remove = false, uint32_t* value = NULL);      // the first remaining rect in build order
+    
+    // As above, also appending the value of each member, its index in the rects the tree was built from, to values
+    void allMembersContaining(int x, int y, std::vector<CvRect>& members, std::vector<uint32_t>& values, bool remove = false) {
+        collectMembers(x + 1, y + 1, x, y, &members, &values, remove);
+    }
+    void allMembersIntersecting(const CvRect& rect, std::vector<CvRect>& members, std::vector<uint32_t>& values,
+                                bool remove = false) {
+        collectMembers(rect.x, rect.y, rect.x + rect.width, rect.y + rect.height, &members, &values, remove);
+    }
+    
+    // As Bvh::allMembersIntersecting() for a batch of rects
+    void allMembersIntersecting(const std::vector<CvRect>& rects, BvhBatchResults& results, int threadCount = 1) const;
+
+private:
+    friend struct BvhBuilder;
+    template <typename Tree> friend struct BvhBatchQuery;
+    
+    enum {
+        nullIndex = 0xFFFFFFFF,
+        leafFlag = 0x80000000,          // marks children that are rect indices rather than node indices
+        stackCapacity = 256             // entries on the stack of a traversal before it uses the heap
+    };
+    
+    struct Node {
+        // The lanes of removed and missing children are empty, with minimums of INT_MAX and maximums of INT_MIN
+        int minX[4];
+        int minY[4];
+        int maxX[4];                    // x + width
+        int maxY[4];                    // y + height
+        uint32_t children[4];
+        uint32_t parent;
+        int parentLane;
+        int liveLanes;
+    };
+    
+    // Returns a bit for each lane of the node that satisfies minX <= query maxX, maxX >= query minX and likewise for y, so
+    // that a query rect matches the lanes that rectIntersectsRect() would, and the query rect (x + 1, y + 1, x, y) matches
+    // the lanes that contain the point (x, y)
+    static int matchingLanes(const Node& node, int minX, int minY, int maxX, int maxY);
+    
+    // Appends the matching rects to members and their values to values if it is not NULL, or if members is NULL, returns
+    // whether any rect matches
+    bool collectMembers(int minX, int minY, int maxX, int maxY, std::vector<CvRect>* members, std::vector<uint32_t>* values,
+                        bool remove);
+    void removeLane(uint32_t index, int lane);
+    void appendIntersectingValues(const CvRect& rect, std::vector<uint32_t>& values) const;
+    
+    std::vector<Node> nodes;
+    std::vector<CvRect> rects;
+    std::vector<uint32_t> rectLanes;    // node index * 4 + lane of each rect
+    std::vector<bool> removed;
+    uint32_t root;
+    int liveCount;
+    size_t nextRect;                    // no rect before it remains
+    int depth;                          // levels of nodes
+};
+
+// A Bvh whose rects each carry a payload, such as a contour index or pointer, which the queries return along with the
+// rects. The payloads are kept in an array indexed by the values of the Bvh.
+template <typename Payload>
+class PayloadBvh {
+public:
+    bool empty() const { return bvh.empty(); }
+    void clear() { bvh.clear(); payloads.clear(); }
+    
+    // The payloads of rects skipped because they are contained are kept but never returned
+    void insert(const CvRect& rect, const Payload& payload, bool skipContainedRects = false) {
+        bvh.insert(rect, skipContainedRects, (uint32_t)payloads.size());
+        payloads.push_back(payload);
+    }
+    void build(const std::vector<CvRect>& rects, const std::vector<Payload>& rectPayloads, int threadCount = 1) {
+        assert(rects.size() == rectPayloads.size());
+        bvh.build(rects, threadCount);
+        payloads = rectPayloads;
+    }
+    
+    bool memberContains(int x, int y) const { return bvh.memberContains(x, y); }
+    void allMembersContaining(int x, int y, std::vector<CvRect>& members, std::vector<Payload>& memberPayloads,
+                              bool remove = false) {
+        values.clear();
+        bvh.allMembersContaining(x, y, members, values, remove);
+        appendPayloads(memberPayloads);
+    }
+    void allMembersIntersecting(const CvRect& rect, std::vector<CvRect>& members, std::vector<Payload>& memberPayloads,
+                                bool remove = false) {
+        values.clear();
+        bvh.allMembersIntersecting(rect, members, values, remove);
+        appendPayloads(memberPayloads);
+    }
+    CvRect getAnyRect(Payload& payload, bool remove = false) {
+        uint32_t value;
+        CvRect rect = bvh.getAnyRect(remove, &value);
+        payload = payloads[value];
+        return rect;
+    }
+
+private:
+    void appendPayloads(std::vector<Payload>& memberPayloads) {
+        for (size_t i = 0; i < values.size(); i++) {
+            memberPayloads.push_back(payloads[values[i]]);
+        }
+    }
+    
+    Bvh bvh;
+    std::vector<Payload> payloads;
+    std::vector<uint32_t> values;       // reused by the queries
 };
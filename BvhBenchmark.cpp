@@ -0,0 +1,415 @@
+//
+//  BvhBenchmark.cpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "BvhBenchmark.hpp"
+#import "Binarization.hpp"
+#import "BinarizationRegressionSuite.hpp"
+#import "Bvh.hpp"
+#import "CannyEdgeDetector.hpp"
+#import "CvRectUtilities.hpp"
+#import "WorkerPool.hpp"
+#import <algorithm>
+
+static std::vector<CvRect> contourRects(CvContour* firstContour)
+{
+    std::vector<CvRect> rects;
+    CvTreeNodeIterator iterator;
+    cvInitTreeNodeIterator(&iterator, firstContour, INT_MAX);
+    CvContour* contour;
+    while ((contour = (CvContour*)cvNextTreeNode(&iterator)) != NULL) {
+        rects.push_back(cvBoundingRect(contour));
+    }
+    return rects;
+}
+
+// Drains the tree into the bounding boxes of transitively intersecting rects, as findContigousIslands() does
+template <typename Tree>
+static std::vector<CvRect> collectIslands(Tree& bvh, int borderPadding)
+{
+    std::vector<CvRect> islands;
+    std::vector<CvRect> intersecting;
+    while (!bvh.empty()) {
+        intersecting.clear();
+        intersecting.push_back(bvh.getAnyRect(true));
+        CvRect boundingBox = intersecting[0];
+        for (size_t i = 0; i < intersecting.size(); i++) {
+            bvh.allMembersIntersecting(outsetRect(intersecting[i], borderPadding, borderPadding), intersecting, true);
+            boundingBox = rectUnion(boundingBox, intersecting[i]);
+        }
+        islands.push_back(boundingBox);
+    }
+    return islands;
+}
+
+// Finds the rects intersecting each padded rect, and returns how many were found in all
+template <typename Tree>
+static int queryPaddedRects(Tree& bvh, const std::vector<CvRect>& rects, int borderPadding)
+{
+    int found = 0;
+    std::vector<CvRect> members;
+    for (size_t i = 0; i < rects.size(); i++) {
+        members.clear();
+        bvh.allMembersIntersecting(outsetRect(rects[i], borderPadding, borderPadding), members);
+        found += (int)members.size();
+    }
+    return found;
+}
+
+static bool rectIsLess(const CvRect& rect1, const CvRect& rect2)
+{
+    if (rect1.y != rect2.y) {
+        return rect1.y < rect2.y;
+    }
+    if (rect1.x != rect2.x) {
+        return rect1.x < rect2.x;
+    }
+    if (rect1.height != rect2.height) {
+        return rect1.height < rect2.height;
+    }
+    return rect1.width < rect2.width;
+}
+
+static bool rectsAreEqual(const CvRect& rect1, const CvRect& rect2)
+{
+    return rect1.x == rect2.x && rect1.y == rect2.y && rect1.width == rect2.width && rect1.height == rect2.height;
+}
+
+// Renders the small duplex page of the regression suite at A4 size, which has tens of thousands of glyph contours
+static IplImage* createDenseTextPage(int dpi)
+{
+    BinarizationRegressionSuite::PageSpec spec = BinarizationRegressionSuite::defaultPages()[1];
+    spec.width = dpi * 827 / 100;
+    spec.height = dpi * 1169 / 100;
+    return BinarizationRegressionSuite::renderPage(spec);
+}
+
+BvhBenchmark::BuildResult BvhBenchmark::runBuildComparison(int dpi, int threadCount, int iterations)
+{
+    // Enough rects for Bvh::build() to split the tree across threads
+    IplImage* page = createDenseTextPage(dpi);
+    IplImage* edges = cvCreateImage(cvGetSize(page), IPL_DEPTH_8U, 1);
+    CannyEdgeDetector detector;
+    detector.detectColorEdges(page, edges, 50.0, 100.0, CannyEdgeDetector::ChannelCombinationOr);
+    CvContour* firstContour = NULL;
+    CvMemStorage* storage = createStorageWithContours(edges, &firstContour);
+    std::vector<CvRect> rects = contourRects(firstContour);
+    
+    BuildResult result;
+    result.width = page->width;
+    result.height = page->height;
+    result.iterations = iterations;
+    result.rects = (int)rects.size();
+    result.threadCount = (threadCount > 0) ? threadCount : WorkerPool::processorCount();
+    result.identical = true;
+    
+    std::vector<double> samples[5];
+    for (int iteration = 0; iteration <= iterations; iteration++) {
+        int64 ticks[6];
+        Bvh inserted, built, parallelBuilt;
+        ticks[0] = cvGetTickCount();
+        for (size_t i = 0; i < rects.size(); i++) {
+            inserted.insert(rects[i], true);
+        }
+        ticks[1] = cvGetTickCount();
+        built.build(rects);
+        ticks[2] = cvGetTickCount();
+        parallelBuilt.build(rects, result.threadCount);
+        ticks[3] = cvGetTickCount();
+        std::vector<CvRect> insertedIslands = collectIslands(inserted, 4);
+        ticks[4] = cvGetTickCount();
+        std::vector<CvRect> builtIslands = collectIslands(built, 4);
+        ticks[5] = cvGetTickCount();
+        
+        // The first iteration warms up the allocator and caches
+        if (iteration > 0) {
+            for (int i = 0; i < 5; i++) {
+                samples[i].push_back(ticksToSeconds(ticks[i + 1] - ticks[i]));
+            }
+        }
+        
+        // The islands are drained in an order that depends on the tree, so compare them sorted. The parallel build's subtrees
+        // are built by different threads, so check its islands too, untimed.
+        std::vector<CvRect> parallelBuiltIslands = collectIslands(parallelBuilt, 4);
+        std::sort(insertedIslands.begin(), insertedIslands.end(), rectIsLess);
+        std::sort(builtIslands.begin(), builtIslands.end(), rectIsLess);
+        std::sort(parallelBuiltIslands.begin(), parallelBuiltIslands.end(), rectIsLess);
+        result.identical = result.identical && insertedIslands.size() == builtIslands.size() &&
+            std::equal(insertedIslands.begin(), insertedIslands.end(), builtIslands.begin(), rectsAreEqual) &&
+            parallelBuiltIslands.size() == builtIslands.size() &&
+            std::equal(parallelBuiltIslands.begin(), parallelBuiltIslands.end(), builtIslands.begin(), rectsAreEqual);
+    }
+    result.insertion = percentiles(samples[0]);
+    result.build = percentiles(samples[1]);
+    result.parallelBuild = percentiles(samples[2]);
+    result.insertedIslands = percentiles(samples[3]);
+    result.builtIslands = percentiles(samples[4]);
+    
+    cvReleaseMemStorage(&storage);
+    cvReleaseImage(&edges);
+    cvReleaseImage(&page);
+    return result;
+}
+
+BvhBenchmark::ChurnResult BvhBenchmark::runChurnCheck(int rounds, int rectsPerRound)
+{
+    ChurnResult result;
+    result.rounds = rounds;
+    result.rectsPerRound = rectsPerRound;
+    result.maximumRects = 0;
+    result.removedRects = 0;
+    result.passed = true;
+    
+    CvRNG rng = cvRNG(1);
+    Bvh bvh;
+    std::vector<CvRect> members;
+    int rects = 0;
+    for (int round = 0; round < rounds; round++) {
+        for (int i = 0; i < rectsPerRound; i++) {
+            bvh.insert(cvRect(cvRandInt(&rng) % 1000, cvRandInt(&rng) % 1000, 1 + cvRandInt(&rng) % 20, 1 + cvRandInt(&rng) % 20));
+        }
+        rects += rectsPerRound;
+        result.maximumRects = MAX(result.maximumRects, rects);
+        
+        members.clear();
+        if (round % 2 == 0) {
+            bvh.allMembersIntersecting(cvRect(cvRandInt(&rng) % 500, cvRandInt(&rng) % 500, 500, 500), members, true);
+        } else {
+            bvh.allMembersContaining(cvRandInt(&rng) % 1000, cvRandInt(&rng) % 1000, members, true);
+        }
+        rects -= (int)members.size();
+        result.removedRects += (int)members.size();
+        
+        // A tree of n rects has 2n - 1 nodes
+        result.passed = result.passed && bvh.nodeCount() <= (size_t)MAX(2 * result.maximumRects - 1, 0);
+    }
+    result.nodes = (int)bvh.nodeCount();
+    return result;
+}
+
+BvhBenchmark::IslandDetectionResult BvhBenchmark::runIslandDetectionComparison(int dpi, int iterations)
+{
+    IplImage* page = createDenseTextPage(dpi);
+    IplImage* edges = cvCreateImage(cvGetSize(page), IPL_DEPTH_8U, 1);
+    CannyEdgeDetector detector;
+    detector.detectColorEdges(page, edges, 50.0, 100.0, CannyEdgeDetector::ChannelCombinationOr);
+    CvContour* firstContour = NULL;
+    CvMemStorage* storage = createStorageWithContours(edges, &firstContour);
+    std::vector<CvRect> rects = contourRects(firstContour);
+    
+    IslandDetectionResult result;
+    result.width = page->width;
+    result.height = page->height;
+    result.iterations = iterations;
+    result.rects = (int)rects.size();
+    result.identical = true;
+    
+    std::vector<double> samples[6];
+    for (int iteration = 0; iteration <= iterations; iteration++) {
+        int64 ticks[7];
+        Bvh binary;
+        QuadBvh quad;
+        ticks[0] = cvGetTickCount();
+        binary.build(rects);
+        ticks[1] = cvGetTickCount();
+        quad.build(rects);
+        ticks[2] = cvGetTickCount();
+        int binaryFound = queryPaddedRects(binary, rects, 4);
+        ticks[3] = cvGetTickCount();
+        int quadFound = queryPaddedRects(quad, rects, 4);
+        ticks[4] = cvGetTickCount();
+        std::vector<CvRect> binaryIslands = collectIslands(binary, 4);
+        ticks[5] = cvGetTickCount();
+        std::vector<CvRect> quadIslands = collectIslands(quad, 4);
+        ticks[6] = cvGetTickCount();
+        
+        // The first iteration warms up the allocator and caches
+        if (iteration > 0) {
+            for (int i = 0; i < 6; i++) {
+                samples[i].push_back(ticksToSeconds(ticks[i + 1] - ticks[i]));
+            }
+        }
+        
+        std::sort(binaryIslands.begin(), binaryIslands.end(), rectIsLess);
+        std::sort(quadIslands.begin(), quadIslands.end(), rectIsLess);
+        result.identical = result.identical && binaryFound == quadFound && binaryIslands.size() == quadIslands.size() &&
+            std::equal(binaryIslands.begin(), binaryIslands.end(), quadIslands.begin(), rectsAreEqual);
+        result.islands = (int)quadIslands.size();
+    }
+    result.binaryBuild = percentiles(samples[0]);
+    result.quadBuild = percentiles(samples[1]);
+    result.binaryQueries = percentiles(samples[2]);
+    result.quadQueries = percentiles(samples[3]);
+    result.binaryIslands = percentiles(samples[4]);
+    result.quadIslands = percentiles(samples[5]);
+    
+    cvReleaseMemStorage(&storage);
+    cvReleaseImage(&edges);
+    cvReleaseImage(&page);
+    return result;
+}
+
+BvhBenchmark::BatchQueryResult BvhBenchmark::runBatchQueryComparison(int dpi, int threadCount, int iterations)
+{
+    IplImage* page = createDenseTextPage(dpi);
+    IplImage* edges = cvCreateImage(cvGetSize(page), IPL_DEPTH_8U, 1);
+    CannyEdgeDetector detector;
+    detector.detectColorEdges(page, edges, 50.0, 100.0, CannyEdgeDetector::ChannelCombinationOr);
+    CvContour* firstContour = NULL;
+    CvMemStorage* storage = createStorageWithContours(edges, &firstContour);
+    std::vector<CvRect> rects = contourRects(firstContour);
+    std::vector<CvRect> queries(rects.size());
+    for (size_t i = 0; i < rects.size(); i++) {
+        queries[i] = outsetRect(rects[i], 4, 4);
+    }
+    std::vector<int> shuffled(queries.size());
+    CvRNG rng = cvRNG(1);
+    for (int i = 0; i < (int)shuffled.size(); i++) {
+        int j = cvRandInt(&rng) % (i + 1);
+        shuffled[i] = shuffled[j];
+        shuffled[j] = i;
+    }
+    
+    Bvh binary;
+    binary.build(rects);
+    QuadBvh quad;
+    quad.build(rects);
+    
+    BatchQueryResult result;
+    result.width = page->width;
+    result.height = page->height;
+    result.iterations = iterations;
+    result.queries = (int)queries.size();
+    result.threadCount = (threadCount > 0) ? threadCount : WorkerPool::processorCount();
+    result.identical = true;
+    
+    std::vector<double> samples[5];
+    std::vector<CvRect> members;
+    BvhBatchResults batchResults[3];
+    for (int iteration = 0; iteration <= iterations; iteration++) {
+        int64 ticks[6];
+        ticks[0] = cvGetTickCount();
+        for (size_t i = 0; i < queries.size(); i++) {
+            members.clear();
+            binary.allMembersIntersecting(queries[i], members);
+        }
+        ticks[1] = cvGetTickCount();
+        for (size_t i = 0; i < queries.size(); i++) {
+            members.clear();
+            binary.allMembersIntersecting(queries[shuffled[i]], members);
+        }
+        ticks[2] = cvGetTickCount();
+        binary.allMembersIntersecting(queries, batchResults[0]);
+        ticks[3] = cvGetTickCount();
+        quad.allMembersIntersecting(queries, batchResults[1]);
+        ticks[4] = cvGetTickCount();
+        quad.allMembersIntersecting(queries, batchResults[2], result.threadCount);
+        ticks[5] = cvGetTickCount();
+        
+        // The first iteration warms up the allocator and caches
+        if (iteration > 0) {
+            for (int i = 0; i < 5; i++) {
+                samples[i].push_back(ticksToSeconds(ticks[i + 1] - ticks[i]));
+            }
+        }
+    }
+    
+    // Each batch must find the values of the same rects as a single query, in any order
+    std::vector<uint32_t> values;
+    std::vector<uint32_t> batchValues;
+    for (size_t i = 0; i < queries.size() && result.identical; i++) {
+        members.clear();
+        values.clear();
+        binary.allMembersIntersecting(queries[i], members, values);
+        std::sort(values.begin(), values.end());
+        for (int batch = 0; batch < 3; batch++) {
+            const BvhBatchResults& results = batchResults[batch];
+            batchValues.assign(results.values.begin() + results.offsets[i], results.values.begin() + results.offsets[i + 1]);
+            std::sort(batchValues.begin(), batchValues.end());
+            result.identical = result.identical && batchValues == values;
+        }
+    }
+    result.hits = (int)batchResults[0].values.size();
+    result.singleQueries = percentiles(samples[0]);
+    result.shuffledSingleQueries = percentiles(samples[1]);
+    result.binaryBatch = percentiles(samples[2]);
+    result.quadBatch = percentiles(samples[3]);
+    result.parallelQuadBatch = percentiles(samples[4]);
+    
+    cvReleaseMemStorage(&storage);
+    cvReleaseImage(&edges);
+    cvReleaseImage(&page);
+    return result;
+}
+
+std::string BvhBenchmark::json(const BuildResult& result)
+{
+    std::string string;
+    appendFormat(string, "{\"width\": %d, \"height\": %d, \"iterations\": %d, \"rects\": %d, \"threads\": %d, "
+                 "\"identical\": %s,\n ", result.width, result.height, result.iterations, result.rects, result.threadCount,
+                 result.identical ? "true" : "false");
+    appendPercentiles(string, "insertion_ms", result.insertion);
+    string += ",\n ";
+    appendPercentiles(string, "build_ms", result.build);
+    string += ",\n ";
+    appendPercentiles(string, "parallel_build_ms", result.parallelBuild);
+    string += ",\n ";
+    appendPercentiles(string, "inserted_islands_ms", result.insertedIslands);
+    string += ",\n ";
+    appendPercentiles(string, "built_islands_ms", result.builtIslands);
+    string += "}\n";
+    return string;
+}
+
+std::string BvhBenchmark::json(const ChurnResult& result)
+{
+    std::string string;
+    appendFormat(string, "{\"rounds\": %d, \"rects_per_round\": %d, \"maximum_rects\": %d, \"removed_rects\": %d, "
+                 "\"nodes\": %d, \"passed\": %s}\n", result.rounds, result.rectsPerRound, result.maximumRects,
+                 result.removedRects, result.nodes, result.passed ? "true" : "false");
+    return string;
+}
+
+std::string BvhBenchmark::json(const IslandDetectionResult& result)
+{
+    std::string string;
+    appendFormat(string, "{\"width\": %d, \"height\": %d, \"iterations\": %d, \"rects\": %d, \"islands\": %d, "
+                 "\"identical\": %s,\n ", result.width, result.height, result.iterations, result.rects, result.islands,
+                 result.identical ? "true" : "false");
+    appendPercentiles(string, "binary_build_ms", result.binaryBuild);
+    string += ",\n ";
+    appendPercentiles(string, "quad_build_ms", result.quadBuild);
+    string += ",\n ";
+    appendPercentiles(string, "binary_queries_ms", result.binaryQueries);
+    string += ",\n ";
+    appendPercentiles(string, "quad_queries_ms", result.quadQueries);
+    string += ",\n ";
+    appendPercentiles(string, "binary_islands_ms", result.binaryIslands);
+    string += ",\n ";
+    appendPercentiles(string, "quad_islands_ms", result.quadIslands);
+    string += "}\n";
+    return string;
+}
+
+std::string BvhBenchmark::json(const BatchQueryResult& result)
+{
+    std::string string;
+    appendFormat(string, "{\"width\": %d, \"height\": %d, \"iterations\": %d, \"queries\": %d, \"hits\": %d, "
+                 "\"threads\": %d, \"identical\": %s,\n ", result.width, result.height, result.iterations, result.queries,
+                 result.hits, result.threadCount, result.identical ? "true" : "false");
+    appendPercentiles(string, "single_queries_ms", result.singleQueries);
+    string += ",\n ";
+    appendPercentiles(string, "shuffled_single_queries_ms", result.shuffledSingleQueries);
+    string += ",\n ";
+    appendPercentiles(string, "binary_batch_ms", result.binaryBatch);
+    string += ",\n ";
+    appendPercentiles(string, "quad_batch_ms", result.quadBatch);
+    string += ",\n ";
+    appendPercentiles(string, "parallel_quad_batch_ms", result.parallelQuadBatch);
+    string += "}\n";
+    return string;
+}
@@ -0,0 +1,99 @@
+//
+//  BvhBenchmark.hpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "opencv2/opencv.hpp"
+#import "BenchmarkUtilities.hpp"
+#import <string>
+#import <vector>
+
+// Times building and querying the Bvh and QuadBvh against the approaches they replaced, using the contour rects of dense
+// synthetic text pages, and checks that they find the same rects
+class BvhBenchmark {
+public:
+    typedef BenchmarkPercentiles Percentiles;
+    
+    // Times building the Bvh of the contour rects of a dense synthetic text page, A4 at dpi, by inserting the rects one at a
+    // time, as findContigousIslands() once did, against Bvh::build() on one thread and on threadCount threads (0 for one per
+    // processor), and times collecting the islands from the inserted and the built trees as findContigousIslands() does. The
+    // page has enough rects for the parallel build to split the tree across threads.
+    struct BuildResult {
+        int width;
+        int height;
+        int iterations;
+        int rects;
+        int threadCount;
+        Percentiles insertion;
+        Percentiles build;
+        Percentiles parallelBuild;
+        Percentiles insertedIslands;
+        Percentiles builtIslands;
+        bool identical;             // whether the inserted tree and both built trees produced the same islands
+    };
+    static BuildResult runBuildComparison(int dpi = 300, int threadCount = 0, int iterations = 5);
+    
+    // Repeatedly inserts random rects into a Bvh and removes those within a random region, alternating between removing by
+    // intersection and by containment, and checks that the node array never grows beyond the nodes needed for the most rects
+    // the tree has held at once, i.e. that the nodes of removed rects are reused
+    struct ChurnResult {
+        int rounds;
+        int rectsPerRound;
+        int maximumRects;           // held at once
+        int removedRects;
+        int nodes;                  // in the array at the end, including freed nodes
+        bool passed;
+    };
+    static ChurnResult runChurnCheck(int rounds = 20, int rectsPerRound = 1000);
+    
+    // Times building a Bvh and a QuadBvh from the contour rects of a dense synthetic text page, A4 at dpi, querying each
+    // tree for the rects intersecting every padded rect without removing them, and collecting the islands from each as
+    // findContigousIslands() does
+    struct IslandDetectionResult {
+        int width;
+        int height;
+        int iterations;
+        int rects;
+        int islands;
+        Percentiles binaryBuild;
+        Percentiles quadBuild;
+        Percentiles binaryQueries;
+        Percentiles quadQueries;
+        Percentiles binaryIslands;
+        Percentiles quadIslands;
+        bool identical;             // whether both trees found the same rects and islands
+    };
+    static IslandDetectionResult runIslandDetectionComparison(int dpi = 300, int iterations = 5);
+    
+    // Times finding the rects intersecting every padded contour rect of the same page as runIslandDetectionComparison(), one
+    // query at a time on a Bvh in contour order and in a shuffled order, against batch queries on a Bvh and a QuadBvh on one
+    // thread and on a QuadBvh on threadCount threads (0 for one per processor). Contour order is already mostly coherent,
+    // while the shuffled order shows what the batches' Morton ordering saves for queries that arrive in any order.
+    struct BatchQueryResult {
+        int width;
+        int height;
+        int iterations;
+        int queries;
+        int hits;
+        int threadCount;
+        Percentiles singleQueries;
+        Percentiles shuffledSingleQueries;
+        Percentiles binaryBatch;
+        Percentiles quadBatch;
+        Percentiles parallelQuadBatch;
+        bool identical;             // whether every batch found the same rects as single queries, for every query
+    };
+    static BatchQueryResult runBatchQueryComparison(int dpi = 300, int threadCount = 0, int iterations = 5);
+    
+    // Formats the results as JSON with times in milliseconds
+    static std::string json(const BuildResult& result);
+    static std::string json(const ChurnResult& result);
+    static std::string json(const IslandDetectionResult& result);
+    static std::string json(const BatchQueryResult& result);
+    
+private:
+    BvhBenchmark();
+};
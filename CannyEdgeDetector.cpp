@@ -0,0 +1,358 @@
+//
+//  CannyEdgeDetector.cpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "CannyEdgeDetector.hpp"
+
+// The non-maxima suppression and hysteresis below follow cvCanny() exactly so that the output is bit-identical
+
+#define CANNY_SHIFT 15
+#define TG22  (int)(0.4142135623730950488016887242097*(1<<CANNY_SHIFT) + 0.5)
+
+CannyEdgeDetector::CannyEdgeDetector() : size (cvSize(0, 0)), dx (NULL), dy (NULL), stackDepth (0), allocations (0)
+{
+}
+
+CannyEdgeDetector::~CannyEdgeDetector()
+{
+    cvReleaseMat(&dx);
+    cvReleaseMat(&dy);
+}
+
+void CannyEdgeDetector::prepare(CvSize newSize)
+{
+    // The buffers are only grown, so that regions of differing sizes can be processed without reallocating
+    size = newSize;
+    if (dx && size.width <= dx->cols && size.height <= dx->rows) {
+        return;
+    }
+    
+    CvSize capacity = cvSize(MAX(size.width, dx ? dx->cols : 0), MAX(size.height, dx ? dx->rows : 0));
+    cvReleaseMat(&dx);
+    cvReleaseMat(&dy);
+    dx = cvCreateMat(capacity.height, capacity.width, CV_16SC1);
+    dy = cvCreateMat(capacity.height, capacity.width, CV_16SC1);
+    
+    sobelRows.assign((capacity.width + 2) * 2, 0);
+    channelRows.assign(capacity.width * 2, 0);
+    magnitudes.assign((capacity.width + 2) * 3, 0);
+    map.assign((capacity.width + 2) * (capacity.height + 2), 0);
+    stack.assign(MAX(1 << 10, capacity.width * capacity.height / 10), NULL);
+    allocations++;
+}
+
+// Computes one row of the separable 3x3 Sobel derivatives of a channel of an image with interleaved channels, with
+// replicated borders, matching cvSobel(). Per column, first take the vertical smoothing [1 2 1] and difference [-1 0 1] of
+// the three source rows, then apply the transposed kernels horizontally. smoothed and differenced have room for a border
+// element on each side.
+template <int channels>
+static inline void sobelRow(const uchar* above, const uchar* center, const uchar* below, int width, int* smoothed, int* differenced,
+                            short* _dx, short* _dy)
+{
+    for (int j = 0; j < width; j++) {
+        smoothed[j] = above[j * channels] + 2 * center[j * channels] + below[j * channels];
+        differenced[j] = below[j * channels] - above[j * channels];
+    }
+    smoothed[-1] = smoothed[0];
+    smoothed[width] = smoothed[width - 1];
+    differenced[-1] = differenced[0];
+    differenced[width] = differenced[width - 1];
+    
+    for (int j = 0; j < width; j++) {
+        _dx[j] = (short)(smoothed[j + 1] - smoothed[j - 1]);
+        _dy[j] = (short)(differenced[j - 1] + 2 * differenced[j] + differenced[j + 1]);
+    }
+}
+
+template <int channels>
+static inline void sobelRow(const IplImage* src, int row, int channel, int* smoothed, int* differenced, short* _dx, short* _dy)
+{
+    const uchar* above = (const uchar*)(src->imageData + src->widthStep * MAX(row - 1, 0)) + channel;
+    const uchar* center = (const uchar*)(src->imageData + src->widthStep * row) + channel;
+    const uchar* below = (const uchar*)(src->imageData + src->widthStep * MIN(row + 1, src->height - 1)) + channel;
+    sobelRow<channels>(above, center, below, src->width, smoothed, differenced, _dx, _dy);
+}
+
+void CannyEdgeDetector::computeGradients(const IplImage* src)
+{
+    assert(src->depth == IPL_DEPTH_8U && src->nChannels == 1 && !src->roi);
+    computeChannelGradients(src, 0);
+}
+
+void CannyEdgeDetector::computeChannelGradients(const IplImage* src, int channel)
+{
+    assert(src->depth == IPL_DEPTH_8U && !src->roi && channel < src->nChannels);
+    prepare(cvGetSize(src));
+    
+    int* smoothed = &sobelRows[0] + 1;
+    int* differenced = smoothed + size.width + 2;
+    for (int i = 0; i < size.height; i++) {
+        short* _dx = (short*)(dx->data.ptr + dx->step * i);
+        short* _dy = (short*)(dy->data.ptr + dy->step * i);
+        switch (src->nChannels) {
+            case 1:
+                sobelRow<1>(src, i, channel, smoothed, differenced, _dx, _dy);
+                break;
+            case 3:
+                sobelRow<3>(src, i, channel, smoothed, differenced, _dx, _dy);
+                break;
+            case 4:
+                sobelRow<4>(src, i, channel, smoothed, differenced, _dx, _dy);
+                break;
+            default:
+                assert(false);
+        }
+    }
+}
+
+template <int channels>
+void CannyEdgeDetector::combineChannelGradients(const IplImage* src, ChannelCombination combination, bool l2Gradient)
+{
+    int width = size.width;
+    int* smoothed = &sobelRows[0] + 1;
+    int* differenced = smoothed + width + 2;
+    short* channelDx = &channelRows[0];
+    short* channelDy = channelDx + width;
+    
+    for (int i = 0; i < size.height; i++) {
+        short* _dx = (short*)(dx->data.ptr + dx->step * i);
+        short* _dy = (short*)(dy->data.ptr + dy->step * i);
+        sobelRow<channels>(src, i, 0, smoothed, differenced, _dx, _dy);
+        
+        // Alpha is not a color channel, so only the first three channels contribute
+        for (int channel = 1; channel < 3; channel++) {
+            sobelRow<channels>(src, i, channel, smoothed, differenced, channelDx, channelDy);
+            if (combination == ChannelCombinationSum) {
+                for (int j = 0; j < width; j++) {
+                    _dx[j] = (short)(_dx[j] + channelDx[j]);
+                    _dy[j] = (short)(_dy[j] + channelDy[j]);
+                }
+            } else if (l2Gradient) {
+                for (int j = 0; j < width; j++) {
+                    int x = channelDx[j], y = channelDy[j];
+                    int maxX = _dx[j], maxY = _dy[j];
+                    if (x * x + y * y > maxX * maxX + maxY * maxY) {
+                        _dx[j] = (short)x;
+                        _dy[j] = (short)y;
+                    }
+                }
+            } else {
+                for (int j = 0; j < width; j++) {
+                    if (abs(channelDx[j]) + abs(channelDy[j]) > abs(_dx[j]) + abs(_dy[j])) {
+                        _dx[j] = channelDx[j];
+                        _dy[j] = channelDy[j];
+                    }
+                }
+            }
+        }
+    }
+}
+
+void CannyEdgeDetector::detectColorEdges(const IplImage* src, IplImage* dst, double lowThreshold, double highThreshold,
+                                         ChannelCombination combination, bool l2Gradient)
+{
+    assert(src->depth == IPL_DEPTH_8U && (src->nChannels == 3 || src->nChannels == 4) && !src->roi);
+    
+    if (combination == ChannelCombinationOr) {
+        // Each channel's edges are traced separately, but read in place and accumulated straight into dst
+        for (int channel = 0; channel < 3; channel++) {
+            computeChannelGradients(src, channel);
+            suppressNonMaxima(lowThreshold, highThreshold, l2Gradient);
+            traceHysteresis(dst, channel > 0);
+        }
+        return;
+    }
+    
+    prepare(cvGetSize(src));
+    if (src->nChannels == 3) {
+        combineChannelGradients<3>(src, combination, l2Gradient);
+    } else {
+        combineChannelGradients<4>(src, combination, l2Gradient);
+    }
+    suppressNonMaxima(lowThreshold, highThreshold, l2Gradient);
+    traceHysteresis(dst);
+}
+
+void CannyEdgeDetector::suppressNonMaxima(double lowThreshold, double highThreshold, bool l2Gradient)
+{
+    assert(dx);
+    
+    if (lowThreshold > highThreshold) {
+        std::swap(lowThreshold, highThreshold);
+    }
+    
+    // The L2 magnitudes are compared as the bit patterns of their positive float values
+    int low, high;
+    if (l2Gradient) {
+        Cv32suf ul, uh;
+        ul.f = (float)lowThreshold;
+        uh.f = (float)highThreshold;
+        low = ul.i;
+        high = uh.i;
+    } else {
+        low = cvFloor(lowThreshold);
+        high = cvFloor(highThreshold);
+    }
+    
+    int width = size.width;
+    ptrdiff_t mapstep = width + 2;
+    int* magBuf[3] = { &magnitudes[0], &magnitudes[0] + width + 2, &magnitudes[0] + (width + 2) * 2 };
+    uchar* mapPtr = &map[0];
+    uchar** stackBottom = &stack[0];
+    stackDepth = 0;
+    
+    memset(magBuf[0], 0, (width + 2) * sizeof(int));
+    memset(mapPtr, 1, mapstep);
+    memset(mapPtr + mapstep * (size.height + 1), 1, mapstep);
+    
+    // Fill the map with one of the following values:
+    //   0 - the pixel might belong to an edge
+    //   1 - the pixel can not belong to an edge
+    //   2 - the pixel does belong to an edge
+    for (int i = 0; i <= size.height; i++) {
+        int* _mag = magBuf[(i > 0) + 1] + 1;
+        
+        if (i < size.height) {
+            const short* _dx = (const short*)(dx->data.ptr + dx->step * i);
+            const short* _dy = (const short*)(dy->data.ptr + dy->step * i);
+            _mag[-1] = _mag[width] = 0;
+            
+            if (l2Gradient) {
+                float* _magf = (float*)_mag;
+                for (int j = 0; j < width; j++) {
+                    int x = _dx[j], y = _dy[j];
+                    _magf[j] = sqrtf(x * x + y * y);
+                }
+            } else {
+                for (int j = 0; j < width; j++) {
+                    _mag[j] = abs(_dx[j]) + abs(_dy[j]);
+                }
+            }
+        } else {
+            memset(_mag - 1, 0, (width + 2) * sizeof(int));
+        }
+        
+        // At the very beginning we do not have a complete ring buffer of 3 magnitude rows for non-maxima suppression
+        if (i == 0) {
+            continue;
+        }
+        
+        uchar* _map = mapPtr + mapstep * i + 1;
+        _map[-1] = _map[width] = 1;
+        
+        _mag = magBuf[1] + 1;       // take the central row
+        const short* _dx = (const short*)(dx->data.ptr + dx->step * (i - 1));
+        const short* _dy = (const short*)(dy->data.ptr + dy->step * (i - 1));
+        ptrdiff_t magstep1 = magBuf[2] - magBuf[1];
+        ptrdiff_t magstep2 = magBuf[0] - magBuf[1];
+        
+        if (stackDepth + width > stack.size()) {
+            stack.resize(MAX(stack.size() * 3 / 2, stack.size() + 8));
+            stackBottom = &stack[0];
+            allocations++;
+        }
+        
+        int prevFlag = 0;
+        for (int j = 0; j < width; j++) {
+            int x = _dx[j];
+            int y = _dy[j];
+            int s = x ^ y;
+            int m = _mag[j];
+            
+            x = abs(x);
+            y = abs(y);
+            if (m > low) {
+                int tg22x = x * TG22;
+                int tg67x = tg22x + ((x + x) << CANNY_SHIFT);
+                y <<= CANNY_SHIFT;
+                
+                bool isMaximum;
+                if (y < tg22x) {
+                    isMaximum = m > _mag[j - 1] && m >= _mag[j + 1];
+                } else if (y > tg67x) {
+                    isMaximum = m > _mag[j + magstep2] && m >= _mag[j + magstep1];
+                } else {
+                    s = s < 0 ? -1 : 1;
+                    isMaximum = m > _mag[j + magstep2 - s] && m > _mag[j + magstep1 + s];
+                }
+                
+                if (isMaximum) {
+                    if (m > high && !prevFlag && _map[j - mapstep] != 2) {
+                        _map[j] = 2;
+                        stackBottom[stackDepth++] = _map + j;
+                        prevFlag = 1;
+                    } else {
+                        _map[j] = 0;
+                    }
+                    continue;
+                }
+            }
+            prevFlag = 0;
+            _map[j] = 1;
+        }
+        
+        // Scroll the ring buffer
+        _mag = magBuf[0];
+        magBuf[0] = magBuf[1];
+        magBuf[1] = magBuf[2];
+        magBuf[2] = _mag;
+    }
+}
+
+void CannyEdgeDetector::traceHysteresis(IplImage* dst, bool accumulate)
+{
+    assert(dx && dst->depth == IPL_DEPTH_8U && dst->nChannels == 1 && !dst->roi);
+    assert(dst->width == size.width && dst->height == size.height);
+    
+    ptrdiff_t mapstep = size.width + 2;
+    uchar** stackBottom = &stack[0];
+    
+#define CANNY_PUSH(d)    *(d) = (uchar)2, stackBottom[stackDepth++] = (d)
+    
+    while (stackDepth > 0) {
+        if (stackDepth + 8 > stack.size()) {
+            stack.resize(MAX(stack.size() * 3 / 2, stack.size() + 8));
+            stackBottom = &stack[0];
+            allocations++;
+        }
+        
+        uchar* m = stackBottom[--stackDepth];
+        if (!m[-1])
+            CANNY_PUSH(m - 1);
+        if (!m[1])
+            CANNY_PUSH(m + 1);
+        if (!m[-mapstep - 1])
+            CANNY_PUSH(m - mapstep - 1);
+        if (!m[-mapstep])
+            CANNY_PUSH(m - mapstep);
+        if (!m[-mapstep + 1])
+            CANNY_PUSH(m - mapstep + 1);
+        if (!m[mapstep - 1])
+            CANNY_PUSH(m + mapstep - 1);
+        if (!m[mapstep])
+            CANNY_PUSH(m + mapstep);
+        if (!m[mapstep + 1])
+            CANNY_PUSH(m + mapstep + 1);
+    }
+    
+#undef CANNY_PUSH
+    
+    // Form the final image
+    for (int i = 0; i < size.height; i++) {
+        const uchar* _map = &map[0] + mapstep * (i + 1) + 1;
+        uchar* _dst = (uchar*)(dst->imageData + dst->widthStep * i);
+        if (accumulate) {
+            for (int j = 0; j < size.width; j++) {
+                _dst[j] |= (uchar)-(_map[j] >> 1);
+            }
+        } else {
+            for (int j = 0; j < size.width; j++) {
+                _dst[j] = (uchar)-(_map[j] >> 1);
+            }
+        }
+    }
+}
@@ -0,0 +1,71 @@
+//
+//  CannyEdgeDetector.hpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "opencv2/opencv.hpp"
+#import <vector>
+
+// Produces the same output as cvCanny() with a 3x3 Sobel aperture, but retains its gradient, magnitude and edge map buffers
+// between calls so that no memory is allocated once it has processed an image at least as large. The individual stages are
+// exposed so that they may be timed separately.
+class CannyEdgeDetector {
+public:
+    // How the gradients of the channels of a color image are combined
+    enum ChannelCombination {
+        ChannelCombinationMaximum,      // the gradient of the channel with the largest magnitude at each pixel
+        ChannelCombinationSum,          // the gradient of the sum of the channels, so thresholds scale by about 3
+        ChannelCombinationOr            // the union of each channel's edges, identical to ORing cvCanny() of each channel
+    };
+    
+    CannyEdgeDetector();
+    ~CannyEdgeDetector();
+    
+    // Equivalent to cvCanny(src, dst, lowThreshold, highThreshold, 3 | (l2Gradient ? CV_CANNY_L2_GRADIENT : 0))
+    void detectEdges(const IplImage* src, IplImage* dst, double lowThreshold, double highThreshold, bool l2Gradient = true) {
+        computeGradients(src);
+        suppressNonMaxima(lowThreshold, highThreshold, l2Gradient);
+        traceHysteresis(dst);
+    }
+    
+    // Detects the edges of an interleaved 8-bit BGR or BGRA image, ignoring alpha. The channels are read in place, and
+    // except for ChannelCombinationOr, non-maxima suppression and hysteresis are only run once on the combined gradients.
+    void detectColorEdges(const IplImage* src, IplImage* dst, double lowThreshold, double highThreshold,
+                          ChannelCombination combination = ChannelCombinationMaximum, bool l2Gradient = true);
+    
+    // Stage 1: computes the horizontal and vertical Sobel derivatives of the 8-bit single channel src
+    void computeGradients(const IplImage* src);
+    // Stage 2: computes the gradient magnitude and marks the local maxima above lowThreshold as candidate edge pixels,
+    // queuing those above highThreshold as edge seeds
+    void suppressNonMaxima(double lowThreshold, double highThreshold, bool l2Gradient = true);
+    // Stage 3: grows the edges from the seeds through the connected candidates and writes the 0/255 edge image into dst, or
+    // ORs it into dst if accumulate is true
+    void traceHysteresis(IplImage* dst, bool accumulate = false);
+    
+    // Number of times the buffers have been (re)allocated due to size changes or the hysteresis stack has grown, for
+    // verifying steady state behavior
+    int allocationCount() const { return allocations; }
+    
+private:
+    CannyEdgeDetector(const CannyEdgeDetector&);
+    CannyEdgeDetector& operator=(const CannyEdgeDetector&);
+    
+    void prepare(CvSize newSize);
+    void computeChannelGradients(const IplImage* src, int channel);
+    template <int channels>
+    void combineChannelGradients(const IplImage* src, ChannelCombination combination, bool l2Gradient);
+    
+    CvSize size;                    // of the current image, which may be smaller than the buffers
+    CvMat* dx;                      // CV_16SC1
+    CvMat* dy;                      // CV_16SC1
+    std::vector<int> sobelRows;     // column sums for the Sobel pass, two rows of width + 2
+    std::vector<short> channelRows; // a row each of the x and y derivatives of the channel being combined
+    std::vector<int> magnitudes;    // ring buffer of 3 rows of width + 2 magnitudes
+    std::vector<uchar> map;         // (width + 2) x (height + 2) edge map with a 1 pixel non-edge border
+    std::vector<uchar*> stack;      // seeds for hysteresis
+    size_t stackDepth;
+    int allocations;
+};
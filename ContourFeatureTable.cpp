@@ -0,0 +1,98 @@
+//
+//  ContourFeatureTable.cpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "ContourFeatureTable.hpp"
+
+static inline bool aspectRatioIsWithinTenthToTen(const CvRect& rect)
+{
+    const int thousand = 1 << 10;
+    int aspectRatioTimesThousand = thousand * rect.width / rect.height;
+    return aspectRatioTimesThousand >= thousand / 10 && aspectRatioTimesThousand <= thousand * 10;
+}
+
+void ContourFeatureTable::build(CvContour* firstContour, bool gatherPoints)
+{
+    contours.clear();
+    rects.clear();
+    largerDimensions.clear();
+    aspectRatiosWithinTenthToTen.clear();
+    childCounts.clear();
+    parents.clear();
+    subtreeEnds.clear();
+    pointOffsets.clear();
+    pointCounts.clear();
+    totalPoints = 0;
+    points.clear();
+    
+    // Visit each contour before its children and its children before its next sibling, as cvNextTreeNode() does
+    int parent = -1;
+    CvContour* contour = firstContour;
+    while (contour) {
+        int index = size();
+        append(contour, parent, gatherPoints);
+        
+        if (contour->v_next) {
+            parent = index;
+            contour = (CvContour*)contour->v_next;
+            continue;
+        }
+        
+        // Close the subtrees of this contour and any ancestors without a next sibling
+        subtreeEnds[index] = index + 1;
+        while (!contour->h_next && parent >= 0) {
+            subtreeEnds[parent] = size();
+            contour = contours[parent];
+            parent = parents[parent];
+        }
+        contour = (CvContour*)contour->h_next;
+    }
+}
+
+// Appends the contour's points to points, dropping consecutive repeats, and returns the number appended
+int ContourFeatureTable::gatherUniquePoints(CvContour* contour)
+{
+    size_t first = points.size();
+    points.resize(first + contour->total);
+    if (contour->total == 0) {
+        return 0;
+    }
+    cvCvtSeqToArray((CvSeq*)contour, &points[first]);
+    
+    size_t end = first + 1;
+    for (size_t i = first + 1; i < points.size(); i++) {
+        if (points[i].x != points[end - 1].x || points[i].y != points[end - 1].y) {
+            points[end++] = points[i];
+        }
+    }
+    if (CV_IS_SEQ_CLOSED(contour) && end - first > 1 &&
+        points[end - 1].x == points[first].x && points[end - 1].y == points[first].y) {
+        end--;
+    }
+    points.resize(end);
+    return (int)(end - first);
+}
+
+void ContourFeatureTable::append(CvContour* contour, int parent, bool gatherPoints)
+{
+    CvRect rect = cvBoundingRect(contour);
+    contours.push_back(contour);
+    rects.push_back(rect);
+    largerDimensions.push_back(MAX(rect.width, rect.height));
+    aspectRatiosWithinTenthToTen.push_back(aspectRatioIsWithinTenthToTen(rect));
+    childCounts.push_back(0);
+    parents.push_back(parent);
+    subtreeEnds.push_back(0);           // set once the subtree has been visited
+    pointOffsets.push_back(totalPoints);
+    int pointCount = gatherPoints ? gatherUniquePoints(contour) : contour->total;
+    pointCounts.push_back(pointCount);
+    totalPoints += pointCount;
+    
+    if (parent >= 0) {
+        childCounts[parent]++;
+    }
+}
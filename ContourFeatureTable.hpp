@@ -0,0 +1,50 @@
+//
+//  ContourFeatureTable.hpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "opencv2/opencv.hpp"
+#import <vector>
+
+// The features of every contour of a tree that are used to select text contours, computed once per contour in a single
+// traversal and stored as parallel arrays. Contours are indexed in the depth first order that cvNextTreeNode() visits them,
+// so each contour's descendants occupy the indices between it and its subtree end, and its children are found by hopping
+// from one subtree end to the next. The arrays are retained between builds, so rebuilding a table of a similar size does
+// not allocate.
+class ContourFeatureTable {
+public:
+    ContourFeatureTable() : totalPoints (0) {}
+    
+    // Replaces the table with the contours of the tree, or empties it if firstContour is NULL. If gatherPoints is set, the
+    // points of every contour are also copied into points, omitting any point that repeats the one before it (or, at the
+    // end of a closed contour, the first point), so that a contour's pixels can be read from one contiguous array.
+    void build(CvContour* firstContour, bool gatherPoints = false);
+    
+    int size() const { return (int)contours.size(); }
+    bool empty() const { return contours.empty(); }
+    
+    int firstChild(int index) const { return (index + 1 < subtreeEnds[index]) ? index + 1 : -1; }
+    int nextSibling(int index) const {
+        int next = subtreeEnds[index];
+        return (next < size() && parents[next] == parents[index]) ? next : -1;
+    }
+    
+    std::vector<CvContour*> contours;
+    std::vector<CvRect> rects;                  // cvBoundingRect()
+    std::vector<int> largerDimensions;          // of the rects
+    std::vector<uchar> aspectRatiosWithinTenthToTen;
+    std::vector<int> childCounts;               // immediate children only
+    std::vector<int> parents;                   // -1 for the contours at the top level
+    std::vector<int> subtreeEnds;               // one past the index of the last descendant
+    std::vector<int> pointOffsets;              // the points of each contour are [pointOffsets, pointOffsets + pointCounts)
+    std::vector<int> pointCounts;               // in the concatenation of every contour's points in table order
+    int totalPoints;
+    std::vector<CvPoint> points;                // that concatenation, if gathered, and otherwise empty
+    
+private:
+    void append(CvContour* contour, int parent, bool gatherPoints);
+    int gatherUniquePoints(CvContour* contour);
+};
@@ -13,12 +13,19 @@
 #import "opencv2/opencv.hpp"
 #import "EGEdgyView.h"
 #import "UIImage-OpenCVExtensions.h"
-#import "Binarization.hpp"        // for static inlines
+#import "StagedEdgePipeline.hpp"
+#import "FramePresenter.hpp"
 #import "ImageOrientationAccelerometer.h"
 #import "EGSHKActionSheet.h"
 
 
-@interface EGCaptureController ()
+@interface EGCaptureController () {
+    StagedEdgePipeline *edgePipeline;
+    LatestFramePresenter *presenter;
+    PipelineGovernor *governor;
+    int appliedFrameRate;           // accessed atomically
+    BOOL displayScheduled;          // accessed atomically
+}
 
 - (void)setDefaultSettings;
 
@@ -26,7 +33,10 @@
 - (void)stopRunning;
 - (void)stopRunningAndResetSettings;
 - (void)updateConfiguration;
+- (void)applyTargetFrameRate;
 - (void)orientationDidChange;
+- (void)presentEdgeImage:(IplImage *)colorEdgeImage;
+- (void)displayLatestEdgeImage;
 
 - (void)thresholdChanged:(id)sender;
 - (void)cameraToggled:(id)sender;
@@ -37,12 +47,27 @@
 @end
 
 
+static void presentEdgeImage(IplImage *colorEdgeImage, void *info);
+
+
 @implementation EGCaptureController
 
 - (id)initWithNibName:(NSString *)nibNameOrNil bundle:(NSBundle *)nibBundleOrNil
 {
     if ((self = [super initWithNibName:nibNameOrNil bundle:nibBundleOrNil])) {
         sampleProcessingQueue = dispatch_queue_create("sample processing", NULL);
+        presenter = new LatestFramePresenter();
+        // Render opaque BGRA so that frames can be displayed without being converted or copied, and color the connected
+        // edges rather than tracing each contour
+        edgePipeline = new StagedEdgePipeline(presentEdgeImage, (__bridge void *)self, 1, StagedEdgePipeline::QueuePolicyDropOldest, 4,
+                                              EdgeFrameContext::RenderModeComponents);
+        // Render straight into the presenter's images, which the display wraps in place and returns once it is done with them
+        edgePipeline->setOutputPool(presenter->bufferPool());
+        // Let the measured performance pick the processing scale and frame rate
+        governor = new PipelineGovernor();
+        edgePipeline->setGovernor(governor);
+        // Much of a live view is static from frame to frame, so only recompute the edges of the parts that changed
+        edgePipeline->setIncremental(true);
         // Set up the session and output
 #if TARGET_OS_EMBEDDED
         session = [[AVCaptureSession alloc] init];
@@ -87,6 +112,9 @@
 #if TARGET_OS_EMBEDDED
     [session removeOutput:captureVideoDataOuput];
 #endif
+    delete edgePipeline;
+    delete presenter;
+    delete governor;
 }
 
 - (void)setDefaultSettings
@@ -210,9 +238,8 @@
         [currentDevice setTorchMode:torchOn ? AVCaptureTorchModeOn : AVCaptureTorchModeOff];
         [[view torchButton] setSelected:torchOn];
     }
-    // Limit the frame rate
-    [currentDevice setActiveVideoMinFrameDuration:CMTimeMake(1, 10)];  // 10 fps max
     [currentDevice unlockForConfiguration];
+    [self applyTargetFrameRate];
     
     // Ensure the image view is rotated properly
     BOOL front = [currentDevice position] == AVCaptureDevicePositionFront;
@@ -233,6 +260,20 @@
     [self orientationDidChange];
 }
 
+// Called on the main thread
+- (void)applyTargetFrameRate
+{
+    // Limit the frame rate to what the governor has found the device can sustain
+    int frameRate = governor->targetFrameRate();
+#if TARGET_OS_EMBEDDED
+    if ([currentDevice lockForConfiguration:nil]) {
+        [currentDevice setActiveVideoMinFrameDuration:CMTimeMake(1, frameRate)];
+        [currentDevice unlockForConfiguration];
+    }
+#endif
+    __atomic_store_n(&appliedFrameRate, frameRate, __ATOMIC_RELAXED);
+}
+
 - (void)orientationDidChange
 {
     UIDeviceOrientation orientation = [[ImageOrientationAccelerometer sharedInstance] deviceOrientation];
@@ -362,72 +403,96 @@
     size_t height = fallBackToBGRA32Sampling ? CVPixelBufferGetHeight(imageBuffer) : CVPixelBufferGetHeightOfPlane(imageBuffer, 0);
     CvSize size = cvSize((int)width, (int)height);
     
-    // Create an image header to hold the data. Vector copy the data since the image buffer has very slow random access performance.
-    IplImage *grayscaleImage = cvCreateImageHeader(size, IPL_DEPTH_8U, fallBackToBGRA32Sampling ? 4 : 1);
-    grayscaleImage->widthStep = (int)bytesPerRow;
-    grayscaleImage->imageSize = (int)(bytesPerRow * height);
-    cvCreateData(grayscaleImage);
-    memcpy(grayscaleImage->imageData, baseAddress, height * bytesPerRow);
+    // Queue the frame for edge rendering. The pipeline copies the plane before returning, so the buffer can then be unlocked.
+    FramePlane plane = framePlane(baseAddress,
+                                  bytesPerRow,
+                                  size.width,
+                                  size.height,
+                                  fallBackToBGRA32Sampling ? FramePlane::PixelFormatBGRA32 : FramePlane::PixelFormatGray8);
+    edgePipeline->submitFrame(plane, cannyThreshold, colorEdges);
     CVPixelBufferUnlockBaseAddress(imageBuffer, 0);
-    
-    // If we fell back, we need to convert the image to grayscale
-    if (fallBackToBGRA32Sampling) {
-        IplImage *temp = cvCreateImage(size, IPL_DEPTH_8U, 1);
-        cvCvtColor(grayscaleImage, temp, CV_BGRA2GRAY);
-        cvReleaseImage(&grayscaleImage);
-        grayscaleImage = temp;
+}
+#endif
+
+// Called on the edge pipeline's present thread with an image from the presenter's pool, which this takes ownership of
+- (void)presentEdgeImage:(IplImage *)colorEdgeImage
+{
+    if (pauseForCapture) {
+        presenter->bufferPool()->recycle(colorEdgeImage);
+        return;
     }
     
-    // Get the Canny edge image
-    IplImage *cannyEdgeImage = cvCreateImage(size, IPL_DEPTH_8U, 1);
-    cvCanny(grayscaleImage, cannyEdgeImage, 40.0, cannyThreshold, 3 | CV_CANNY_L2_GRADIENT);
-    cvReleaseImage(&grayscaleImage);
-    
-    // Find each unique contour
-    CvContour *firstContour = NULL;
-    CvMemStorage *storage = cvCreateMemStorage();
-    cvFindContours(cannyEdgeImage, storage, (CvSeq **)&firstContour, sizeof(CvContour), CV_RETR_LIST);      // modifies images
-    cvReleaseImage(&cannyEdgeImage);
-    
-    // Color each contour
-    IplImage *colorEdgeImage = cvCreateImage(size, IPL_DEPTH_8U, 3);
-    fastSetZero(colorEdgeImage);
-    if (firstContour) {
-        CvTreeNodeIterator iterator;
-        cvInitTreeNodeIterator(&iterator, firstContour, INT_MAX);
-        CvContour *contour;
-        while ((contour = (CvContour*)cvNextTreeNode(&iterator)) != NULL) {
-            CvScalar color = colorEdges ? randomRGBColor() : CV_RGB(255, 255, 255);
-            cvDrawContours(colorEdgeImage, (CvSeq *)contour, color, color, 0);
-        }
+    // Hand the frame to the main thread through the triple buffer without copying it, which never blocks. Only schedule a
+    // display pass if one isn't already pending, since that pass will pick up the newest frame anyway.
+#if PRINT_PERFORMANCE
+    CvSize size = cvGetSize(colorEdgeImage);        // the image belongs to the display once published
+#endif
+    presenter->publishBuffer(colorEdgeImage);
+    if (!__atomic_exchange_n(&displayScheduled, YES, __ATOMIC_ACQ_REL)) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self displayLatestEdgeImage];
+        });
     }
-    cvReleaseMemStorage(&storage);
-    
-    // Send the image data to the main thread for display. Block so we aren't drawing while processing.
-    dispatch_sync(dispatch_get_main_queue(), ^{
-        if (!pauseForCapture) {
-            UIImageView *imageView = [(EGEdgyView *)[self view] imageView];
-            UIImage *uiImage = [[UIImage alloc] initWithIplImage:colorEdgeImage];
-            [imageView setImage:uiImage];
-        }
-    });
     
-    cvReleaseImage(&colorEdgeImage);
+    // Apply any new frame rate decided by the governor. Only this thread changes the target, so it is applied once.
+    int targetFrameRate = governor->targetFrameRate();
+    if (targetFrameRate != __atomic_load_n(&appliedFrameRate, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&appliedFrameRate, targetFrameRate, __ATOMIC_RELAXED);
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self applyTargetFrameRate];
+        });
+    }
     
 #if PRINT_PERFORMANCE
     static CFAbsoluteTime lastUpdateTime = 0.0;
     CFAbsoluteTime currentTime = CACurrentMediaTime();
     if (lastUpdateTime) {
-        NSLog(@"Processing time: %.3f (fps %.1f) size(%u,%u)",
+        PipelineGovernor::Metrics metrics = governor->metrics();
+        NSLog(@"Processing time: %.3f (fps %.1f) size(%u,%u) latency %.3f dropped %d undisplayed %d scale %d target fps %d p95 latency %.3f recomputed %.2f",
               currentTime - lastUpdateTime,
               1.0 / (currentTime - lastUpdateTime),
               size.width,
-              size.height);
+              size.height,
+              edgePipeline->meanEndToEndLatency(),
+              edgePipeline->statistics(StagedEdgePipeline::StageCanny).framesDropped,
+              presenter->framesDropped(),
+              (int)metrics.processingScale,
+              metrics.targetFrameRate,
+              metrics.windowLatency,
+              edgePipeline->meanFractionRecomputed());
     }
     lastUpdateTime = currentTime;
 #endif
 }
-#endif
+
+// Called on the main thread
+- (void)displayLatestEdgeImage
+{
+    // Clear the flag first so that any frame published from here on schedules another pass
+    __atomic_store_n(&displayScheduled, NO, __ATOMIC_RELEASE);
+    
+    // Take the frame so that the UIImage can wrap it in place. Its data provider returns it to the pool once the image view
+    // has moved on to a later frame.
+    IplImage *colorEdgeImage = presenter->takeLatest();
+    if (colorEdgeImage) {
+        FrameBufferPool *pool = presenter->bufferPool();
+        if (pauseForCapture) {
+            pool->recycle(colorEdgeImage);
+        } else {
+            UIImageView *imageView = [(EGEdgyView *)[self view] imageView];
+            UIImage *uiImage = [[UIImage alloc] initWithIplImageNoCopy:colorEdgeImage
+                                                           orientation:UIImageOrientationUp
+                                                   releaseDataCallback:FrameBufferPool::recycleData
+                                                                  info:pool];
+            [imageView setImage:uiImage];
+        }
+    }
+}
+
+static void presentEdgeImage(IplImage *colorEdgeImage, void *info)
+{
+    [(__bridge EGCaptureController *)info presentEdgeImage:colorEdgeImage];
+}
 
 - (void)bannerViewDidLoadAd:(ADBannerView *)banner
 {
@@ -0,0 +1,183 @@
+//
+//  EdgeComponentLabeler.cpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "EdgeComponentLabeler.hpp"
+#import "Binarization.hpp"        // for static inlines
+
+static inline uint32_t packPixel(uchar blue, uchar green, uchar red)
+{
+    const uchar pixel[4] = { blue, green, red, 255 };
+    uint32_t packed;
+    memcpy(&packed, pixel, sizeof(packed));
+    return packed;
+}
+
+EdgeComponentLabeler::EdgeComponentLabeler()
+    : size (cvSize(0, 0)), provisionalLabels (0), components (0), allocations (0)
+{
+}
+
+void EdgeComponentLabeler::prepare(CvSize newSize)
+{
+    if (!labels.empty() && newSize.width == size.width && newSize.height == size.height) {
+        return;
+    }
+    
+    size = newSize;
+    labels.assign((size.width + 2) * (size.height + 1), 0);
+    
+    // Provisional labels are only created for pixels without a labeled neighbor above or to the left, so at most one pixel
+    // of each 2x2 block has one
+    int maxLabels = ((size.width + 1) / 2) * ((size.height + 1) / 2) + 1;
+    parents.assign(maxLabels, 0);
+    colors.assign(maxLabels, 0);
+    allocations++;
+}
+
+int EdgeComponentLabeler::findRoot(int label)
+{
+    int root = label;
+    while (parents[root] != root) {
+        root = parents[root];
+    }
+    // Compress the path
+    while (parents[label] != root) {
+        int next = parents[label];
+        parents[label] = root;
+        label = next;
+    }
+    return root;
+}
+
+void EdgeComponentLabeler::merge(int label, int otherLabel)
+{
+    int root = findRoot(label);
+    int otherRoot = findRoot(otherLabel);
+    
+    // Keep the smaller label as the root so that every label's parent precedes it
+    if (root < otherRoot) {
+        parents[otherRoot] = root;
+    } else {
+        parents[root] = otherRoot;
+    }
+}
+
+void EdgeComponentLabeler::labelComponents(const IplImage* edgeImage)
+{
+    assert(edgeImage->depth == IPL_DEPTH_8U && edgeImage->nChannels == 1 && !edgeImage->roi);
+    prepare(cvGetSize(edgeImage));
+    
+    int stride = size.width + 2;
+    int next = 1;
+    parents[0] = 0;
+    
+    // First pass: give each edge pixel the label of a neighbor above or to its left, recording which labels touch. Only
+    // the neighbors that are not already known to be connected through another neighbor are merged.
+    for (int i = 0; i < size.height; i++) {
+        const uchar* edges = (const uchar*)(edgeImage->imageData + edgeImage->widthStep * i);
+        int* row = &labels[stride * (i + 1) + 1];
+        const int* above = row - stride;
+        
+        int j = 0;
+        while (j < size.width) {
+            // Skip runs of background a word at a time
+            if (j + 8 <= size.width) {
+                uint64_t word;
+                memcpy(&word, edges + j, sizeof(word));
+                if (!word) {
+                    for (int k = 0; k < 8; k++) {
+                        row[j + k] = 0;
+                    }
+                    j += 8;
+                    continue;
+                }
+            }
+            
+            if (!edges[j]) {
+                row[j] = 0;
+            } else if (above[j]) {
+                row[j] = above[j];
+            } else if (above[j + 1]) {
+                row[j] = above[j + 1];
+                if (above[j - 1]) {
+                    merge(above[j + 1], above[j - 1]);
+                } else if (row[j - 1]) {
+                    merge(above[j + 1], row[j - 1]);
+                }
+            } else if (above[j - 1]) {
+                row[j] = above[j - 1];
+            } else if (row[j - 1]) {
+                row[j] = row[j - 1];
+            } else {
+                parents[next] = next;
+                row[j] = next++;
+            }
+            j++;
+        }
+    }
+    provisionalLabels = next;
+    
+    // Resolve each provisional label to a consecutive final label in place. Parents precede their children, so each parent
+    // has already been resolved.
+    components = 0;
+    colors[0] = packPixel(0, 0, 0);
+    for (int label = 1; label < provisionalLabels; label++) {
+        if (parents[label] == label) {
+            parents[label] = ++components;
+            CvScalar color = randomRGBColor();
+            colors[components] = packPixel((uchar)color.val[0], (uchar)color.val[1], (uchar)color.val[2]);
+        } else {
+            parents[label] = parents[parents[label]];
+        }
+    }
+}
+
+void EdgeComponentLabeler::renderComponents(IplImage* destination) const
+{
+    assert(destination->width == size.width && destination->height == size.height);
+    assert(destination->depth == IPL_DEPTH_8U && (destination->nChannels == 3 || destination->nChannels == 4));
+    
+    int stride = size.width + 2;
+    for (int i = 0; i < size.height; i++) {
+        const int* row = &labels[stride * (i + 1) + 1];
+        uchar* dst = (uchar*)(destination->imageData + destination->widthStep * i);
+        if (destination->nChannels == 4) {
+            uint32_t* pixels = (uint32_t*)dst;
+            for (int j = 0; j < size.width; j++) {
+                pixels[j] = colors[parents[row[j]]];
+            }
+        } else {
+            for (int j = 0; j < size.width; j++) {
+                memcpy(dst + 3 * j, &colors[parents[row[j]]], 3);
+            }
+        }
+    }
+}
+
+void EdgeComponentLabeler::renderEdgeMap(const IplImage* edgeImage, IplImage* destination)
+{
+    assert(edgeImage->depth == IPL_DEPTH_8U && edgeImage->nChannels == 1);
+    assert(destination->width == edgeImage->width && destination->height == edgeImage->height);
+    assert(destination->depth == IPL_DEPTH_8U && (destination->nChannels == 3 || destination->nChannels == 4));
+    
+    const uint32_t palette[2] = { packPixel(0, 0, 0), packPixel(255, 255, 255) };
+    for (int i = 0; i < edgeImage->height; i++) {
+        const uchar* edges = (const uchar*)(edgeImage->imageData + edgeImage->widthStep * i);
+        uchar* dst = (uchar*)(destination->imageData + destination->widthStep * i);
+        if (destination->nChannels == 4) {
+            uint32_t* pixels = (uint32_t*)dst;
+            for (int j = 0; j < edgeImage->width; j++) {
+                pixels[j] = palette[edges[j] != 0];
+            }
+        } else {
+            for (int j = 0; j < edgeImage->width; j++) {
+                memcpy(dst + 3 * j, &palette[edges[j] != 0], 3);
+            }
+        }
+    }
+}
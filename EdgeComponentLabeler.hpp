@@ -0,0 +1,48 @@
+//
+//  EdgeComponentLabeler.hpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "opencv2/opencv.hpp"
+#import <vector>
+
+// Colors each 8-connected component of an edge image in its own random color. This is a faster alternative to tracing the
+// contours with cvFindContours() and redrawing them with cvDrawContours(), since each edge pixel is visited once to be
+// labeled and once to be colored, and no CvMemStorage is used. Its buffers are retained between calls so that no memory is
+// allocated once it has processed an image of a given size.
+class EdgeComponentLabeler {
+public:
+    EdgeComponentLabeler();
+    
+    // Labels the connected components of the nonzero pixels of the 8-bit single channel edgeImage using two-pass union-find,
+    // and assigns each component a random color
+    void labelComponents(const IplImage* edgeImage);
+    
+    // Writes each pixel of the labeled image in its component's color, or black, into the BGR or BGRA destination. The alpha
+    // channel of BGRA destinations is set to 255.
+    void renderComponents(IplImage* destination) const;
+    
+    // Writes each nonzero pixel of edgeImage as white, and the others as black, into the BGR or BGRA destination
+    static void renderEdgeMap(const IplImage* edgeImage, IplImage* destination);
+    
+    int componentCount() const { return components; }
+    
+    // Number of times the buffers have been (re)allocated due to size changes, for verifying steady state behavior
+    int allocationCount() const { return allocations; }
+    
+private:
+    void prepare(CvSize newSize);
+    int findRoot(int label);
+    void merge(int label, int otherLabel);
+    
+    CvSize size;
+    std::vector<int> labels;        // (width + 2) x (height + 1) provisional labels with a non-edge top row and side columns
+    std::vector<int> parents;       // union-find forest over the provisional labels, then the final label of each
+    std::vector<uint32_t> colors;   // BGRA color of each final label, with label 0 black
+    int provisionalLabels;
+    int components;
+    int allocations;
+};
@@ -0,0 +1,232 @@
+//
+//  EdgeFramePipeline.cpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "EdgeFramePipeline.hpp"
+#import "Binarization.hpp"        // for static inlines
+
+const double EdgeFrameContext::cannyLowThreshold = 40.0;
+
+// Sets every pixel of a BGRA image to black with an alpha of 255
+static inline void fastSetOpaqueBlack(IplImage* image)
+{
+    assert(image->depth == IPL_DEPTH_8U && image->nChannels == 4 && image->widthStep % sizeof(uint32_t) == 0);
+    const uchar opaqueBlackPixel[4] = { 0, 0, 0, 255 };
+    uint32_t opaqueBlack;
+    memcpy(&opaqueBlack, opaqueBlackPixel, sizeof(opaqueBlack));
+    
+    for (int i = 0; i < image->height; i++) {
+        uint32_t* row = (uint32_t*)(image->imageData + i * image->widthStep);
+        std::fill(row, row + image->width, opaqueBlack);
+    }
+}
+
+CvSize EdgeFrameContext::scaledSize(CvSize size, ProcessingScale scale)
+{
+    switch (scale) {
+        case ProcessingScaleThreeQuarters:
+            return cvSize(MAX((size.width * 3 + 2) / 4, 1), MAX((size.height * 3 + 2) / 4, 1));
+        case ProcessingScaleHalf:
+            return cvSize((size.width + 1) / 2, (size.height + 1) / 2);     // as required by cvPyrDown()
+        default:
+            return size;
+    }
+}
+
+EdgeFrameContext::EdgeFrameContext()
+    : grayscaleImage (NULL), grayscaleBuffer (NULL), fullSizeGrayscaleBuffer (NULL), bytesCopied (0), cannyEdgeImage (NULL), colorEdgeImage (NULL), firstContour (NULL),
+      allocations (0)
+{
+    storage = cvCreateMemStorage();
+}
+
+EdgeFrameContext::~EdgeFrameContext()
+{
+    releaseImages();
+    cvReleaseMemStorage(&storage);
+}
+
+void EdgeFrameContext::prepare(CvSize size, int outputChannels)
+{
+    assert(outputChannels == 3 || outputChannels == 4);
+    if (!grayscaleBuffer || grayscaleBuffer->width != size.width || grayscaleBuffer->height != size.height ||
+        colorEdgeImage->nChannels != outputChannels) {
+        releaseImages();
+        grayscaleBuffer = cvCreateImage(size, IPL_DEPTH_8U, 1);
+        cannyEdgeImage = cvCreateImage(size, IPL_DEPTH_8U, 1);
+        colorEdgeImage = cvCreateImage(size, IPL_DEPTH_8U, outputChannels);
+        allocations++;
+    }
+    
+    // Retains the storage's blocks for reuse
+    cvClearMemStorage(storage);
+    firstContour = NULL;
+    grayscaleImage = NULL;
+    bytesCopied = 0;
+}
+
+void EdgeFrameContext::ingest(const FramePlane& plane, bool copy, ProcessingScale scale)
+{
+    assert(grayscaleBuffer && grayscaleBuffer->width == scaledSize(cvSize(plane.width, plane.height), scale).width &&
+           grayscaleBuffer->height == scaledSize(cvSize(plane.width, plane.height), scale).height);
+    
+    initImageHeaderWithPlane(&grayscaleHeader, plane);
+    grayscaleImage = grayscaleBuffer;
+    bytesCopied = 0;
+    
+    if (scale != ProcessingScaleFull) {
+        const IplImage* source = &grayscaleHeader;
+        if (plane.format == FramePlane::PixelFormatBGRA32) {
+            if (!fullSizeGrayscaleBuffer || fullSizeGrayscaleBuffer->width != plane.width || fullSizeGrayscaleBuffer->height != plane.height) {
+                cvReleaseImage(&fullSizeGrayscaleBuffer);
+                fullSizeGrayscaleBuffer = cvCreateImage(cvSize(plane.width, plane.height), IPL_DEPTH_8U, 1);
+                allocations++;
+            }
+            cvCvtColor(&grayscaleHeader, fullSizeGrayscaleBuffer, CV_BGRA2GRAY);
+            source = fullSizeGrayscaleBuffer;
+        }
+        
+        // Halving uses the Gaussian pyramid, which filters and decimates in one pass
+        if (scale == ProcessingScaleHalf) {
+            cvPyrDown(source, grayscaleBuffer, CV_GAUSSIAN_5x5);
+        } else {
+            cvResize(source, grayscaleBuffer, CV_INTER_LINEAR);
+        }
+    } else if (plane.format == FramePlane::PixelFormatBGRA32) {
+        cvCvtColor(&grayscaleHeader, grayscaleBuffer, CV_BGRA2GRAY);
+    } else if (copy) {
+        // Stream the rows in order since the plane may have very slow random access performance
+        const uchar* src = (const uchar*)plane.baseAddress;
+        uchar* dst = (uchar*)grayscaleBuffer->imageData;
+        for (int i = 0; i < plane.height; i++) {
+            memcpy(dst, src, plane.width);
+            src += plane.bytesPerRow;
+            dst += grayscaleBuffer->widthStep;
+        }
+        bytesCopied = (size_t)plane.width * plane.height;
+    } else {
+        grayscaleImage = &grayscaleHeader;
+    }
+}
+
+void EdgeFrameContext::detectEdges(CannyEdgeDetector& detector, double cannyThreshold)
+{
+    detector.detectEdges(grayscaleImage, cannyEdgeImage, cannyLowThreshold, cannyThreshold);
+}
+
+void EdgeFrameContext::detectEdges(IncrementalEdgeDetector& detector, double cannyThreshold)
+{
+    detector.detectEdges(grayscaleImage, cannyEdgeImage, cannyLowThreshold, cannyThreshold);
+}
+
+void EdgeFrameContext::traceContours()
+{
+    cvFindContours(cannyEdgeImage, storage, (CvSeq**)&firstContour, sizeof(CvContour), CV_RETR_LIST);      // modifies images
+}
+
+void EdgeFrameContext::renderEdges(bool colorEdges, IplImage* destination)
+{
+    if (!destination) {
+        destination = colorEdgeImage;
+    }
+    assert(destination->width == cannyEdgeImage->width && destination->height == cannyEdgeImage->height);
+    assert(destination->depth == IPL_DEPTH_8U && (destination->nChannels == 3 || destination->nChannels == 4));
+    
+    // Write the alpha channel of BGRA images along with the color so that they are already in the display's format
+    bool opaque = destination->nChannels == 4;
+    if (opaque) {
+        fastSetOpaqueBlack(destination);
+    } else {
+        fastSetZero(destination);
+    }
+    
+    if (firstContour) {
+        CvTreeNodeIterator iterator;
+        cvInitTreeNodeIterator(&iterator, firstContour, INT_MAX);
+        CvContour* contour;
+        while ((contour = (CvContour*)cvNextTreeNode(&iterator)) != NULL) {
+            CvScalar color = colorEdges ? randomRGBColor() : CV_RGB(255, 255, 255);
+            if (opaque) {
+                color.val[3] = 255.0;
+            }
+            cvDrawContours(destination, (CvSeq*)contour, color, color, 0);
+        }
+    }
+}
+
+void EdgeFrameContext::labelComponents()
+{
+    labeler.labelComponents(cannyEdgeImage);
+}
+
+void EdgeFrameContext::renderComponents(bool colorEdges, IplImage* destination)
+{
+    if (!destination) {
+        destination = colorEdgeImage;
+    }
+    
+    // Every pixel is written, so the destination needs no clearing
+    if (colorEdges) {
+        labeler.renderComponents(destination);
+    } else {
+        EdgeComponentLabeler::renderEdgeMap(cannyEdgeImage, destination);
+    }
+}
+
+void EdgeFrameContext::releaseImages()
+{
+    cvReleaseImage(&grayscaleBuffer);
+    cvReleaseImage(&fullSizeGrayscaleBuffer);
+    cvReleaseImage(&cannyEdgeImage);
+    cvReleaseImage(&colorEdgeImage);
+}
+
+const IplImage* EdgeFramePipeline::processFrame(const FramePlane& plane, double cannyThreshold, bool colorEdges)
+{
+    detectEdges(plane, cannyThreshold, colorEdges);
+    renderEdges(colorEdges, NULL);
+    return context.colorEdgeImage;
+}
+
+void EdgeFramePipeline::processFrame(const FramePlane& plane, double cannyThreshold, bool colorEdges, IplImage* destination)
+{
+    detectEdges(plane, cannyThreshold, colorEdges);
+    renderEdges(colorEdges, destination);
+}
+
+void EdgeFramePipeline::detectEdges(const FramePlane& plane, double cannyThreshold, bool colorEdges)
+{
+    context.prepare(EdgeFrameContext::scaledSize(cvSize(plane.width, plane.height), processingScale), outputChannels);
+    
+    // The Canny gradient pass reads its source strictly row by row, which is fast even for camera buffers with slow random
+    // access, so gray planes are used in place rather than copied
+    context.ingest(plane, false, processingScale);
+    
+    // Get the Canny edge image
+    if (incremental) {
+        context.detectEdges(incrementalEdgeDetector, cannyThreshold);
+    } else {
+        context.detectEdges(cannyEdgeDetector, cannyThreshold);
+    }
+    
+    // Find each unique contour or component. White components are drawn straight from the edge image.
+    if (renderMode == EdgeFrameContext::RenderModeContours) {
+        context.traceContours();
+    } else if (colorEdges) {
+        context.labelComponents();
+    }
+}
+
+void EdgeFramePipeline::renderEdges(bool colorEdges, IplImage* destination)
+{
+    // Color each contour or component
+    if (renderMode == EdgeFrameContext::RenderModeContours) {
+        context.renderEdges(colorEdges, destination);
+    } else {
+        context.renderComponents(colorEdges, destination);
+    }
+}
@@ -0,0 +1,134 @@
+//
+//  EdgeFramePipeline.hpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "opencv2/opencv.hpp"
+#import "CannyEdgeDetector.hpp"
+#import "EdgeComponentLabeler.hpp"
+#import "IncrementalEdgeDetector.hpp"
+#import "FrameSource.hpp"
+
+// Owns the images and contour storage needed to process one frame. They are only reallocated when the frame size changes,
+// so processing a steady stream of frames in component mode does not touch the heap. Contour mode still makes one small
+// allocation per frame, since cvFindContours() allocates its scanner on every call. The stages are called in order:
+// prepare(), ingest(), detectEdges(), then traceContours() and renderEdges() or labelComponents() and renderComponents(),
+// possibly on different threads.
+class EdgeFrameContext {
+public:
+    enum RenderMode {
+        RenderModeContours,         // trace each contour with cvFindContours() and draw it with cvDrawContours()
+        RenderModeComponents        // color each connected component of the edge image without tracing or contour storage
+    };
+    
+    // Frames may be processed at a reduced resolution to save time, with the rendered edges being scaled up for display
+    enum ProcessingScale {
+        ProcessingScaleFull,
+        ProcessingScaleThreeQuarters,
+        ProcessingScaleHalf
+    };
+    
+    static CvSize scaledSize(CvSize size, ProcessingScale scale);
+    
+    EdgeFrameContext();
+    ~EdgeFrameContext();
+    
+    // Ensures the images are allocated for frames of the given size and clears the contour storage. colorEdgeImage has
+    // outputChannels channels: 3 for BGR, or 4 for opaque BGRA that can be handed to the display without conversion.
+    void prepare(CvSize size, int outputChannels = 3);
+    
+    // Makes the plane available as grayscaleImage. Gray planes are wrapped in place without copying unless copy is true (e.g.
+    // because the consumer needs random access or must outlive the plane), in which case their rows are streamed into the
+    // context's pooled buffer. BGRA planes are converted into the pooled buffer. Planes processed at a reduced scale are
+    // downsampled into the pooled buffer, which must have been prepared with scaledSize().
+    void ingest(const FramePlane& plane, bool copy, ProcessingScale scale = ProcessingScaleFull);
+    
+    // Fills cannyEdgeImage from grayscaleImage using the caller's detector, whose buffers may be shared by many contexts
+    void detectEdges(CannyEdgeDetector& detector, double cannyThreshold);
+    // Likewise, only recomputing the parts of the frame that changed since the previous frame given to the detector
+    void detectEdges(IncrementalEdgeDetector& detector, double cannyThreshold);
+    static const double cannyLowThreshold;
+    
+    // Finds each unique contour of cannyEdgeImage, which is modified
+    void traceContours();
+    
+    // Draws each contour in a random color, or in white, into destination or colorEdgeImage if it is NULL. The destination
+    // may be BGR or BGRA, in which case the alpha channel is set to 255.
+    void renderEdges(bool colorEdges, IplImage* destination = NULL);
+    
+    // Labels the connected components of cannyEdgeImage, which is not modified. Only needed when coloring the edges.
+    void labelComponents();
+    
+    // Draws each component in a random color, or the edge pixels in white, into destination or colorEdgeImage if it is NULL.
+    // The destination may be BGR or BGRA, in which case the alpha channel is set to 255.
+    void renderComponents(bool colorEdges, IplImage* destination = NULL);
+    
+    // Number of times the images have been (re)allocated, for verifying steady state behavior
+    int allocationCount() const { return allocations + labeler.allocationCount(); }
+    
+    const IplImage* grayscaleImage; // either grayscaleHeader or grayscaleBuffer
+    IplImage grayscaleHeader;       // wraps a borrowed plane
+    IplImage* grayscaleBuffer;
+    IplImage* fullSizeGrayscaleBuffer;  // BGRA planes converted before downsampling
+    size_t bytesCopied;             // frame bytes copied by the last call to ingest()
+    IplImage* cannyEdgeImage;
+    IplImage* colorEdgeImage;       // BGR or BGRA
+    CvMemStorage* storage;
+    CvContour* firstContour;
+    EdgeComponentLabeler labeler;
+    
+private:
+    EdgeFrameContext(const EdgeFrameContext&);
+    EdgeFrameContext& operator=(const EdgeFrameContext&);
+    
+    void releaseImages();
+    
+    int allocations;
+};
+
+// Renders the edges of live camera frames. Has no dependencies on AVFoundation or UIKit so that the per-frame hot path can be
+// run, profiled and tuned headlessly.
+class EdgeFramePipeline {
+public:
+    EdgeFramePipeline(int outputChannels = 3, EdgeFrameContext::RenderMode renderMode = EdgeFrameContext::RenderModeContours)
+        : outputChannels (outputChannels), renderMode (renderMode), processingScale (EdgeFrameContext::ProcessingScaleFull),
+          incremental (false) {}
+    
+    // Returns a BGR or BGRA image, as given to the constructor, containing the edges of the plane, which is only read for the
+    // duration of the call. The returned image is owned by the pipeline and is valid until the next call.
+    const IplImage* processFrame(const FramePlane& plane, double cannyThreshold, bool colorEdges);
+    
+    // Renders the edges of the plane straight into the caller's BGR or BGRA image, which must be the plane's size at the
+    // processing scale
+    void processFrame(const FramePlane& plane, double cannyThreshold, bool colorEdges, IplImage* destination);
+    
+    // Subsequent frames are processed and rendered at the given fraction of their size
+    void setProcessingScale(EdgeFrameContext::ProcessingScale scale) { processingScale = scale; }
+    
+    // When enabled, edges are only recomputed for the tiles of each frame that changed since the previous frame
+    void setIncremental(bool enabled) { incremental = enabled; }
+    double fractionRecomputed() const { return incremental ? incrementalEdgeDetector.fractionRecomputed() : 1.0; }
+    
+    const EdgeFrameContext& frameContext() const { return context; }
+    int allocationCount() const {
+        return context.allocationCount() + cannyEdgeDetector.allocationCount() + incrementalEdgeDetector.allocationCount();
+    }
+    
+private:
+    EdgeFramePipeline(const EdgeFramePipeline&);
+    EdgeFramePipeline& operator=(const EdgeFramePipeline&);
+    
+    void detectEdges(const FramePlane& plane, double cannyThreshold, bool colorEdges);
+    void renderEdges(bool colorEdges, IplImage* destination);
+    
+    EdgeFrameContext context;
+    CannyEdgeDetector cannyEdgeDetector;
+    IncrementalEdgeDetector incrementalEdgeDetector;
+    int outputChannels;
+    EdgeFrameContext::RenderMode renderMode;
+    EdgeFrameContext::ProcessingScale processingScale;
+    bool incremental;
+};
@@ -0,0 +1,438 @@
+//
+//  EdgePipelineBenchmark.cpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "EdgePipelineBenchmark.hpp"
+#import "FramePresenter.hpp"
+#import <pthread.h>
+#import <unistd.h>
+
+EdgePipelineBenchmark::EdgePipelineBenchmark(double cannyThreshold, bool colorEdges, EdgeFrameContext::RenderMode renderMode,
+                                             int outputChannels, int warmupFrames)
+    : cannyThreshold (cannyThreshold), colorEdges (colorEdges), renderMode (renderMode), outputChannels (outputChannels),
+      warmupFrames (warmupFrames)
+{
+}
+
+EdgePipelineBenchmark::Result EdgePipelineBenchmark::run(FrameSource& source, const char* name)
+{
+    Result result;
+    result.name = name;
+    result.width = 0;
+    result.height = 0;
+    result.frames = 0;
+    
+    std::vector<double> stageSamples[StageCount];
+    std::vector<double> totalSamples;
+    double totalTime = 0.0;
+    int warmupFramesRemaining = warmupFrames;
+    
+    FramePlane plane;
+    while (source.nextFrame(plane)) {
+        if (plane.width != result.width || plane.height != result.height) {
+            result.width = plane.width;
+            result.height = plane.height;
+            warmupFramesRemaining = warmupFrames;
+        }
+        
+        int64 ticks[StageCount + 2];
+        ticks[0] = cvGetTickCount();
+        context.prepare(cvSize(plane.width, plane.height), outputChannels);
+        context.ingest(plane, false);
+        
+        ticks[1] = cvGetTickCount();
+        cannyEdgeDetector.computeGradients(context.grayscaleImage);
+        ticks[2] = cvGetTickCount();
+        cannyEdgeDetector.suppressNonMaxima(EdgeFrameContext::cannyLowThreshold, cannyThreshold);
+        ticks[3] = cvGetTickCount();
+        cannyEdgeDetector.traceHysteresis(context.cannyEdgeImage);
+        ticks[4] = cvGetTickCount();
+        
+        if (renderMode == EdgeFrameContext::RenderModeContours) {
+            context.traceContours();
+        } else if (colorEdges) {
+            context.labelComponents();
+        }
+        ticks[5] = cvGetTickCount();
+        
+        if (renderMode == EdgeFrameContext::RenderModeContours) {
+            context.renderEdges(colorEdges);
+        } else {
+            context.renderComponents(colorEdges);
+        }
+        ticks[6] = cvGetTickCount();
+        
+        if (warmupFramesRemaining > 0) {
+            warmupFramesRemaining--;
+            continue;
+        }
+        for (int stage = 0; stage < StageCount; stage++) {
+            stageSamples[stage].push_back(ticksToSeconds(ticks[stage + 2] - ticks[stage + 1]));
+        }
+        double frameTime = ticksToSeconds(ticks[StageCount + 1] - ticks[0]);
+        totalSamples.push_back(frameTime);
+        totalTime += frameTime;
+        result.frames++;
+    }
+    
+    for (int stage = 0; stage < StageCount; stage++) {
+        result.stages[stage] = percentiles(stageSamples[stage]);
+    }
+    result.total = percentiles(totalSamples);
+    result.framesPerSecond = (totalTime > 0.0) ? result.frames / totalTime : 0.0;
+    return result;
+}
+
+static const struct {
+    const char* name;
+    int width;
+    int height;
+} syntheticSizes[] = {
+    { "480p", 640, 480 },
+    { "720p", 1280, 720 },
+    { "1080p", 1920, 1080 },
+    { "4k", 3840, 2160 }
+};
+
+std::vector<EdgePipelineBenchmark::Result> EdgePipelineBenchmark::runSyntheticSuite(int framesPerSize)
+{
+    std::vector<Result> results;
+    for (size_t i = 0; i < sizeof(syntheticSizes) / sizeof(syntheticSizes[0]); i++) {
+        SyntheticFrameSource source(syntheticSizes[i].width, syntheticSizes[i].height, framesPerSize + warmupFrames);
+        results.push_back(run(source, (std::string("synthetic-") + syntheticSizes[i].name).c_str()));
+    }
+    return results;
+}
+
+std::vector<EdgePipelineBenchmark::Result> EdgePipelineBenchmark::runRenderModeComparison(int framesPerSize)
+{
+    static const struct {
+        const char* name;
+        EdgeFrameContext::RenderMode renderMode;
+    } modes[] = {
+        { "contours", EdgeFrameContext::RenderModeContours },
+        { "components", EdgeFrameContext::RenderModeComponents }
+    };
+    
+    std::vector<Result> results;
+    for (size_t i = 0; i < sizeof(syntheticSizes) / sizeof(syntheticSizes[0]); i++) {
+        for (size_t mode = 0; mode < sizeof(modes) / sizeof(modes[0]); mode++) {
+            // Each source is seeded alike, so both modes see the same frames
+            EdgePipelineBenchmark benchmark(cannyThreshold, colorEdges, modes[mode].renderMode, outputChannels, warmupFrames);
+            SyntheticFrameSource source(syntheticSizes[i].width, syntheticSizes[i].height, framesPerSize + warmupFrames);
+            std::string name = std::string(modes[mode].name) + "-" + syntheticSizes[i].name;
+            results.push_back(benchmark.run(source, name.c_str()));
+        }
+    }
+    return results;
+}
+
+EdgePipelineBenchmark::SteadyStateResult EdgePipelineBenchmark::runSteadyStateCheck(HeapAllocationCounter heapAllocationCounter,
+                                                                                  int width, int height, int frames,
+                                                                                  int warmupFrames)
+{
+    SteadyStateResult result;
+    result.width = width;
+    result.height = height;
+    result.frames = frames;
+    result.configurations = 0;
+    result.warmupAllocations = 0;
+    result.steadyAllocations = 0;
+    long heapAllocations[2] = { 0, 0 };
+    
+    static const EdgeFrameContext::RenderMode renderModes[] = {
+        EdgeFrameContext::RenderModeContours,
+        EdgeFrameContext::RenderModeComponents
+    };
+    for (int mode = 0; mode < 2; mode++) {
+        for (int outputChannels = 3; outputChannels <= 4; outputChannels++) {
+            for (int incremental = 0; incremental < 2; incremental++) {
+                EdgeFramePipeline pipeline(outputChannels, renderModes[mode]);
+                pipeline.setIncremental(incremental);
+                SyntheticFrameSource source(width, height, warmupFrames + frames);
+                
+                FramePlane plane;
+                for (int i = 0; i < warmupFrames && source.nextFrame(plane); i++) {
+                    pipeline.processFrame(plane, 100.0, true);
+                }
+                int warmupAllocations = pipeline.allocationCount();
+                while (source.nextFrame(plane)) {
+                    // The source allocates while drawing each frame, so only the pipeline is counted
+                    long startHeapAllocations = heapAllocationCounter ? heapAllocationCounter() : 0;
+                    pipeline.processFrame(plane, 100.0, true);
+                    if (heapAllocationCounter) {
+                        heapAllocations[mode] += heapAllocationCounter() - startHeapAllocations;
+                    }
+                }
+                
+                result.configurations++;
+                result.warmupAllocations += warmupAllocations;
+                result.steadyAllocations += pipeline.allocationCount() - warmupAllocations;
+            }
+        }
+    }
+    result.contourHeapAllocations = heapAllocationCounter ? heapAllocations[0] : -1;
+    result.componentHeapAllocations = heapAllocationCounter ? heapAllocations[1] : -1;
+    result.passed = result.steadyAllocations == 0 && result.componentHeapAllocations <= 0;
+    return result;
+}
+
+// The state shared by the producer thread of the presenter stress test and the consumer on the calling thread
+struct PresenterStress {
+    LatestFramePresenter* presenter;
+    IplImage* frame;
+    int frames;
+    double interval;                // seconds between frames
+    bool finished;                  // accessed atomically
+};
+
+// Stamps the number of each frame into its first and last pixels, so that the consumer can tell if a frame is torn
+static void* producePresenterFrames(void* context)
+{
+    PresenterStress* stress = (PresenterStress*)context;
+    IplImage* frame = stress->frame;
+    int* first = (int*)frame->imageData;
+    int* last = (int*)(frame->imageData + frame->widthStep * (frame->height - 1) + frame->width - sizeof(int));
+    for (int i = 1; i <= stress->frames; i++) {
+        *first = i;
+        *last = i;
+        stress->presenter->publish(frame);
+        if (stress->interval > 0.0) {
+            usleep((useconds_t)(stress->interval * 1.0e6));
+        }
+    }
+    __atomic_store_n(&stress->finished, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+EdgePipelineBenchmark::PresenterStressResult EdgePipelineBenchmark::runPresenterStressTest(int frames, int width, int height,
+                                                                                         double producerInterval,
+                                                                                         double consumerInterval)
+{
+    assert(width >= (int)sizeof(int) && height > 0);
+    PresenterStressResult result;
+    result.width = width;
+    result.height = height;
+    result.consumed = 0;
+    result.tornFrames = 0;
+    
+    LatestFramePresenter presenter;
+    PresenterStress stress;
+    stress.presenter = &presenter;
+    stress.frame = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+    cvSetZero(stress.frame);
+    stress.frames = frames;
+    stress.interval = producerInterval;
+    stress.finished = false;
+    
+    int64 startTicks = cvGetTickCount();
+    pthread_t producer;
+    pthread_create(&producer, NULL, producePresenterFrames, &stress);
+    
+    // Keep consuming until a pass after the producer finished, so that its last frame is consumed
+    bool ordered = true;
+    int lastFrameNumber = 0;
+    bool finished;
+    do {
+        finished = __atomic_load_n(&stress.finished, __ATOMIC_ACQUIRE);
+        bool isNew;
+        const IplImage* image = presenter.acquireLatest(&isNew);
+        if (isNew) {
+            int first, last;
+            memcpy(&first, image->imageData, sizeof(int));
+            memcpy(&last, image->imageData + image->widthStep * (image->height - 1) + image->width - sizeof(int), sizeof(int));
+            result.consumed++;
+            result.tornFrames += first != last;
+            ordered = ordered && first > lastFrameNumber;
+            lastFrameNumber = first;
+        }
+        if (!finished && consumerInterval > 0.0) {
+            usleep((useconds_t)(consumerInterval * 1.0e6));
+        }
+    } while (!finished);
+    pthread_join(producer, NULL);
+    result.seconds = ticksToSeconds(cvGetTickCount() - startTicks);
+    
+    result.published = presenter.framesPublished();
+    result.dropped = presenter.framesDropped();
+    result.producerStallTime = presenter.producerStallTime();
+    result.passed = result.published == frames && result.published == result.consumed + result.dropped &&
+                    result.tornFrames == 0 && ordered && lastFrameNumber == frames;
+    
+    cvReleaseImage(&stress.frame);
+    return result;
+}
+
+// Records windows of identical frames, appending the governor's metrics after each window to trace
+static void recordGovernorWindows(PipelineGovernor& governor, int windowFrames, int windows, double latency,
+                                  double stageTime, std::vector<PipelineGovernor::Metrics>& trace)
+{
+    for (int i = 0; i < windows; i++) {
+        for (int j = 0; j < windowFrames; j++) {
+            governor.recordFrame(latency, stageTime);
+        }
+        trace.push_back(governor.metrics());
+    }
+}
+
+// Checks that the settings only change every calmWindowsBeforeRaising windows of trace from start, and only upward
+static bool raisedOnlyWhenCalm(const std::vector<PipelineGovernor::Metrics>& trace, size_t start)
+{
+    bool calm = true;
+    int windowsSinceChange = 0;
+    for (size_t i = start; i < trace.size(); i++) {
+        windowsSinceChange++;
+        bool scaleRaised = trace[i].processingScale < trace[i - 1].processingScale;
+        bool frameRateRaised = trace[i].targetFrameRate > trace[i - 1].targetFrameRate;
+        bool lowered = trace[i].processingScale > trace[i - 1].processingScale ||
+                       trace[i].targetFrameRate < trace[i - 1].targetFrameRate;
+        if (scaleRaised || frameRateRaised || lowered) {
+            calm = calm && !lowered && windowsSinceChange == PipelineGovernor::calmWindowsBeforeRaising;
+            windowsSinceChange = 0;
+        }
+    }
+    return calm;
+}
+
+EdgePipelineBenchmark::GovernorCheckResult EdgePipelineBenchmark::runGovernorCheck(int windowFrames)
+{
+    // A 150 ms budget between 10 and 30 fps. Calm frames take 20 ms with a 5 ms busiest stage, over budget frames take
+    // 300 ms with a 20 ms busiest stage, which keeps up with 30 fps, and the falling behind frames have a 60 ms stage.
+    PipelineGovernor governor(0.150, 10, 30, windowFrames);
+    std::vector<PipelineGovernor::Metrics> trace;
+    trace.push_back(governor.metrics());
+    
+    // The governor starts at the minimum frame rate, which calm windows raise to the maximum
+    recordGovernorWindows(governor, windowFrames, 6 * PipelineGovernor::calmWindowsBeforeRaising, 0.020, 0.005, trace);
+    size_t overBudgetStart = trace.size();
+    bool raisedWhenCalm = raisedOnlyWhenCalm(trace, 1) && trace.back().targetFrameRate == 30;
+    
+    // Over budget, the scale is lowered one step per window, then the frame rate
+    recordGovernorWindows(governor, windowFrames, 10, 0.300, 0.020, trace);
+    bool scaleLoweredFirst = trace[overBudgetStart].processingScale == EdgeFrameContext::ProcessingScaleThreeQuarters &&
+                             trace[overBudgetStart + 1].processingScale == EdgeFrameContext::ProcessingScaleHalf;
+    for (size_t i = overBudgetStart; i < trace.size(); i++) {
+        bool frameRateLowered = trace[i].targetFrameRate < trace[i - 1].targetFrameRate;
+        bool atHalfScale = trace[i - 1].processingScale == EdgeFrameContext::ProcessingScaleHalf;
+        scaleLoweredFirst = scaleLoweredFirst && (!frameRateLowered || atHalfScale);
+    }
+    scaleLoweredFirst = scaleLoweredFirst && trace.back().targetFrameRate == 10;
+    
+    // Calm again, the scale is restored before the frame rate is raised
+    size_t calmStart = trace.size();
+    recordGovernorWindows(governor, windowFrames, 8 * PipelineGovernor::calmWindowsBeforeRaising, 0.020, 0.005, trace);
+    raisedWhenCalm = raisedWhenCalm && raisedOnlyWhenCalm(trace, calmStart);
+    bool scaleRaisedFirst = trace.back().processingScale == EdgeFrameContext::ProcessingScaleFull &&
+                            trace.back().targetFrameRate == 30;
+    for (size_t i = calmStart; i < trace.size(); i++) {
+        bool frameRateRaised = trace[i].targetFrameRate > trace[i - 1].targetFrameRate;
+        bool atFullScale = trace[i - 1].processingScale == EdgeFrameContext::ProcessingScaleFull;
+        scaleRaisedFirst = scaleRaisedFirst && (!frameRateRaised || atFullScale);
+    }
+    
+    // A 60 ms stage can't keep up with 30 or 24 fps but can with 15, and is within the latency budget
+    size_t behindStart = trace.size();
+    recordGovernorWindows(governor, windowFrames, 4, 0.020, 0.060, trace);
+    bool frameRateLoweredWhenBehind = trace.back().targetFrameRate == 15;
+    for (size_t i = behindStart; i < trace.size(); i++) {
+        bool atFullScale = trace[i].processingScale == EdgeFrameContext::ProcessingScaleFull;
+        frameRateLoweredWhenBehind = frameRateLoweredWhenBehind && atFullScale;
+    }
+    
+    GovernorCheckResult result;
+    result.windows = (int)trace.size() - 1;
+    result.scaleChanges = trace.back().scaleChanges;
+    result.frameRateChanges = trace.back().frameRateChanges;
+    result.scaleLoweredFirst = scaleLoweredFirst;
+    result.scaleRaisedFirst = scaleRaisedFirst;
+    result.raisedOnlyWhenCalm = raisedWhenCalm;
+    result.frameRateLoweredWhenBehind = frameRateLoweredWhenBehind;
+    result.passed = scaleLoweredFirst && scaleRaisedFirst && raisedWhenCalm && frameRateLoweredWhenBehind;
+    return result;
+}
+
+std::string EdgePipelineBenchmark::json(const std::vector<Result>& results)
+{
+    std::string string = "[\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& result = results[i];
+        
+        // Names are chosen by the caller, so escape them
+        std::string name;
+        for (size_t j = 0; j < result.name.size(); j++) {
+            char c = result.name[j];
+            if (c == '"' || c == '\\') {
+                name += '\\';
+            }
+            name += ((uchar)c < 0x20) ? ' ' : c;
+        }
+        
+        appendFormat(string, "  {\"name\": \"%s\", \"width\": %d, \"height\": %d, \"frames\": %d, \"fps\": %.2f,\n",
+                     name.c_str(), result.width, result.height, result.frames, result.framesPerSecond);
+        string += "   \"stages_ms\": {";
+        for (int stage = 0; stage < StageCount; stage++) {
+            string += (stage == 0) ? "\n    " : ",\n    ";
+            appendPercentiles(string, stageName((Stage)stage), result.stages[stage]);
+        }
+        string += "},\n   ";
+        appendPercentiles(string, "total_ms", result.total);
+        string += (i + 1 < results.size()) ? "},\n" : "}\n";
+    }
+    string += "]\n";
+    return string;
+}
+
+std::string EdgePipelineBenchmark::json(const SteadyStateResult& result)
+{
+    std::string string;
+    appendFormat(string, "{\"width\": %d, \"height\": %d, \"frames\": %d, \"configurations\": %d, "
+                 "\"warmup_allocations\": %d, \"steady_allocations\": %d,\n \"component_heap_allocations\": %ld, "
+                 "\"contour_heap_allocations\": %ld, \"passed\": %s}\n", result.width, result.height, result.frames,
+                 result.configurations, result.warmupAllocations, result.steadyAllocations, result.componentHeapAllocations,
+                 result.contourHeapAllocations, result.passed ? "true" : "false");
+    return string;
+}
+
+std::string EdgePipelineBenchmark::json(const PresenterStressResult& result)
+{
+    std::string string;
+    appendFormat(string, "{\"width\": %d, \"height\": %d, \"published\": %d, \"consumed\": %d, \"dropped\": %d, "
+                 "\"torn_frames\": %d,\n \"producer_stall_ms\": %.3f, \"ms\": %.3f, \"passed\": %s}\n", result.width,
+                 result.height, result.published, result.consumed, result.dropped, result.tornFrames,
+                 result.producerStallTime * 1000.0, result.seconds * 1000.0, result.passed ? "true" : "false");
+    return string;
+}
+
+std::string EdgePipelineBenchmark::json(const GovernorCheckResult& result)
+{
+    std::string string;
+    appendFormat(string, "{\"windows\": %d, \"scale_changes\": %d, \"frame_rate_changes\": %d, "
+                 "\"scale_lowered_first\": %s,\n \"scale_raised_first\": %s, \"raised_only_when_calm\": %s, "
+                 "\"frame_rate_lowered_when_behind\": %s, \"passed\": %s}\n", result.windows, result.scaleChanges,
+                 result.frameRateChanges, result.scaleLoweredFirst ? "true" : "false",
+                 result.scaleRaisedFirst ? "true" : "false", result.raisedOnlyWhenCalm ? "true" : "false",
+                 result.frameRateLoweredWhenBehind ? "true" : "false", result.passed ? "true" : "false");
+    return string;
+}
+
+const char* EdgePipelineBenchmark::stageName(Stage stage)
+{
+    switch (stage) {
+        case StageSobel:
+            return "sobel";
+        case StageNonMaximaSuppression:
+            return "nms";
+        case StageHysteresis:
+            return "hysteresis";
+        case StageContours:
+            return "contours";
+        case StageRender:
+            return "render";
+        default:
+            return "unknown";
+    }
+}
@@ -0,0 +1,129 @@
+//
+//  EdgePipelineBenchmark.hpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "opencv2/opencv.hpp"
+#import "BenchmarkUtilities.hpp"
+#import "EdgeFramePipeline.hpp"
+#import "PipelineGovernor.hpp"
+#import <string>
+#import <vector>
+
+// Replays frames through the stages of the edge pipeline on the calling thread, timing each stage of each frame, so that
+// performance can be tracked headlessly from commit to commit rather than by watching the frame rate on a device
+class EdgePipelineBenchmark {
+public:
+    enum Stage {
+        StageSobel,
+        StageNonMaximaSuppression,
+        StageHysteresis,
+        StageContours,              // contour tracing or component labeling, depending on the render mode
+        StageRender,
+        StageCount
+    };
+    
+    typedef BenchmarkPercentiles Percentiles;
+    
+    struct Result {
+        std::string name;
+        int width;
+        int height;
+        int frames;                 // timed frames, excluding the warm up frames
+        double framesPerSecond;     // for the whole pipeline on one thread
+        Percentiles stages[StageCount];
+        Percentiles total;          // per frame, including ingesting the plane
+    };
+    
+    EdgePipelineBenchmark(double cannyThreshold = 100.0, bool colorEdges = true,
+                          EdgeFrameContext::RenderMode renderMode = EdgeFrameContext::RenderModeContours,
+                          int outputChannels = 3, int warmupFrames = 5);
+    
+    // Processes every frame of the source, discarding the timings of the first warmupFrames of each size
+    Result run(FrameSource& source, const char* name);
+    
+    // Runs synthetic scenes at 480p, 720p, 1080p and 4K
+    std::vector<Result> runSyntheticSuite(int framesPerSize);
+    
+    // Runs the same synthetic scenes with each render mode and otherwise the same settings, so that tracing contours and
+    // drawing them with cvDrawContours() can be compared with labeling components by their StageContours and StageRender
+    // times. The results alternate between the modes, contours first, at each size.
+    std::vector<Result> runRenderModeComparison(int framesPerSize);
+    
+    // Returns the number of heap allocations the process has made so far, e.g. by counting calls to malloc()
+    typedef long (*HeapAllocationCounter)();
+    
+    // Processes synthetic frames of a steady size through an EdgeFramePipeline with each render mode and output format,
+    // with and without incremental edge detection, and checks that allocationCount() stops changing after the warm up frames.
+    // Given a heapAllocationCounter, also checks that component mode makes no heap allocations at all after the warm up
+    // frames. Contour mode can't guarantee this, since cvFindContours() allocates its scanner on every call.
+    struct SteadyStateResult {
+        int width;
+        int height;
+        int frames;                 // checked frames of each configuration, after its warm up frames
+        int configurations;
+        int warmupAllocations;      // summed over the configurations
+        int steadyAllocations;      // made after the warm up frames, which should be 0
+        long componentHeapAllocations;  // made after the warm up frames in component mode, which should be 0, or -1
+        long contourHeapAllocations;    // made after the warm up frames in contour mode, or -1
+        bool passed;
+    };
+    static SteadyStateResult runSteadyStateCheck(HeapAllocationCounter heapAllocationCounter = NULL, int width = 640,
+                                                 int height = 480, int frames = 30, int warmupFrames = 5);
+    
+    // Publishes frames through a LatestFramePresenter from a producer thread every producerInterval seconds, while the calling
+    // thread consumes them every consumerInterval seconds, and checks that every frame was either consumed or dropped and that
+    // none was torn
+    struct PresenterStressResult {
+        int width;
+        int height;
+        int published;
+        int consumed;
+        int dropped;
+        int tornFrames;             // consumed frames mixing the contents of two published frames
+        double producerStallTime;   // seconds, in total
+        double seconds;
+        bool passed;                // whether published == consumed + dropped, no frame was torn and frames stayed in order
+    };
+    static PresenterStressResult runPresenterStressTest(int frames = 2000, int width = 640, int height = 480,
+                                                        double producerInterval = 0.0005, double consumerInterval = 0.002);
+    
+    // Feeds a PipelineGovernor windows of synthetic frame latencies and stage times: calm windows, then windows over the
+    // latency budget, calm windows again, and windows whose busiest stage can't keep up with the frame rate. Checks that
+    // over budget the scale is lowered to 3/4 and 1/2 before the frame rate is lowered, that the scale is restored before
+    // the frame rate is raised, that settings are only raised after calmWindowsBeforeRaising calm windows, and that a stage
+    // that falls behind lowers the frame rate without changing the scale.
+    struct GovernorCheckResult {
+        int windows;
+        int scaleChanges;
+        int frameRateChanges;
+        bool scaleLoweredFirst;
+        bool scaleRaisedFirst;
+        bool raisedOnlyWhenCalm;
+        bool frameRateLoweredWhenBehind;
+        bool passed;
+    };
+    static GovernorCheckResult runGovernorCheck(int windowFrames = 15);
+    
+    // Formats the results as a JSON array with times in milliseconds
+    static std::string json(const std::vector<Result>& results);
+    static std::string json(const SteadyStateResult& result);
+    static std::string json(const PresenterStressResult& result);
+    static std::string json(const GovernorCheckResult& result);
+    static const char* stageName(Stage stage);
+    
+private:
+    EdgePipelineBenchmark(const EdgePipelineBenchmark&);
+    EdgePipelineBenchmark& operator=(const EdgePipelineBenchmark&);
+    
+    double cannyThreshold;
+    bool colorEdges;
+    EdgeFrameContext::RenderMode renderMode;
+    int outputChannels;
+    int warmupFrames;
+    EdgeFrameContext context;
+    CannyEdgeDetector cannyEdgeDetector;
+};
@@ -0,0 +1,287 @@
+//
+//  EdgyTool-main.cpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+// Runs the checks, benchmarks and batch binarizer headlessly, printing their results as JSON. The checks exit with a
+// nonzero status when they fail so that they can run as tests; see CMakeLists.txt.
+
+#import <cerrno>
+#import <cstdio>
+#import <cstdlib>
+#import <cstring>
+#import <new>
+#import <string>
+#import <vector>
+#import "BatchBinarizer.hpp"
+#import "BinarizationBenchmark.hpp"
+#import "BinarizationRegressionSuite.hpp"
+#import "BvhBenchmark.hpp"
+#import "EdgePipelineBenchmark.hpp"
+
+// Counts every heap allocation of the process for the steady state check. With glibc, malloc() itself is replaced, which
+// also catches OpenCV's allocations and those of operator new. Elsewhere only operator new can be replaced portably.
+// AddressSanitizer replaces the allocator itself, so allocations aren't counted in its builds.
+#if defined(__SANITIZE_ADDRESS__)
+static const EdgePipelineBenchmark::HeapAllocationCounter heapAllocationCounter = NULL;
+#else
+static long heapAllocations;
+
+static long heapAllocationCount()
+{
+    return __atomic_load_n(&heapAllocations, __ATOMIC_RELAXED);
+}
+
+static const EdgePipelineBenchmark::HeapAllocationCounter heapAllocationCounter = heapAllocationCount;
+
+#if defined(__GLIBC__)
+extern "C" {
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* pointer, size_t size);
+    void* __libc_memalign(size_t alignment, size_t size);
+    
+    void* malloc(size_t size)
+    {
+        __atomic_add_fetch(&heapAllocations, 1, __ATOMIC_RELAXED);
+        return __libc_malloc(size);
+    }
+    
+    void* calloc(size_t count, size_t size)
+    {
+        __atomic_add_fetch(&heapAllocations, 1, __ATOMIC_RELAXED);
+        return __libc_calloc(count, size);
+    }
+    
+    void* realloc(void* pointer, size_t size)
+    {
+        __atomic_add_fetch(&heapAllocations, 1, __ATOMIC_RELAXED);
+        return __libc_realloc(pointer, size);
+    }
+    
+    int posix_memalign(void** pointer, size_t alignment, size_t size)
+    {
+        __atomic_add_fetch(&heapAllocations, 1, __ATOMIC_RELAXED);
+        *pointer = __libc_memalign(alignment, size);
+        return *pointer ? 0 : ENOMEM;
+    }
+}
+#else
+void* operator new(size_t size) throw(std::bad_alloc)
+{
+    __atomic_add_fetch(&heapAllocations, 1, __ATOMIC_RELAXED);
+    void* pointer = malloc(size ? size : 1);
+    if (!pointer) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[](size_t size) throw(std::bad_alloc)
+{
+    return operator new(size);
+}
+
+void operator delete(void* pointer) throw()
+{
+    free(pointer);
+}
+
+void operator delete[](void* pointer) throw()
+{
+    free(pointer);
+}
+#endif
+#endif
+
+static bool checkSteadyState(std::string& json)
+{
+    EdgePipelineBenchmark::SteadyStateResult result = EdgePipelineBenchmark::runSteadyStateCheck(heapAllocationCounter);
+    json = EdgePipelineBenchmark::json(result);
+    return result.passed;
+}
+
+static bool checkPresenter(std::string& json)
+{
+    EdgePipelineBenchmark::PresenterStressResult result = EdgePipelineBenchmark::runPresenterStressTest();
+    json = EdgePipelineBenchmark::json(result);
+    return result.passed;
+}
+
+static bool checkGovernor(std::string& json)
+{
+    EdgePipelineBenchmark::GovernorCheckResult result = EdgePipelineBenchmark::runGovernorCheck();
+    json = EdgePipelineBenchmark::json(result);
+    return result.passed;
+}
+
+static bool checkBvhChurn(std::string& json)
+{
+    BvhBenchmark::ChurnResult result = BvhBenchmark::runChurnCheck();
+    json = BvhBenchmark::json(result);
+    return result.passed;
+}
+
+static bool checkStreaming(std::string& json)
+{
+    // The default band height and overlap, and bands shorter than the overlap
+    static const int bandHeights[] = { 512, 64, 100 };
+    static const int overlaps[] = { 128, 128, 150 };
+    BinarizationBenchmark::StreamingResult result =
+        BinarizationBenchmark::runStreamingCheck(std::vector<int>(bandHeights, bandHeights + 3),
+                                                 std::vector<int>(overlaps, overlaps + 3));
+    json = BinarizationBenchmark::json(result);
+    return result.passed;
+}
+
+static bool checkRegressionSuite(std::string& json)
+{
+    std::vector<BinarizationRegressionSuite::PageResult> results = BinarizationRegressionSuite::run();
+    json = BinarizationRegressionSuite::json(results);
+    return BinarizationRegressionSuite::allPassed(results);
+}
+
+static void benchmarkPipeline(std::string& json)
+{
+    EdgePipelineBenchmark benchmark;
+    json = EdgePipelineBenchmark::json(benchmark.runSyntheticSuite(30));
+}
+
+static void benchmarkRenderModes(std::string& json)
+{
+    EdgePipelineBenchmark benchmark;
+    json = EdgePipelineBenchmark::json(benchmark.runRenderModeComparison(30));
+}
+
+static void benchmarkColorEdges(std::string& json)
+{
+    json = BinarizationBenchmark::json(BinarizationBenchmark::runColorEdgeComparison());
+}
+
+static void benchmarkScaling(std::string& json)
+{
+    std::vector<int> threadCounts;
+    for (int threadCount = 1; threadCount <= 8; threadCount *= 2) {
+        threadCounts.push_back(threadCount);
+    }
+    json = BinarizationBenchmark::json(BinarizationBenchmark::runScaling(300, threadCounts));
+}
+
+static void benchmarkLocalThreshold(std::string& json)
+{
+    json = BinarizationBenchmark::json(BinarizationBenchmark::runLocalThresholdComparison());
+}
+
+static void benchmarkBvhBuild(std::string& json)
+{
+    json = BvhBenchmark::json(BvhBenchmark::runBuildComparison());
+}
+
+static void benchmarkIslands(std::string& json)
+{
+    json = BvhBenchmark::json(BvhBenchmark::runIslandDetectionComparison());
+}
+
+static void benchmarkBatchQuery(std::string& json)
+{
+    json = BvhBenchmark::json(BvhBenchmark::runBatchQueryComparison());
+}
+
+static const struct {
+    const char* name;
+    bool (*run)(std::string& json);
+} checks[] = {
+    { "steady-state", checkSteadyState },
+    { "presenter", checkPresenter },
+    { "governor", checkGovernor },
+    { "bvh-churn", checkBvhChurn },
+    { "streaming", checkStreaming },
+    { "regression", checkRegressionSuite }
+};
+
+static const struct {
+    const char* name;
+    void (*run)(std::string& json);
+} benchmarks[] = {
+    { "pipeline", benchmarkPipeline },
+    { "render-modes", benchmarkRenderModes },
+    { "color-edges", benchmarkColorEdges },
+    { "scaling", benchmarkScaling },
+    { "local-threshold", benchmarkLocalThreshold },
+    { "bvh-build", benchmarkBvhBuild },
+    { "islands", benchmarkIslands },
+    { "batch-query", benchmarkBatchQuery }
+};
+
+// Binarizes the PPM and PGM files of inputDirectory into PBM files in outputDirectory
+static bool binarizeBatch(const char* inputDirectory, const char* outputDirectory)
+{
+    std::vector<std::string> extensions;
+    extensions.push_back(".ppm");
+    extensions.push_back(".pgm");
+    std::vector<std::string> paths = BatchBinarizer::pathsInDirectory(inputDirectory, extensions);
+    
+    BatchBinarizer::Options options;
+    options.outputDirectory = outputDirectory;
+    BatchBinarizer binarizer(options);
+    BatchBinarizer::Report report = binarizer.run(paths);
+    printf("%s", BatchBinarizer::json(report).c_str());
+    return report.failures == 0;
+}
+
+static int printUsage(const char* tool)
+{
+    fprintf(stderr, "usage: %s check <name>|all\n", tool);
+    fprintf(stderr, "       %s benchmark <name>|all\n", tool);
+    fprintf(stderr, "       %s batch <input directory> <output directory>\n\nchecks:", tool);
+    for (size_t i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+        fprintf(stderr, " %s", checks[i].name);
+    }
+    fprintf(stderr, "\nbenchmarks:");
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        fprintf(stderr, " %s", benchmarks[i].name);
+    }
+    fprintf(stderr, "\n");
+    return 2;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc == 4 && strcmp(argv[1], "batch") == 0) {
+        return binarizeBatch(argv[2], argv[3]) ? 0 : 1;
+    }
+    if (argc != 3) {
+        return printUsage(argv[0]);
+    }
+    
+    bool all = strcmp(argv[2], "all") == 0;
+    bool found = false;
+    bool passed = true;
+    std::string json;
+    if (strcmp(argv[1], "check") == 0) {
+        for (size_t i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+            if (all || strcmp(argv[2], checks[i].name) == 0) {
+                bool checkPassed = checks[i].run(json);
+                printf("%s: %s\n%s\n", checks[i].name, checkPassed ? "passed" : "FAILED", json.c_str());
+                passed = passed && checkPassed;
+                found = true;
+            }
+        }
+    } else if (strcmp(argv[1], "benchmark") == 0) {
+        for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+            if (all || strcmp(argv[2], benchmarks[i].name) == 0) {
+                benchmarks[i].run(json);
+                printf("%s:\n%s\n", benchmarks[i].name, json.c_str());
+                found = true;
+            }
+        }
+    }
+    
+    if (!found) {
+        return printUsage(argv[0]);
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,166 @@
+//
+//  FramePresenter.cpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "FramePresenter.hpp"
+#import <algorithm>
+
+FrameBufferPool::FrameBufferPool() : acquiredCount (0), allocations (0), abandoned (false)
+{
+    pthread_mutex_init(&mutex, NULL);
+}
+
+FrameBufferPool::~FrameBufferPool()
+{
+    assert(images.empty());
+    pthread_mutex_destroy(&mutex);
+}
+
+IplImage* FrameBufferPool::acquire(CvSize size, int depth, int channels)
+{
+    pthread_mutex_lock(&mutex);
+    assert(!abandoned);
+    IplImage* image = NULL;
+    while (!freeImages.empty() && !image) {
+        IplImage* candidate = freeImages.back();
+        freeImages.pop_back();
+        if (candidate->width == size.width && candidate->height == size.height && candidate->depth == depth &&
+            candidate->nChannels == channels) {
+            image = candidate;
+        } else {
+            // The frame format changed, so images of the old format will not be needed again
+            releaseImage(candidate);
+        }
+    }
+    if (!image) {
+        image = cvCreateImage(size, depth, channels);
+        images.push_back(image);
+        __atomic_store_n(&allocations, allocations + 1, __ATOMIC_RELAXED);     // read without the mutex
+    }
+    acquiredCount++;
+    pthread_mutex_unlock(&mutex);
+    return image;
+}
+
+void FrameBufferPool::recycle(IplImage* image)
+{
+    pthread_mutex_lock(&mutex);
+    acquiredCount--;
+    if (abandoned) {
+        releaseImage(image);
+    } else {
+        freeImages.push_back(image);
+    }
+    bool finished = abandoned && acquiredCount == 0;
+    pthread_mutex_unlock(&mutex);
+    
+    if (finished) {
+        delete this;
+    }
+}
+
+void FrameBufferPool::recycleData(void* info, const void* data, size_t)
+{
+    FrameBufferPool* pool = (FrameBufferPool*)info;
+    IplImage* image = NULL;
+    pthread_mutex_lock(&pool->mutex);
+    for (size_t i = 0; i < pool->images.size() && !image; i++) {
+        if (pool->images[i]->imageData == data) {
+            image = pool->images[i];
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    
+    assert(image);
+    pool->recycle(image);
+}
+
+void FrameBufferPool::abandon()
+{
+    pthread_mutex_lock(&mutex);
+    abandoned = true;
+    while (!freeImages.empty()) {
+        releaseImage(freeImages.back());
+        freeImages.pop_back();
+    }
+    bool finished = acquiredCount == 0;
+    pthread_mutex_unlock(&mutex);
+    
+    if (finished) {
+        delete this;
+    }
+}
+
+int FrameBufferPool::allocationCount() const
+{
+    return __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+}
+
+void FrameBufferPool::releaseImage(IplImage* image)
+{
+    images.erase(std::find(images.begin(), images.end(), image));
+    cvReleaseImage(&image);
+}
+
+LatestFramePresenter::LatestFramePresenter() : pool (new FrameBufferPool()), handoffTicks (0)
+{
+}
+
+LatestFramePresenter::~LatestFramePresenter()
+{
+    for (int i = 0; i < 3; i++) {
+        if (buffers.buffer(i)) {
+            pool->recycle(buffers.buffer(i));
+        }
+    }
+    pool->abandon();
+}
+
+void LatestFramePresenter::publish(const IplImage* image)
+{
+    IplImage* buffer = pool->acquire(cvGetSize(image), image->depth, image->nChannels);
+    cvCopy(image, buffer);
+    publishBuffer(buffer);
+}
+
+void LatestFramePresenter::publishBuffer(IplImage* buffer)
+{
+    int64 startTicks = cvGetTickCount();
+    
+    // The back buffer belongs to this thread. It holds a frame that was dropped or that the consumer is done with, if any.
+    IplImage*& back = buffers.backBuffer();
+    if (back) {
+        pool->recycle(back);
+    }
+    back = buffer;
+    buffers.publish();
+    __atomic_store_n(&handoffTicks, handoffTicks + (cvGetTickCount() - startTicks), __ATOMIC_RELAXED);
+}
+
+const IplImage* LatestFramePresenter::acquireLatest(bool* isNew)
+{
+    bool consumed = buffers.consumeLatest();
+    if (isNew) {
+        *isNew = consumed;
+    }
+    return buffers.frontBuffer();
+}
+
+IplImage* LatestFramePresenter::takeLatest()
+{
+    if (!buffers.consumeLatest()) {
+        return NULL;
+    }
+    IplImage* image = buffers.frontBuffer();
+    buffers.frontBuffer() = NULL;
+    return image;
+}
+
+double LatestFramePresenter::producerStallTime() const
+{
+    return __atomic_load_n(&handoffTicks, __ATOMIC_RELAXED) / (cvGetTickFrequency() * 1.0e6);     // ticks per microsecond
+}
@@ -0,0 +1,90 @@
+//
+//  FramePresenter.hpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import <pthread.h>
+#import <vector>
+#import "opencv2/opencv.hpp"
+#import "TripleBuffer.hpp"
+
+// Images that are recycled rather than freed, so that frames can be rendered into them and displayed from them in place
+// without allocating. Any thread may acquire and recycle images; the mutex guarding the pool is only held briefly. Images may
+// still be recycled after the pool's owner has abandoned it, as when the display releases them late, in which case they are
+// freed and the pool deletes itself once the last one is returned.
+class FrameBufferPool {
+public:
+    FrameBufferPool();
+    
+    // Returns an image of the given format, reusing a recycled one if possible. The caller owns it until it is recycled.
+    IplImage* acquire(CvSize size, int depth, int channels);
+    void recycle(IplImage* image);
+    
+    // Recycles the acquired image whose data is data into the pool passed as info. Has the signature of a
+    // CGDataProviderReleaseDataCallback, so that a data provider that wraps an image can return it once it is done with it.
+    static void recycleData(void* info, const void* data, size_t size);
+    
+    // Frees the recycled images and deletes the pool, immediately or once every acquired image has been recycled. Only
+    // recycle() and recycleData() may be called afterward.
+    void abandon();
+    
+    int allocationCount() const;    // images allocated since the pool was created, for verifying steady state behavior
+    
+private:
+    FrameBufferPool(const FrameBufferPool&);
+    FrameBufferPool& operator=(const FrameBufferPool&);
+    ~FrameBufferPool();
+    
+    void releaseImage(IplImage* image);     // with the mutex held
+    
+    pthread_mutex_t mutex;
+    std::vector<IplImage*> images;          // every image that has not been freed
+    std::vector<IplImage*> freeImages;
+    int acquiredCount;
+    int allocations;
+    bool abandoned;
+};
+
+// Passes rendered frames from a processing thread to the display thread. Publishing never waits for the display, and the
+// display always receives the newest complete frame. The frames are images from the presenter's pool, so once the pool holds
+// an image for each frame in flight, only a change in frame size or format allocates memory.
+class LatestFramePresenter {
+public:
+    LatestFramePresenter();
+    ~LatestFramePresenter();
+    
+    // Producer only. Copies image into an image from the pool and publishes it.
+    void publish(const IplImage* image);
+    
+    // Producer only. Publishes an image acquired from bufferPool() without copying it, taking ownership of it.
+    void publishBuffer(IplImage* buffer);
+    
+    // Consumer only. Returns the newest published frame, which stays valid until the next call, or NULL if none has been
+    // published yet. isNew is set to whether the frame was published since the previous call.
+    const IplImage* acquireLatest(bool* isNew = NULL);
+    
+    // Consumer only. Returns the frame published since the previous call, or NULL if there is none, and transfers its
+    // ownership to the caller so that it can be displayed without a copy. The caller returns it to bufferPool() once it
+    // is no longer displayed, for which FrameBufferPool::recycleData() can be a data provider's release callback. Do not mix
+    // with acquireLatest().
+    IplImage* takeLatest();
+    
+    // Renderers may draw into images from this pool and publish them with publishBuffer(). It lives until the presenter is
+    // destroyed and every image taken from it has been recycled.
+    FrameBufferPool* bufferPool() { return pool; }
+    
+    int framesPublished() const { return buffers.publishedCount(); }
+    int framesDropped() const { return buffers.droppedCount(); }       // replaced before the consumer acquired them
+    double producerStallTime() const;       // total seconds publish() spent handing off frames, excluding the copy
+    
+private:
+    LatestFramePresenter(const LatestFramePresenter&);
+    LatestFramePresenter& operator=(const LatestFramePresenter&);
+    
+    FrameBufferPool* pool;
+    TripleBuffer<IplImage*> buffers;        // NULL where the consumer took the image
+    int64 handoffTicks;
+};
@@ -0,0 +1,129 @@
+//
+//  FrameSource.cpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "FrameSource.hpp"
+#import <sys/mman.h>
+#import <sys/stat.h>
+#import <fcntl.h>
+#import <unistd.h>
+
+MappedYUVFileFrameSource::MappedYUVFileFrameSource(const char* path, int width, int height, Layout layout, bool loop)
+    : width (width), height (height), loop (loop), mapping (NULL), mappingSize (0), frames (0), nextIndex (0)
+{
+    size_t lumaSize = (size_t)width * height;
+    frameSize = (layout == LayoutGray8) ? lumaSize : lumaSize + 2 * ((size_t)((width + 1) / 2) * ((height + 1) / 2));
+    
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    
+    struct stat info;
+    if (fstat(fd, &info) == 0 && frameSize > 0 && (size_t)info.st_size >= frameSize) {
+        mappingSize = (size_t)info.st_size;
+        mapping = mmap(NULL, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            mapping = NULL;
+        } else {
+            madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+            frames = (int)(mappingSize / frameSize);
+        }
+    }
+    close(fd);      // the mapping remains valid
+}
+
+MappedYUVFileFrameSource::~MappedYUVFileFrameSource()
+{
+    if (mapping) {
+        munmap(mapping, mappingSize);
+    }
+}
+
+bool MappedYUVFileFrameSource::nextFrame(FramePlane& plane)
+{
+    if (!mapping) {
+        return false;
+    }
+    if (nextIndex >= frames) {
+        if (!loop) {
+            return false;
+        }
+        nextIndex = 0;
+    }
+    
+    const uchar* luma = (const uchar*)mapping + frameSize * nextIndex++;
+    plane = framePlane(luma, width, width, height, FramePlane::PixelFormatGray8);
+    return true;
+}
+
+SyntheticFrameSource::SyntheticFrameSource(int width, int height, int frameCount, uint64 seed)
+    : frameCount (frameCount), nextIndex (0), seed (seed)
+{
+    // A diagonal shading with sensor-like noise, which yields a realistic number of weak gradients for the thresholds to
+    // reject
+    background = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+    for (int i = 0; i < height; i++) {
+        uchar* row = (uchar*)(background->imageData + background->widthStep * i);
+        for (int j = 0; j < width; j++) {
+            row[j] = (uchar)(64 + 128 * (i + j) / (width + height));
+        }
+    }
+    IplImage* noise = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+    CvRNG rng = cvRNG(seed);
+    cvRandArr(&rng, noise, CV_RAND_NORMAL, cvScalarAll(0.0), cvScalarAll(6.0));
+    cvAdd(background, noise, background);
+    cvReleaseImage(&noise);
+    
+    image = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+}
+
+SyntheticFrameSource::~SyntheticFrameSource()
+{
+    cvReleaseImage(&background);
+    cvReleaseImage(&image);
+}
+
+bool SyntheticFrameSource::nextFrame(FramePlane& plane)
+{
+    if (nextIndex >= frameCount) {
+        return false;
+    }
+    
+    // Shapes keep their size, shade and velocity from frame to frame so that consecutive frames are coherent like video
+    cvCopy(background, image);
+    CvRNG rng = cvRNG(seed);
+    int width = image->width;
+    int height = image->height;
+    int scale = MAX(MIN(width, height) / 16, 4);
+    for (int i = 0; i < 48; i++) {
+        int x = cvRandInt(&rng) % width;
+        int y = cvRandInt(&rng) % height;
+        int size = scale / 2 + cvRandInt(&rng) % scale;
+        int dx = (int)(cvRandInt(&rng) % 9) - 4;
+        int dy = (int)(cvRandInt(&rng) % 9) - 4;
+        CvScalar shade = cvScalarAll(cvRandInt(&rng) % 256);
+        int thickness = (cvRandInt(&rng) % 3 == 0) ? CV_FILLED : 1 + cvRandInt(&rng) % 3;
+        
+        CvPoint center = cvPoint(x + dx * nextIndex, y + dy * nextIndex);
+        switch (i % 3) {
+            case 0:
+                cvCircle(image, center, size, shade, thickness);
+                break;
+            case 1:
+                cvRectangle(image, cvPoint(center.x - size, center.y - size / 2), cvPoint(center.x + size, center.y + size / 2), shade, thickness);
+                break;
+            default:
+                cvLine(image, cvPoint(center.x - size, center.y + size), cvPoint(center.x + size, center.y - size), shade, MAX(thickness, 1));
+                break;
+        }
+    }
+    nextIndex++;
+    
+    plane = framePlane(image->imageData, image->widthStep, width, height, FramePlane::PixelFormatGray8);
+    return true;
+}
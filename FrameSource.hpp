@@ -0,0 +1,98 @@
+//
+//  FrameSource.hpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "opencv2/opencv.hpp"
+
+// A borrowed, strided 8-bit image plane, e.g. the locked Y' plane of a camera pixel buffer. The memory is owned by whoever
+// produced the plane and is only valid for as long as they say so.
+struct FramePlane {
+    enum PixelFormat {
+        PixelFormatGray8,           // 8-bit luma, e.g. the Y' plane of bi-planar YpCbCr
+        PixelFormatBGRA32
+    };
+    
+    const void* baseAddress;
+    size_t bytesPerRow;
+    int width;
+    int height;
+    PixelFormat format;
+};
+
+static inline FramePlane framePlane(const void* baseAddress, size_t bytesPerRow, int width, int height, FramePlane::PixelFormat format)
+{
+    FramePlane plane = { baseAddress, bytesPerRow, width, height, format };
+    return plane;
+}
+
+// Initializes header to refer to the plane's pixels without copying them
+static inline void initImageHeaderWithPlane(IplImage* header, const FramePlane& plane)
+{
+    cvInitImageHeader(header, cvSize(plane.width, plane.height), IPL_DEPTH_8U, (plane.format == FramePlane::PixelFormatBGRA32) ? 4 : 1);
+    cvSetData(header, (void*)plane.baseAddress, (int)plane.bytesPerRow);
+}
+
+// A pull based supplier of frames, allowing the edge pipeline to be driven by recorded or synthetic frames
+class FrameSource {
+public:
+    virtual ~FrameSource() {}
+    
+    // Returns false once there are no more frames. The plane is valid until the next call or the source is destroyed.
+    virtual bool nextFrame(FramePlane& plane) = 0;
+};
+
+// Serves the luma planes of a raw file of back to back frames directly out of a read-only memory mapping, so that no frame
+// data is copied before it reaches the consumer
+class MappedYUVFileFrameSource : public FrameSource {
+public:
+    enum Layout {
+        LayoutGray8,                // width * height bytes per frame
+        LayoutNV12,                 // Y' plane followed by an interleaved CbCr plane at half resolution
+        LayoutI420                  // Y' plane followed by Cb and Cr planes at half resolution
+    };
+    
+    MappedYUVFileFrameSource(const char* path, int width, int height, Layout layout, bool loop = false);
+    virtual ~MappedYUVFileFrameSource();
+    
+    bool isOpen() const { return mapping != NULL; }
+    int frameCount() const { return frames; }
+    
+    virtual bool nextFrame(FramePlane& plane);
+    
+private:
+    MappedYUVFileFrameSource(const MappedYUVFileFrameSource&);
+    MappedYUVFileFrameSource& operator=(const MappedYUVFileFrameSource&);
+    
+    int width;
+    int height;
+    bool loop;
+    size_t frameSize;
+    void* mapping;
+    size_t mappingSize;
+    int frames;
+    int nextIndex;
+};
+
+// Renders a deterministic scene of moving shapes over a shaded, noisy background, for exercising the edge pipeline at any
+// resolution without recorded footage
+class SyntheticFrameSource : public FrameSource {
+public:
+    SyntheticFrameSource(int width, int height, int frameCount, uint64 seed = 1);
+    virtual ~SyntheticFrameSource();
+    
+    virtual bool nextFrame(FramePlane& plane);
+    
+private:
+    SyntheticFrameSource(const SyntheticFrameSource&);
+    SyntheticFrameSource& operator=(const SyntheticFrameSource&);
+    
+    IplImage* background;
+    IplImage* image;
+    int frameCount;
+    int nextIndex;
+    uint64 seed;
+};
@@ -0,0 +1,141 @@
+//
+//  IncrementalEdgeDetector.cpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "IncrementalEdgeDetector.hpp"
+
+// Returns a header for the rect of image, which shares its pixels, so that it can be processed as a whole image
+static inline IplImage* initSubimageHeader(IplImage* header, const IplImage* image, CvRect rect)
+{
+    cvInitImageHeader(header, cvSize(rect.width, rect.height), image->depth, image->nChannels);
+    cvSetData(header, image->imageData + image->widthStep * rect.y + rect.x * image->nChannels, image->widthStep);
+    return header;
+}
+
+static inline void copyRect(const IplImage* src, IplImage* dst, CvRect rect)
+{
+    for (int i = rect.y; i < rect.y + rect.height; i++) {
+        memcpy(dst->imageData + dst->widthStep * i + rect.x, src->imageData + src->widthStep * i + rect.x, rect.width);
+    }
+}
+
+IncrementalEdgeDetector::IncrementalEdgeDetector(int tileSize, int halo, int noiseFloor, int changeThreshold)
+    : tileSize (tileSize), halo (halo), noiseFloor (noiseFloor), changeThreshold (changeThreshold), reference (NULL), edges (NULL),
+      regionEdges (NULL), valid (false), lastLowThreshold (0.0), lastHighThreshold (0.0), lastL2Gradient (false), fraction (0.0),
+      allocations (0)
+{
+    assert(tileSize > 0 && halo >= 0);
+}
+
+IncrementalEdgeDetector::~IncrementalEdgeDetector()
+{
+    cvReleaseImage(&reference);
+    cvReleaseImage(&edges);
+    cvReleaseImage(&regionEdges);
+}
+
+void IncrementalEdgeDetector::prepare(CvSize size)
+{
+    if (reference && reference->width == size.width && reference->height == size.height) {
+        return;
+    }
+    
+    cvReleaseImage(&reference);
+    cvReleaseImage(&edges);
+    cvReleaseImage(&regionEdges);
+    reference = cvCreateImage(size, IPL_DEPTH_8U, 1);
+    edges = cvCreateImage(size, IPL_DEPTH_8U, 1);
+    regionEdges = cvCreateImage(size, IPL_DEPTH_8U, 1);
+    changedTiles.assign(((size.width + tileSize - 1) / tileSize) * ((size.height + tileSize - 1) / tileSize), 0);
+    valid = false;
+    allocations++;
+}
+
+bool IncrementalEdgeDetector::tileChanged(const IplImage* src, CvRect tile) const
+{
+    // Check a row at a time, stopping as soon as the threshold is exceeded
+    int difference = 0;
+    for (int i = tile.y; i < tile.y + tile.height; i++) {
+        const uchar* current = (const uchar*)(src->imageData + src->widthStep * i) + tile.x;
+        const uchar* previous = (const uchar*)(reference->imageData + reference->widthStep * i) + tile.x;
+        for (int j = 0; j < tile.width; j++) {
+            difference += MAX(abs(current[j] - previous[j]) - noiseFloor, 0);
+        }
+        if (difference > changeThreshold) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void IncrementalEdgeDetector::recomputeTiles(const IplImage* src, CvRect tiles, double lowThreshold, double highThreshold, bool l2Gradient)
+{
+    CvRect region = cvRect(MAX(tiles.x - halo, 0), MAX(tiles.y - halo, 0), 0, 0);
+    region.width = MIN(tiles.x + tiles.width + halo, src->width) - region.x;
+    region.height = MIN(tiles.y + tiles.height + halo, src->height) - region.y;
+    
+    IplImage srcHeader, dstHeader;
+    detector.detectEdges(initSubimageHeader(&srcHeader, src, region), initSubimageHeader(&dstHeader, regionEdges, region),
+                         lowThreshold, highThreshold, l2Gradient);
+    
+    // Keep only the tiles themselves, since the halo's edges are incomplete
+    copyRect(regionEdges, edges, tiles);
+    copyRect(src, reference, tiles);
+}
+
+void IncrementalEdgeDetector::detectEdges(const IplImage* src, IplImage* dst, double lowThreshold, double highThreshold, bool l2Gradient)
+{
+    assert(src->depth == IPL_DEPTH_8U && src->nChannels == 1 && !src->roi);
+    assert(dst->depth == IPL_DEPTH_8U && dst->nChannels == 1 && dst->width == src->width && dst->height == src->height);
+    prepare(cvGetSize(src));
+    
+    if (!valid || lowThreshold != lastLowThreshold || highThreshold != lastHighThreshold || l2Gradient != lastL2Gradient) {
+        detector.detectEdges(src, edges, lowThreshold, highThreshold, l2Gradient);
+        cvCopy(src, reference);
+        valid = true;
+        lastLowThreshold = lowThreshold;
+        lastHighThreshold = highThreshold;
+        lastL2Gradient = l2Gradient;
+        fraction = 1.0;
+    } else {
+        int columns = (src->width + tileSize - 1) / tileSize;
+        int rows = (src->height + tileSize - 1) / tileSize;
+        int recomputed = 0;
+        
+        for (int row = 0; row < rows; row++) {
+            int y = row * tileSize;
+            int height = MIN(tileSize, src->height - y);
+            uchar* changed = &changedTiles[row * columns];
+            for (int column = 0; column < columns; column++) {
+                int x = column * tileSize;
+                changed[column] = tileChanged(src, cvRect(x, y, MIN(tileSize, src->width - x), height));
+            }
+            
+            // Recompute each horizontal run of changed tiles as one region so that their halos are shared
+            int column = 0;
+            while (column < columns) {
+                if (!changed[column]) {
+                    column++;
+                    continue;
+                }
+                int end = column;
+                while (end < columns && changed[end]) {
+                    end++;
+                }
+                int x = column * tileSize;
+                CvRect tiles = cvRect(x, y, MIN(end * tileSize, src->width) - x, height);
+                recomputeTiles(src, tiles, lowThreshold, highThreshold, l2Gradient);
+                recomputed += end - column;
+                column = end;
+            }
+        }
+        fraction = (double)recomputed / (rows * columns);
+    }
+    
+    // The caller may modify dst, e.g. by finding its contours
+    cvCopy(edges, dst);
+}
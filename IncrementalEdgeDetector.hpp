@@ -0,0 +1,59 @@
+//
+//  IncrementalEdgeDetector.hpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "opencv2/opencv.hpp"
+#import "CannyEdgeDetector.hpp"
+#import <vector>
+
+// Detects the edges of a stream of frames, such as a live camera view, by only rerunning Canny on the tiles whose luma has
+// changed since their edges were last computed, and reusing the cached edges of the other tiles. Each run of changed tiles
+// is processed along with a surrounding halo so that the gradients and suppression at the tile borders match a full frame
+// pass. Hysteresis can still connect edges over longer distances than the halo, so the output may differ slightly from
+// cvCanny() near changed tiles until they are recomputed.
+class IncrementalEdgeDetector {
+public:
+    // A tile has changed when the sum over its pixels of the absolute luma difference in excess of noiseFloor exceeds
+    // changeThreshold, so that sensor noise alone doesn't cause recomputation
+    IncrementalEdgeDetector(int tileSize = 64, int halo = 16, int noiseFloor = 12, int changeThreshold = 256);
+    ~IncrementalEdgeDetector();
+    
+    // Writes the 0/255 edge image of the 8-bit single channel src into dst. Every tile is recomputed when the size or
+    // thresholds change.
+    void detectEdges(const IplImage* src, IplImage* dst, double lowThreshold, double highThreshold, bool l2Gradient = true);
+    
+    // Forces every tile to be recomputed for the next frame
+    void invalidate() { valid = false; }
+    
+    double fractionRecomputed() const { return fraction; }     // of the tiles of the last frame
+    int allocationCount() const { return allocations + detector.allocationCount(); }
+    
+private:
+    IncrementalEdgeDetector(const IncrementalEdgeDetector&);
+    IncrementalEdgeDetector& operator=(const IncrementalEdgeDetector&);
+    
+    void prepare(CvSize size);
+    bool tileChanged(const IplImage* src, CvRect tile) const;
+    void recomputeTiles(const IplImage* src, CvRect tiles, double lowThreshold, double highThreshold, bool l2Gradient);
+    
+    CannyEdgeDetector detector;
+    int tileSize;
+    int halo;
+    int noiseFloor;
+    int changeThreshold;
+    
+    IplImage* reference;            // the luma of each tile when its edges were last computed
+    IplImage* edges;                // cached edges of every tile
+    IplImage* regionEdges;          // edges of the haloed regions being recomputed
+    std::vector<uchar> changedTiles;
+    bool valid;
+    double lastLowThreshold;
+    double lastHighThreshold;
+    bool lastL2Gradient;
+    double fraction;
+    int allocations;
+};
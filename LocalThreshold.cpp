@@ -0,0 +1,207 @@
+//
+//  LocalThreshold.cpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "LocalThreshold.hpp"
+#import "WorkerPool.hpp"
+#import <vector>
+
+#if defined(__SSE2__)
+#import <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#import <arm_neon.h>
+#endif
+
+// The state shared by the tasks that threshold bands of rows
+struct LocalThresholding {
+    enum {
+        bandHeight = 64
+    };
+    
+    const IplImage* grayImg;
+    IplImage* dst;
+    const IplImage* skipMask;
+    bool sauvola;
+    int radius;                         // windowSize / 2
+    // Sauvola's m * (1 + k * (s / R - 1)) is evaluated as m * (base + deviationWeight * s) and Niblack's m + k * s as
+    // m + deviationWeight * s, identically in the scalar and SIMD paths
+    double base;
+    double deviationWeight;
+};
+
+static inline double thresholdOfWindow(const LocalThresholding* thresholding, double sum, double squareSum, double area)
+{
+    double mean = sum / area;
+    double deviation = sqrt(MAX(squareSum / area - mean * mean, 0.0));
+    if (thresholding->sauvola) {
+        return mean * (thresholding->base + thresholding->deviationWeight * deviation);
+    }
+    return mean + thresholding->deviationWeight * deviation;
+}
+
+// Thresholds the columns [x, end) of a row, whose windows span the integral image rows sums0/squareSums0 to
+// sums1/squareSums1, into output
+static void thresholdColumns(const LocalThresholding* thresholding, const uchar* gray, uchar* output, int x, int end,
+                             int windowRows, const int* sums0, const int* sums1, const double* squareSums0,
+                             const double* squareSums1)
+{
+    int width = thresholding->grayImg->width;
+    int radius = thresholding->radius;
+    for (; x < end; x++) {
+        int x0 = MAX(x - radius, 0);
+        int x1 = MIN(x + radius + 1, width);
+        double sum = sums1[x1] - sums1[x0] - sums0[x1] + sums0[x0];
+        double squareSum = squareSums1[x1] - squareSums1[x0] - squareSums0[x1] + squareSums0[x0];
+        double threshold = thresholdOfWindow(thresholding, sum, squareSum, windowRows * (x1 - x0));
+        output[x] = (gray[x] <= threshold) ? 0 : UCHAR_MAX;
+    }
+}
+
+// Thresholds the columns whose windows are not clipped by the sides of the image, two at a time where SIMD is available
+static int thresholdInteriorColumns(const LocalThresholding* thresholding, const uchar* gray, uchar* output, int x, int end,
+                                    int windowRows, const int* sums0, const int* sums1, const double* squareSums0,
+                                    const double* squareSums1)
+{
+#if defined(__SSE2__) || (defined(__ARM_NEON) && defined(__aarch64__))
+    int radius = thresholding->radius;
+    double area = windowRows * (2 * radius + 1);
+    bool sauvola = thresholding->sauvola;
+    double a = thresholding->base;
+    double b = thresholding->deviationWeight;
+#if defined(__SSE2__)
+    __m128d areas = _mm_set1_pd(area);
+    __m128d zero = _mm_setzero_pd();
+    __m128d as = _mm_set1_pd(a);
+    __m128d bs = _mm_set1_pd(b);
+    for (; x + 2 <= end; x += 2) {
+        int x0 = x - radius;
+        int x1 = x + radius + 1;
+        __m128i sums = _mm_sub_epi32(_mm_sub_epi32(_mm_loadl_epi64((const __m128i*)(sums1 + x1)),
+                                                   _mm_loadl_epi64((const __m128i*)(sums1 + x0))),
+                                     _mm_sub_epi32(_mm_loadl_epi64((const __m128i*)(sums0 + x1)),
+                                                   _mm_loadl_epi64((const __m128i*)(sums0 + x0))));
+        __m128d squareSums = _mm_sub_pd(_mm_sub_pd(_mm_loadu_pd(squareSums1 + x1), _mm_loadu_pd(squareSums1 + x0)),
+                                        _mm_sub_pd(_mm_loadu_pd(squareSums0 + x1), _mm_loadu_pd(squareSums0 + x0)));
+        __m128d means = _mm_div_pd(_mm_cvtepi32_pd(sums), areas);
+        __m128d variances = _mm_sub_pd(_mm_div_pd(squareSums, areas), _mm_mul_pd(means, means));
+        __m128d deviations = _mm_sqrt_pd(_mm_max_pd(variances, zero));
+        __m128d thresholds = sauvola ? _mm_mul_pd(means, _mm_add_pd(as, _mm_mul_pd(bs, deviations))) :
+                                       _mm_add_pd(means, _mm_mul_pd(bs, deviations));
+        __m128d pixels = _mm_set_pd(gray[x + 1], gray[x]);
+        int black = _mm_movemask_pd(_mm_cmple_pd(pixels, thresholds));
+        output[x] = (black & 1) ? 0 : UCHAR_MAX;
+        output[x + 1] = (black & 2) ? 0 : UCHAR_MAX;
+    }
+#else
+    float64x2_t areas = vdupq_n_f64(area);
+    float64x2_t zero = vdupq_n_f64(0.0);
+    float64x2_t as = vdupq_n_f64(a);
+    float64x2_t bs = vdupq_n_f64(b);
+    for (; x + 2 <= end; x += 2) {
+        int x0 = x - radius;
+        int x1 = x + radius + 1;
+        int32x2_t sums = vsub_s32(vsub_s32(vld1_s32(sums1 + x1), vld1_s32(sums1 + x0)),
+                                  vsub_s32(vld1_s32(sums0 + x1), vld1_s32(sums0 + x0)));
+        float64x2_t squareSums = vsubq_f64(vsubq_f64(vld1q_f64(squareSums1 + x1), vld1q_f64(squareSums1 + x0)),
+                                           vsubq_f64(vld1q_f64(squareSums0 + x1), vld1q_f64(squareSums0 + x0)));
+        float64x2_t means = vdivq_f64(vcvtq_f64_s64(vmovl_s32(sums)), areas);
+        float64x2_t variances = vsubq_f64(vdivq_f64(squareSums, areas), vmulq_f64(means, means));
+        float64x2_t deviations = vsqrtq_f64(vmaxq_f64(variances, zero));
+        float64x2_t thresholds = sauvola ? vmulq_f64(means, vaddq_f64(as, vmulq_f64(bs, deviations))) :
+                                           vaddq_f64(means, vmulq_f64(bs, deviations));
+        double pixelPair[2] = { (double)gray[x], (double)gray[x + 1] };
+        uint64x2_t black = vcleq_f64(vld1q_f64(pixelPair), thresholds);
+        output[x] = vgetq_lane_u64(black, 0) ? 0 : UCHAR_MAX;
+        output[x + 1] = vgetq_lane_u64(black, 1) ? 0 : UCHAR_MAX;
+    }
+#endif
+#endif
+    return x;
+}
+
+static void thresholdBand(void* context, int band)
+{
+    const LocalThresholding* thresholding = (const LocalThresholding*)context;
+    const IplImage* grayImg = thresholding->grayImg;
+    int width = grayImg->width;
+    int height = grayImg->height;
+    int radius = thresholding->radius;
+    int top = band * LocalThresholding::bandHeight;
+    int bottom = MIN(top + (int)LocalThresholding::bandHeight, height);
+    
+    // Integrate the rows of the band and the window rows above and below it, which keeps the sums within 32 bits
+    int windowTop = MAX(top - radius, 0);
+    int windowBottom = MIN(bottom + radius + 1, height);
+    CvMat rows;
+    cvGetSubRect(grayImg, &rows, cvRect(0, windowTop, width, windowBottom - windowTop));
+    CvMat* sums = cvCreateMat(rows.rows + 1, width + 1, CV_32SC1);
+    CvMat* squareSums = cvCreateMat(rows.rows + 1, width + 1, CV_64FC1);
+    cvIntegral(&rows, sums, squareSums);
+    
+    std::vector<uchar> output(width);
+    int interiorStart = MIN(radius, width);
+    int interiorEnd = MAX(width - radius - 1, interiorStart);
+    for (int y = top; y < bottom; y++) {
+        int y0 = MAX(y - radius, 0) - windowTop;
+        int y1 = MIN(y + radius + 1, height) - windowTop;
+        const int* sums0 = (const int*)(sums->data.ptr + sums->step * y0);
+        const int* sums1 = (const int*)(sums->data.ptr + sums->step * y1);
+        const double* squareSums0 = (const double*)(squareSums->data.ptr + squareSums->step * y0);
+        const double* squareSums1 = (const double*)(squareSums->data.ptr + squareSums->step * y1);
+        const uchar* gray = (const uchar*)grayImg->imageData + grayImg->widthStep * y;
+        
+        thresholdColumns(thresholding, gray, &output[0], 0, interiorStart, y1 - y0, sums0, sums1, squareSums0, squareSums1);
+        int x = thresholdInteriorColumns(thresholding, gray, &output[0], interiorStart, interiorEnd, y1 - y0,
+                                         sums0, sums1, squareSums0, squareSums1);
+        thresholdColumns(thresholding, gray, &output[0], x, width, y1 - y0, sums0, sums1, squareSums0, squareSums1);
+        
+        uchar* dst = (uchar*)thresholding->dst->imageData + thresholding->dst->widthStep * y;
+        if (thresholding->skipMask) {
+            const uchar* skip = (const uchar*)thresholding->skipMask->imageData + thresholding->skipMask->widthStep * y;
+            for (int i = 0; i < width; i++) {
+                if (!skip[i]) {
+                    dst[i] = output[i];
+                }
+            }
+        } else {
+            memcpy(dst, &output[0], width);
+        }
+    }
+    
+    cvReleaseMat(&squareSums);
+    cvReleaseMat(&sums);
+}
+
+void localThreshold(const IplImage* img, IplImage* dst, LocalThresholdMethod method, int windowSize, double k,
+                    double dynamicRange, const IplImage* skipMask, int threadCount)
+{
+    assert(img->depth == IPL_DEPTH_8U && dst->nChannels == 1 && dst->depth == IPL_DEPTH_8U);
+    assert(img->width == dst->width && img->height == dst->height);
+    
+    IplImage* grayImg = NULL;
+    if (img->nChannels != 1) {
+        grayImg = cvCreateImage(cvGetSize(img), IPL_DEPTH_8U, 1);
+        cvCvtColor(img, grayImg, (img->nChannels == 3) ? CV_BGR2GRAY : CV_BGRA2GRAY);
+    }
+    
+    LocalThresholding thresholding;
+    thresholding.grayImg = grayImg ? grayImg : img;
+    thresholding.dst = dst;
+    thresholding.skipMask = skipMask;
+    thresholding.sauvola = method == LocalThresholdMethodSauvola;
+    thresholding.radius = MAX(windowSize, 1) / 2;
+    thresholding.base = thresholding.sauvola ? 1.0 - k : 0.0;
+    thresholding.deviationWeight = thresholding.sauvola ? k / dynamicRange : k;
+    
+    WorkerPool pool(threadCount);
+    int bandCount = (img->height + LocalThresholding::bandHeight - 1) / LocalThresholding::bandHeight;
+    pool.run(bandCount, thresholdBand, &thresholding);
+    
+    if (grayImg) {
+        cvReleaseImage(&grayImg);
+    }
+}
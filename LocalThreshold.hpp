@@ -0,0 +1,29 @@
+//
+//  LocalThreshold.hpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "opencv2/opencv.hpp"
+
+// How the threshold of each pixel is derived from the mean m and standard deviation s of the window around it
+enum LocalThresholdMethod {
+    LocalThresholdMethodSauvola,        // m * (1 + k * (s / dynamicRange - 1)), with k usually 0.2 to 0.5
+    LocalThresholdMethodNiblack         // m + k * s, with k usually about -0.2
+};
+
+// Binarizes every pixel of img, which may be gray or BGR(A), into the 0/255 image dst, making the pixels at or below their
+// local threshold black (0). Each pixel's window is windowSize x windowSize pixels, clipped to the image, and its sum and
+// sum of squares are read in constant time from the cvIntegral() images of bands of rows, so the cost does not depend on
+// the window size. The bands are thresholded by threadCount threads (0 for one per processor). If skipMask is not NULL,
+// the pixels of dst where it is nonzero are left unchanged.
+void localThreshold(const IplImage* img,
+                    IplImage* dst,
+                    LocalThresholdMethod method = LocalThresholdMethodSauvola,
+                    int windowSize = 25,
+                    double k = 0.2,
+                    double dynamicRange = 128.0,
+                    const IplImage* skipMask = NULL,
+                    int threadCount = 1);
@@ -0,0 +1,159 @@
+//
+//  PipelineGovernor.cpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "PipelineGovernor.hpp"
+#import <algorithm>
+
+// Frame rates the governor steps between, in descending order
+static const int frameRateSteps[] = { 30, 24, 20, 15, 12, 10, 8, 5 };
+static const int frameRateStepCount = sizeof(frameRateSteps) / sizeof(frameRateSteps[0]);
+
+static const double headroomFraction = 0.6;     // of the budget or frame interval, below which settings may be raised
+
+// The generic forms of the builtins are used since they also support doubles
+template <typename T>
+static inline T atomicLoad(const T& value)
+{
+    T result;
+    __atomic_load(&value, &result, __ATOMIC_RELAXED);
+    return result;
+}
+
+// Only used for values that have a single writer
+template <typename T>
+static inline void atomicStore(T& value, T newValue)
+{
+    __atomic_store(&value, &newValue, __ATOMIC_RELAXED);
+}
+
+PipelineGovernor::PipelineGovernor(double latencyBudget, int minFrameRate, int maxFrameRate, int windowFrames)
+    : latencyBudget (latencyBudget), minFrameRate (minFrameRate), maxFrameRate (maxFrameRate), windowFrames (windowFrames),
+      windowStageTimeSum (0.0), calmWindows (0), scale (EdgeFrameContext::ProcessingScaleFull), frameRate (minFrameRate),
+      framesObserved (0), scaleChanges (0), frameRateChanges (0), windowLatency (0.0), windowStageTime (0.0)
+{
+    assert(minFrameRate > 0 && minFrameRate <= maxFrameRate && windowFrames > 0);
+    windowLatencies.reserve(windowFrames);
+}
+
+void PipelineGovernor::recordFrame(double latency, double busiestStageTime)
+{
+    windowLatencies.push_back(latency);
+    windowStageTimeSum += busiestStageTime;
+    atomicStore(framesObserved, framesObserved + 1);
+    
+    if ((int)windowLatencies.size() >= windowFrames) {
+        evaluateWindow();
+        windowLatencies.clear();
+        windowStageTimeSum = 0.0;
+    }
+}
+
+void PipelineGovernor::evaluateWindow()
+{
+    std::sort(windowLatencies.begin(), windowLatencies.end());
+    double latency = windowLatencies[MAX((size_t)ceil(0.95 * windowLatencies.size()), (size_t)1) - 1];
+    double stageTime = windowStageTimeSum / windowLatencies.size();
+    atomicStore(windowLatency, latency);
+    atomicStore(windowStageTime, stageTime);
+    
+    bool overBudget = latency > latencyBudget;
+    bool fallingBehind = stageTime * frameRate > 1.0;
+    if (overBudget || fallingBehind) {
+        calmWindows = 0;
+        
+        // Keep the frame rate for as long as possible when over budget, since it is more noticeable than the scale
+        if (fallingBehind && changeFrameRate(-1)) {
+            return;
+        }
+        if (scale < EdgeFrameContext::ProcessingScaleHalf) {
+            atomicStore(scale, scale + 1);
+            atomicStore(scaleChanges, scaleChanges + 1);
+        } else {
+            changeFrameRate(-1);
+        }
+        return;
+    }
+    
+    if (latency < latencyBudget * headroomFraction && stageTime * frameRate < headroomFraction) {
+        calmWindows++;
+    } else {
+        calmWindows = 0;
+    }
+    if (calmWindows >= calmWindowsBeforeRaising) {
+        calmWindows = 0;
+        
+        // Restore the scale first, then raise the frame rate if the busiest stage would still have headroom
+        if (scale > EdgeFrameContext::ProcessingScaleFull) {
+            atomicStore(scale, scale - 1);
+            atomicStore(scaleChanges, scaleChanges + 1);
+        } else {
+            int index = 0;
+            while (index < frameRateStepCount && frameRateSteps[index] > frameRate) {
+                index++;
+            }
+            int higherFrameRate = (index > 0) ? MIN(frameRateSteps[index - 1], maxFrameRate) : maxFrameRate;
+            if (stageTime * higherFrameRate < headroomFraction) {
+                changeFrameRate(1);
+            }
+        }
+    }
+}
+
+bool PipelineGovernor::changeFrameRate(int direction)
+{
+    // Step to the next rate in the given direction within the limits
+    int newFrameRate = frameRate;
+    if (direction > 0) {
+        for (int i = frameRateStepCount - 1; i >= 0; i--) {
+            if (frameRateSteps[i] > frameRate) {
+                newFrameRate = frameRateSteps[i];
+                break;
+            }
+        }
+        newFrameRate = MIN(newFrameRate, maxFrameRate);
+    } else {
+        for (int i = 0; i < frameRateStepCount; i++) {
+            if (frameRateSteps[i] < frameRate) {
+                newFrameRate = frameRateSteps[i];
+                break;
+            }
+        }
+        newFrameRate = MAX(newFrameRate, minFrameRate);
+    }
+    
+    if (newFrameRate == frameRate) {
+        return false;
+    }
+    atomicStore(frameRate, newFrameRate);
+    atomicStore(frameRateChanges, frameRateChanges + 1);
+    return true;
+}
+
+EdgeFrameContext::ProcessingScale PipelineGovernor::processingScale() const
+{
+    return (EdgeFrameContext::ProcessingScale)atomicLoad(scale);
+}
+
+int PipelineGovernor::targetFrameRate() const
+{
+    return atomicLoad(frameRate);
+}
+
+PipelineGovernor::Metrics PipelineGovernor::metrics() const
+{
+    Metrics metrics;
+    metrics.processingScale = processingScale();
+    metrics.targetFrameRate = targetFrameRate();
+    metrics.latencyBudget = latencyBudget;
+    metrics.windowLatency = atomicLoad(windowLatency);
+    metrics.windowStageTime = atomicLoad(windowStageTime);
+    metrics.framesObserved = atomicLoad(framesObserved);
+    metrics.scaleChanges = atomicLoad(scaleChanges);
+    metrics.frameRateChanges = atomicLoad(frameRateChanges);
+    return metrics;
+}
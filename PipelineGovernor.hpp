@@ -0,0 +1,70 @@
+//
+//  PipelineGovernor.hpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "opencv2/opencv.hpp"
+#import "EdgeFramePipeline.hpp"
+
+// Chooses the processing scale and camera frame rate from the measured performance of the edge pipeline, so that slower
+// devices hold a latency budget and faster ones aren't held back. Measurements are made over windows of frames. When the
+// window's 95th percentile latency exceeds the budget, the scale is lowered, and only once at half scale is the frame rate
+// lowered. The frame rate is also lowered whenever the busiest stage can't keep up with it, since frames would otherwise be
+// dropped. Settings are only raised after several consecutive windows with plenty of headroom, so as not to oscillate.
+//
+// recordFrame() must be called from a single thread, but the decisions and metrics may be read from any thread.
+class PipelineGovernor {
+public:
+    enum {
+        calmWindowsBeforeRaising = 3    // consecutive windows with headroom
+    };
+    
+    struct Metrics {
+        EdgeFrameContext::ProcessingScale processingScale;
+        int targetFrameRate;
+        double latencyBudget;           // seconds
+        double windowLatency;           // 95th percentile end to end latency of the last window, in seconds
+        double windowStageTime;         // mean time of the busiest stage over the last window, in seconds
+        int framesObserved;
+        int scaleChanges;
+        int frameRateChanges;
+    };
+    
+    PipelineGovernor(double latencyBudget = 0.150, int minFrameRate = 10, int maxFrameRate = 30, int windowFrames = 15);
+    
+    // Records a processed frame's end to end latency and the time spent in its slowest stage, which bounds the throughput
+    // of a staged pipeline
+    void recordFrame(double latency, double busiestStageTime);
+    
+    EdgeFrameContext::ProcessingScale processingScale() const;
+    int targetFrameRate() const;
+    Metrics metrics() const;
+    
+private:
+    PipelineGovernor(const PipelineGovernor&);
+    PipelineGovernor& operator=(const PipelineGovernor&);
+    
+    void evaluateWindow();
+    bool changeFrameRate(int direction);
+    
+    double latencyBudget;
+    int minFrameRate;
+    int maxFrameRate;
+    int windowFrames;
+    
+    std::vector<double> windowLatencies;
+    double windowStageTimeSum;
+    int calmWindows;                    // consecutive windows with headroom
+    
+    // Read from other threads
+    int scale;                          // EdgeFrameContext::ProcessingScale
+    int frameRate;
+    int framesObserved;
+    int scaleChanges;
+    int frameRateChanges;
+    double windowLatency;
+    double windowStageTime;
+};
@@ -0,0 +1,74 @@
+//
+//  SpscQueue.hpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import <vector>
+#import <stddef.h>
+
+// Bounded lock-free queue of pointers for exactly one producer thread and one consumer thread. The producer may also
+// displace the oldest element when the queue is full, which is resolved against a concurrent pop() with a compare-and-swap
+// on the head index so that every element is handed to exactly one of the two threads.
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) : slots (capacity, NULL), head (0), tail (0) { assert(capacity > 0); }
+    
+    size_t capacity() const { return slots.size(); }
+    size_t depth() const {
+        size_t h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+        size_t t = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+        return t - h;
+    }
+    bool empty() const { return depth() == 0; }
+    
+    // Producer only. Returns false if the queue is full.
+    bool push(T* item) {
+        size_t t = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+        if (t - __atomic_load_n(&head, __ATOMIC_ACQUIRE) >= slots.size()) {
+            return false;
+        }
+        __atomic_store_n(&slots[t % slots.size()], item, __ATOMIC_RELAXED);
+        __atomic_store_n(&tail, t + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+    
+    // Producer only. Always enqueues item, returning the oldest element that was removed to make room or NULL.
+    T* pushDisplacingOldest(T* item) {
+        T* displaced = NULL;
+        while (!push(item)) {
+            size_t h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+            T* oldest = __atomic_load_n(&slots[h % slots.size()], __ATOMIC_RELAXED);
+            if (__atomic_compare_exchange_n(&head, &h, h + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                displaced = oldest;
+            }
+        }
+        return displaced;
+    }
+    
+    // Consumer only. Returns false if the queue is empty.
+    bool pop(T*& item) {
+        size_t h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+        while (h != __atomic_load_n(&tail, __ATOMIC_ACQUIRE)) {
+            // A slot is only overwritten after head has passed it, in which case the exchange fails and we retry
+            T* value = __atomic_load_n(&slots[h % slots.size()], __ATOMIC_RELAXED);
+            if (__atomic_compare_exchange_n(&head, &h, h + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                item = value;
+                return true;
+            }
+        }
+        return false;
+    }
+    
+private:
+    SpscQueue(const SpscQueue&);
+    SpscQueue& operator=(const SpscQueue&);
+    
+    std::vector<T*> slots;
+    size_t head;        // advanced by the consumer, or by the producer when displacing
+    char padding[64];   // keep the indices on separate cache lines
+    size_t tail;        // advanced by the producer
+};
@@ -0,0 +1,289 @@
+//
+//  StagedEdgePipeline.cpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "StagedEdgePipeline.hpp"
+
+static inline double ticksToSeconds(int64 ticks)
+{
+    return ticks / (cvGetTickFrequency() * 1.0e6);       // cvGetTickFrequency() is in ticks per microsecond
+}
+
+template <typename T>
+static inline T atomicLoad(const T& value)
+{
+    return __atomic_load_n(&value, __ATOMIC_RELAXED);
+}
+
+// Only used for counters that have a single writer, so a load and store suffice
+template <typename T>
+static inline void atomicAdd(T& value, T amount)
+{
+    __atomic_store_n(&value, __atomic_load_n(&value, __ATOMIC_RELAXED) + amount, __ATOMIC_RELAXED);
+}
+
+StagedEdgePipeline::StagedEdgePipeline(PresentFunction present, void* info, int queueCapacity, QueuePolicy policy,
+                                       int outputChannels, EdgeFrameContext::RenderMode renderMode)
+    : present (present), info (info), policy (policy), outputChannels (outputChannels), renderMode (renderMode), governor (NULL),
+      outputPool (NULL), incremental (false), stopping (false), endToEndTicks (0), recomputedMillionths (0)
+{
+    assert(queueCapacity > 0);
+    
+    // Enough frames for every queue to be full while every stage thread holds one and a new frame is being ingested
+    int frameCount = (StageCount - 1) * (queueCapacity + 1) + 1;
+    for (int i = 0; i < frameCount; i++) {
+        frames.push_back(new Frame());
+        frames.back()->output = NULL;
+    }
+    freeFrames = frames;
+    pthread_mutex_init(&freeFramesMutex, NULL);
+    pthread_cond_init(&freeFramesCondition, NULL);
+    
+    queues[StageIngest] = NULL;
+    for (int stage = StageIngest + 1; stage < StageCount; stage++) {
+        queues[stage] = new SpscQueue<Frame>(queueCapacity);
+        
+        workers[stage].pipeline = this;
+        workers[stage].stage = (Stage)stage;
+        pthread_create(&workers[stage].thread, NULL, runWorker, &workers[stage]);
+    }
+}
+
+StagedEdgePipeline::~StagedEdgePipeline()
+{
+    __atomic_store_n(&stopping, true, __ATOMIC_RELEASE);
+    for (int stage = StageIngest + 1; stage < StageCount; stage++) {
+        queueNotEmpty[stage].notify();
+        queueNotFull[stage].notify();
+    }
+    for (int stage = StageIngest + 1; stage < StageCount; stage++) {
+        pthread_join(workers[stage].thread, NULL);
+        delete queues[stage];
+    }
+    
+    pthread_cond_destroy(&freeFramesCondition);
+    pthread_mutex_destroy(&freeFramesMutex);
+    for (size_t i = 0; i < frames.size(); i++) {
+        if (frames[i]->output) {
+            outputPool->recycle(frames[i]->output);
+        }
+        delete frames[i];
+    }
+}
+
+bool StagedEdgePipeline::submitFrame(const FramePlane& plane, double cannyThreshold, bool colorEdges)
+{
+    int64 startTicks = cvGetTickCount();
+    
+    Frame* frame = NULL;
+    pthread_mutex_lock(&freeFramesMutex);
+    while (freeFrames.empty() && policy == QueuePolicyBlock) {
+        pthread_cond_wait(&freeFramesCondition, &freeFramesMutex);
+    }
+    if (!freeFrames.empty()) {
+        frame = freeFrames.back();
+        freeFrames.pop_back();
+    }
+    pthread_mutex_unlock(&freeFramesMutex);
+    
+    if (!frame) {
+        atomicAdd(counters[StageIngest].framesDropped, 1);
+        return false;
+    }
+    
+    // Copy the plane since it is only valid for the duration of this call
+    EdgeFrameContext::ProcessingScale scale = governor ? governor->processingScale() : EdgeFrameContext::ProcessingScaleFull;
+    frame->context.prepare(EdgeFrameContext::scaledSize(cvSize(plane.width, plane.height), scale), outputChannels);
+    frame->context.ingest(plane, true, scale);
+    frame->cannyThreshold = cannyThreshold;
+    frame->colorEdges = colorEdges;
+    frame->submitTicks = startTicks;
+    
+    int64 endTicks = cvGetTickCount();
+    frame->busiestStageTicks = endTicks - startTicks;
+    recordProcessing(StageIngest, startTicks, endTicks);
+    enqueue(StageCanny, frame);
+    return true;
+}
+
+void StagedEdgePipeline::flush()
+{
+    pthread_mutex_lock(&freeFramesMutex);
+    while (freeFrames.size() < frames.size()) {
+        pthread_cond_wait(&freeFramesCondition, &freeFramesMutex);
+    }
+    pthread_mutex_unlock(&freeFramesMutex);
+}
+
+StagedEdgePipeline::StageStatistics StagedEdgePipeline::statistics(Stage stage) const
+{
+    const StageCounters& stageCounters = counters[stage];
+    int framesProcessed = atomicLoad(stageCounters.framesProcessed);
+    
+    StageStatistics statistics;
+    statistics.framesProcessed = framesProcessed;
+    statistics.framesDropped = atomicLoad(stageCounters.framesDropped);
+    statistics.queueDepth = queues[stage] ? (int)queues[stage]->depth() : 0;
+    statistics.maxQueueDepth = atomicLoad(stageCounters.maxQueueDepth);
+    statistics.meanLatency = framesProcessed ? ticksToSeconds(atomicLoad(stageCounters.ticks)) / framesProcessed : 0.0;
+    statistics.maxLatency = ticksToSeconds(atomicLoad(stageCounters.maxTicks));
+    statistics.meanQueueLatency = framesProcessed ? ticksToSeconds(atomicLoad(stageCounters.queueTicks)) / framesProcessed : 0.0;
+    return statistics;
+}
+
+double StagedEdgePipeline::meanEndToEndLatency() const
+{
+    int framesPresented = atomicLoad(counters[StagePresent].framesProcessed);
+    return framesPresented ? ticksToSeconds(atomicLoad(endToEndTicks)) / framesPresented : 0.0;
+}
+
+double StagedEdgePipeline::meanFractionRecomputed() const
+{
+    // The Canny stage's count is incremented after its fraction is added, so it may briefly lag, which is harmless
+    int framesDetected = atomicLoad(counters[StageCanny].framesProcessed);
+    if (!incremental || !framesDetected) {
+        return 1.0;
+    }
+    return MIN(atomicLoad(recomputedMillionths) / 1.0e6 / framesDetected, 1.0);
+}
+
+void* StagedEdgePipeline::runWorker(void* worker)
+{
+    Worker* stageWorker = (Worker*)worker;
+    stageWorker->pipeline->runStage(stageWorker->stage);
+    return NULL;
+}
+
+void StagedEdgePipeline::runStage(Stage stage)
+{
+    SpscQueue<Frame>* queue = queues[stage];
+    
+    while (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE)) {
+        Frame* frame;
+        if (!queue->pop(frame)) {
+            queueNotEmpty[stage].wait();
+            continue;
+        }
+        if (policy == QueuePolicyBlock) {
+            queueNotFull[stage].notify();
+        }
+        
+        int64 startTicks = cvGetTickCount();
+        atomicAdd(counters[stage].queueTicks, startTicks - frame->enqueueTicks);
+        processFrame(stage, frame);
+        int64 endTicks = cvGetTickCount();
+        recordProcessing(stage, startTicks, endTicks);
+        frame->busiestStageTicks = MAX(frame->busiestStageTicks, endTicks - startTicks);
+        
+        if (stage == StagePresent) {
+            atomicAdd(endToEndTicks, endTicks - frame->submitTicks);
+            if (governor) {
+                governor->recordFrame(ticksToSeconds(endTicks - frame->submitTicks), ticksToSeconds(frame->busiestStageTicks));
+            }
+            recycle(frame);
+        } else {
+            enqueue((Stage)(stage + 1), frame);
+        }
+    }
+}
+
+void StagedEdgePipeline::processFrame(Stage stage, Frame* frame)
+{
+    switch (stage) {
+        case StageCanny:
+            if (incremental) {
+                frame->context.detectEdges(incrementalEdgeDetector, frame->cannyThreshold);
+                atomicAdd(recomputedMillionths, (int64)(incrementalEdgeDetector.fractionRecomputed() * 1.0e6 + 0.5));
+            } else {
+                frame->context.detectEdges(cannyEdgeDetector, frame->cannyThreshold);
+            }
+            break;
+        case StageContours:
+            if (renderMode == EdgeFrameContext::RenderModeContours) {
+                frame->context.traceContours();
+            } else if (frame->colorEdges) {
+                frame->context.labelComponents();
+            }
+            break;
+        case StageRender:
+            if (outputPool) {
+                frame->output = outputPool->acquire(cvGetSize(frame->context.cannyEdgeImage), IPL_DEPTH_8U, outputChannels);
+            }
+            if (renderMode == EdgeFrameContext::RenderModeContours) {
+                frame->context.renderEdges(frame->colorEdges, frame->output);
+            } else {
+                frame->context.renderComponents(frame->colorEdges, frame->output);
+            }
+            break;
+        case StagePresent:
+            if (frame->output) {
+                // The present function takes ownership of the image
+                IplImage* output = frame->output;
+                frame->output = NULL;
+                present(output, info);
+            } else {
+                present(frame->context.colorEdgeImage, info);
+            }
+            break;
+        default:
+            assert(false);
+    }
+}
+
+void StagedEdgePipeline::enqueue(Stage stage, Frame* frame)
+{
+    SpscQueue<Frame>* queue = queues[stage];
+    frame->enqueueTicks = cvGetTickCount();
+    
+    if (policy == QueuePolicyDropOldest) {
+        Frame* displaced = queue->pushDisplacingOldest(frame);
+        if (displaced) {
+            atomicAdd(counters[stage].framesDropped, 1);
+            recycle(displaced);
+        }
+    } else {
+        while (!queue->push(frame)) {
+            if (__atomic_load_n(&stopping, __ATOMIC_ACQUIRE)) {
+                recycle(frame);
+                return;
+            }
+            queueNotFull[stage].wait();
+        }
+    }
+    
+    // Only this thread pushes onto the queue, so it is the only writer of its maximum depth
+    int depth = (int)queue->depth();
+    if (depth > atomicLoad(counters[stage].maxQueueDepth)) {
+        __atomic_store_n(&counters[stage].maxQueueDepth, depth, __ATOMIC_RELAXED);
+    }
+    queueNotEmpty[stage].notify();
+}
+
+void StagedEdgePipeline::recycle(Frame* frame)
+{
+    // Frames dropped after rendering still hold their output image
+    if (frame->output) {
+        outputPool->recycle(frame->output);
+        frame->output = NULL;
+    }
+    
+    pthread_mutex_lock(&freeFramesMutex);
+    freeFrames.push_back(frame);
+    pthread_cond_broadcast(&freeFramesCondition);
+    pthread_mutex_unlock(&freeFramesMutex);
+}
+
+void StagedEdgePipeline::recordProcessing(Stage stage, int64 startTicks, int64 endTicks)
+{
+    StageCounters& stageCounters = counters[stage];
+    int64 ticks = endTicks - startTicks;
+    atomicAdd(stageCounters.framesProcessed, 1);
+    atomicAdd(stageCounters.ticks, ticks);
+    if (ticks > atomicLoad(stageCounters.maxTicks)) {
+        __atomic_store_n(&stageCounters.maxTicks, ticks, __ATOMIC_RELAXED);
+    }
+}
@@ -0,0 +1,180 @@
+//
+//  StagedEdgePipeline.hpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import <pthread.h>
+#import "opencv2/opencv.hpp"
+#import "EdgeFramePipeline.hpp"
+#import "SpscQueue.hpp"
+#import "PipelineGovernor.hpp"
+#import "FramePresenter.hpp"
+
+// Wakes a single waiting thread. A notification sent while nobody is waiting is remembered, so it is never lost.
+class ThreadSignal {
+public:
+    ThreadSignal() : signaled (false) {
+        pthread_mutex_init(&mutex, NULL);
+        pthread_cond_init(&condition, NULL);
+    }
+    ~ThreadSignal() {
+        pthread_cond_destroy(&condition);
+        pthread_mutex_destroy(&mutex);
+    }
+    void notify() {
+        pthread_mutex_lock(&mutex);
+        signaled = true;
+        pthread_cond_signal(&condition);
+        pthread_mutex_unlock(&mutex);
+    }
+    void wait() {
+        pthread_mutex_lock(&mutex);
+        while (!signaled) {
+            pthread_cond_wait(&condition, &mutex);
+        }
+        signaled = false;
+        pthread_mutex_unlock(&mutex);
+    }
+    
+private:
+    ThreadSignal(const ThreadSignal&);
+    ThreadSignal& operator=(const ThreadSignal&);
+    
+    pthread_mutex_t mutex;
+    pthread_cond_t condition;
+    bool signaled;
+};
+
+// Runs the edge rendering stages concurrently, each on its own thread, connected by bounded lock-free queues:
+//
+//     submitFrame() -> ingest -> [queue] -> Canny -> [queue] -> contour trace -> [queue] -> render -> [queue] -> present
+//
+// Ingest runs on the submitting thread since the plane is only valid during the call. With the drop oldest policy a stage
+// that finds its output queue full discards the oldest queued frame instead of waiting, so the frame rate approaches that of
+// the slowest stage rather than the sum of all stages and the presented frames are always the most recent available.
+class StagedEdgePipeline {
+public:
+    enum Stage {
+        StageIngest,
+        StageCanny,
+        StageContours,
+        StageRender,
+        StagePresent,
+        StageCount
+    };
+    
+    enum QueuePolicy {
+        QueuePolicyDropOldest,      // never wait for a downstream stage
+        QueuePolicyBlock            // wait for room, so that every submitted frame is presented
+    };
+    
+    struct StageStatistics {
+        int framesProcessed;
+        int framesDropped;          // frames discarded from this stage's input queue, or by submitFrame() for StageIngest
+        int queueDepth;             // current depth of this stage's input queue
+        int maxQueueDepth;
+        double meanLatency;         // seconds spent processing each frame
+        double maxLatency;
+        double meanQueueLatency;    // seconds each frame waited in the input queue
+    };
+    
+    // Called on the present thread with the rendered BGR or BGRA image, which is only valid for the duration of the call
+    // unless the pipeline has an output pool, in which case the function takes ownership of it and must recycle it
+    typedef void (*PresentFunction)(IplImage* colorEdgeImage, void* info);
+    
+    // outputChannels selects BGR (3) or opaque BGRA (4) rendering
+    StagedEdgePipeline(PresentFunction present, void* info, int queueCapacity = 1, QueuePolicy policy = QueuePolicyDropOldest,
+                       int outputChannels = 3, EdgeFrameContext::RenderMode renderMode = EdgeFrameContext::RenderModeContours);
+    ~StagedEdgePipeline();      // discards queued frames and joins the stage threads
+    
+    // Copies the plane and queues it for processing. Returns false if the frame was dropped because every frame buffer is in
+    // flight, which can only happen with QueuePolicyDropOldest; otherwise this waits for a buffer to be recycled.
+    bool submitFrame(const FramePlane& plane, double cannyThreshold, bool colorEdges);
+    
+    // Waits until every submitted frame has been presented or dropped
+    void flush();
+    
+    // Reports the latency of each presented frame to the governor, and processes subsequently submitted frames at the
+    // scale it chooses. Must be set before any frames are submitted. The governor is not owned by the pipeline.
+    void setGovernor(PipelineGovernor* newGovernor) { governor = newGovernor; }
+    
+    // When enabled, the Canny stage only recomputes the tiles of each frame that changed since the previous frame. Must be
+    // set before any frames are submitted.
+    void setIncremental(bool enabled) { incremental = enabled; }
+    
+    // Renders each frame straight into an image acquired from the pool, such as a LatestFramePresenter's, rather than into
+    // the frame's own image, and hands that image to the present function, so that it can be displayed without a copy. Must be
+    // set before any frames are submitted. The pool is not owned by the pipeline.
+    void setOutputPool(FrameBufferPool* pool) { outputPool = pool; }
+    
+    StageStatistics statistics(Stage stage) const;
+    double meanEndToEndLatency() const;     // seconds from submitFrame() to the end of presentation
+    double meanFractionRecomputed() const;  // of the tiles of each frame, or 1 unless incremental
+    
+private:
+    StagedEdgePipeline(const StagedEdgePipeline&);
+    StagedEdgePipeline& operator=(const StagedEdgePipeline&);
+    
+    struct Frame {
+        EdgeFrameContext context;
+        double cannyThreshold;
+        bool colorEdges;
+        IplImage* output;           // from the output pool, if any, between rendering and presentation
+        int64 busiestStageTicks;
+        int64 submitTicks;
+        int64 enqueueTicks;
+    };
+    
+    struct StageCounters {
+        StageCounters() : framesProcessed (0), framesDropped (0), maxQueueDepth (0), ticks (0), maxTicks (0), queueTicks (0) {}
+        int framesProcessed;
+        int framesDropped;
+        int maxQueueDepth;
+        int64 ticks;
+        int64 maxTicks;
+        int64 queueTicks;
+    };
+    
+    struct Worker {
+        StagedEdgePipeline* pipeline;
+        Stage stage;
+        pthread_t thread;
+    };
+    
+    static void* runWorker(void* worker);
+    void runStage(Stage stage);
+    void processFrame(Stage stage, Frame* frame);
+    void enqueue(Stage stage, Frame* frame);        // into the input queue of stage
+    void recycle(Frame* frame);
+    void recordProcessing(Stage stage, int64 startTicks, int64 endTicks);
+    
+    PresentFunction present;
+    void* info;
+    QueuePolicy policy;
+    int outputChannels;
+    EdgeFrameContext::RenderMode renderMode;
+    PipelineGovernor* governor;
+    FrameBufferPool* outputPool;
+    bool incremental;
+    bool stopping;
+    
+    std::vector<Frame*> frames;
+    SpscQueue<Frame>* queues[StageCount];           // input queue of each stage; none for StageIngest
+    ThreadSignal queueNotEmpty[StageCount];
+    ThreadSignal queueNotFull[StageCount];
+    
+    // Recycled frames return to the submitting thread from any stage, so the free list is guarded by a mutex
+    std::vector<Frame*> freeFrames;
+    pthread_mutex_t freeFramesMutex;
+    pthread_cond_t freeFramesCondition;
+    
+    CannyEdgeDetector cannyEdgeDetector;            // only used by the Canny stage
+    IncrementalEdgeDetector incrementalEdgeDetector;
+    Worker workers[StageCount];
+    StageCounters counters[StageCount];
+    int64 endToEndTicks;
+    int64 recomputedMillionths;                     // sum over the frames of the fraction of tiles recomputed
+};
@@ -0,0 +1,168 @@
+//
+//  StreamingBinarizer.cpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "StreamingBinarizer.hpp"
+#import "Binarization.hpp"
+#import "CvRectUtilities.hpp"
+
+static inline bool rectsAreEqual(const CvRect& rect1, const CvRect& rect2)
+{
+    return rect1.x == rect2.x && rect1.y == rect2.y && rect1.width == rect2.width && rect1.height == rect2.height;
+}
+
+// A header for rows [top, top + height) of an image
+static inline void initRowsHeader(IplImage* header, const IplImage* image, int top, int height)
+{
+    cvInitImageHeader(header, cvSize(image->width, height), image->depth, image->nChannels);
+    cvSetData(header, image->imageData + image->widthStep * top, image->widthStep);
+}
+
+StreamingBinarizer::StreamingBinarizer(CvSize imageSize, int channels, RowsFunction output, void* info, int bandHeight,
+                                       int overlap, double cannyLowThreshold, double cannyHighThreshold, int threadCount)
+    : imageSize (imageSize), output (output), info (info), bandHeight (bandHeight), overlap (overlap),
+      cannyLowThreshold (cannyLowThreshold), cannyHighThreshold (cannyHighThreshold), threadCount (threadCount),
+      windowTop (0), windowRowsFilled (0), rowsEmitted (0)
+{
+    assert(channels == 1 || channels == 3 || channels == 4);
+    assert(bandHeight > 0 && overlap > 0);
+    
+    CvSize windowSize = cvSize(imageSize.width, MIN(bandHeight + 2 * overlap, imageSize.height));
+    window = cvCreateImage(windowSize, IPL_DEPTH_8U, channels);
+    resultWindow = cvCreateImage(windowSize, IPL_DEPTH_8U, 1);
+    edges = cvCreateImage(windowSize, IPL_DEPTH_8U, 1);
+    memset(resultWindow->imageData, UCHAR_MAX, resultWindow->imageSize);
+    storage = cvCreateMemStorage();
+}
+
+StreamingBinarizer::~StreamingBinarizer()
+{
+    cvReleaseMemStorage(&storage);
+    cvReleaseImage(&edges);
+    cvReleaseImage(&resultWindow);
+    cvReleaseImage(&window);
+}
+
+void StreamingBinarizer::pushRows(const IplImage* rows)
+{
+    assert(rows->width == imageSize.width && rows->nChannels == window->nChannels && rows->depth == IPL_DEPTH_8U);
+    assert(rowsReceived() + rows->height <= imageSize.height);
+    
+    size_t rowBytes = imageSize.width * window->nChannels;
+    int row = 0;
+    while (row < rows->height) {
+        // The window is complete once it reaches overlap rows past the current band, or the bottom of the image
+        int windowBottom = MIN(rowsEmitted + bandHeight + overlap, imageSize.height);
+        int count = MIN(rows->height - row, windowBottom - rowsReceived());
+        for (int i = 0; i < count; i++) {
+            memcpy(window->imageData + window->widthStep * (windowRowsFilled + i), rows->imageData + rows->widthStep * (row + i), rowBytes);
+        }
+        windowRowsFilled += count;
+        row += count;
+        
+        // Sliding the window may leave the next one complete already, when it is the last
+        while (!finished() && rowsReceived() == MIN(rowsEmitted + bandHeight + overlap, imageSize.height)) {
+            processWindow();
+        }
+    }
+}
+
+void StreamingBinarizer::processWindow()
+{
+    int bandTop = rowsEmitted;
+    int bandBottom = MIN(bandTop + bandHeight, imageSize.height);
+    int windowBottom = windowTop + windowRowsFilled;
+    bool lastBand = bandBottom == imageSize.height;
+    
+    IplImage windowHeader, edgesHeader, resultHeader;
+    initRowsHeader(&windowHeader, window, 0, windowRowsFilled);
+    initRowsHeader(&edgesHeader, edges, 0, windowRowsFilled);
+    initRowsHeader(&resultHeader, resultWindow, 0, windowRowsFilled);
+    
+    if (window->nChannels == 1) {
+        cannyEdgeDetector.detectEdges(&windowHeader, &edgesHeader, cannyLowThreshold, cannyHighThreshold);
+    } else {
+        cannyEdgeDetector.detectColorEdges(&windowHeader, &edgesHeader, cannyLowThreshold, cannyHighThreshold,
+                                           CannyEdgeDetector::ChannelCombinationOr);
+    }
+    cvClearMemStorage(storage);
+    CvContour* firstContour = NULL;
+    cvFindContours(&edgesHeader, storage, (CvSeq**)&firstContour, sizeof(CvContour), CV_RETR_TREE);      // modifies image
+    table.build(firstContour);
+    
+    // Select the contours owned by this band as binarizeContours() would, skipping the descendants of accepted contours
+    accepted.clear();
+    carriedContours.clear();
+    int next;
+    for (int i = 0; i < table.size(); i = next) {
+        next = i + 1;
+        
+        CvRect rect = table.rects[i];
+        rect.y += windowTop;
+        
+        // A contour accepted by an earlier band is traced again here if it extends into this band, and its descendants
+        // are skipped just as those of contours accepted by this band are
+        bool carried = false;
+        for (size_t j = 0; j < carriedRects.size() && !carried; j++) {
+            carried = rectsAreEqual(carriedRects[j], rect);
+        }
+        if (carried) {
+            carriedContours.push_back(i);
+            next = table.subtreeEnds[i];
+            continue;
+        }
+        
+        if (rect.y < bandTop || rect.y >= bandBottom) {
+            continue;
+        }
+        // The corner samples below the rect must be within the window, unless it is bounded by the image
+        if (!lastBand && rect.y + rect.height + 1 >= windowBottom) {
+            continue;
+        }
+        
+        if (contourSatisfiesTextConditions(table, i, imageSize, cvPoint(0, windowTop))) {
+            accepted.push_back(i);
+            next = table.subtreeEnds[i];
+        }
+    }
+    
+    // cvFindContours() lists contours roughly bottom to top, so on the whole image the contours of earlier bands would be
+    // thresholded after, and over, those of this band. Threshold the carried contours again last to match.
+    accepted.insert(accepted.end(), carriedContours.begin(), carriedContours.end());
+    binarizeTextContours(&windowHeader, table, accepted, &resultHeader, false, threadCount);
+    
+    // Keep the rects that extend into the next band
+    carriedRects.clear();
+    for (size_t j = 0; j < accepted.size(); j++) {
+        CvRect rect = table.rects[accepted[j]];
+        rect.y += windowTop;
+        if (rect.y + rect.height > bandBottom) {
+            carriedRects.push_back(rect);
+        }
+    }
+    
+    // No later band can write above its own top, so this band is final
+    IplImage bandHeader;
+    initRowsHeader(&bandHeader, resultWindow, bandTop - windowTop, bandBottom - bandTop);
+    output(info, &bandHeader, bandTop);
+    rowsEmitted = bandBottom;
+    if (lastBand) {
+        return;
+    }
+    
+    // Slide the window so that it begins overlap rows above the next band, keeping the rows that both windows share. Near
+    // the top of the image, where overlap exceeds the rows above the next band, the window stays at the top.
+    int newWindowTop = MAX(bandBottom - overlap, windowTop);
+    int shift = newWindowTop - windowTop;
+    int keptRows = windowRowsFilled - shift;
+    memmove(window->imageData, window->imageData + window->widthStep * shift, window->widthStep * keptRows);
+    memmove(resultWindow->imageData, resultWindow->imageData + resultWindow->widthStep * shift, resultWindow->widthStep * keptRows);
+    memset(resultWindow->imageData + resultWindow->widthStep * keptRows, UCHAR_MAX,
+           resultWindow->widthStep * (resultWindow->height - keptRows));
+    windowTop = newWindowTop;
+    windowRowsFilled = keptRows;
+}
@@ -0,0 +1,68 @@
+//
+//  StreamingBinarizer.hpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "opencv2/opencv.hpp"
+#import "CannyEdgeDetector.hpp"
+#import "ContourFeatureTable.hpp"
+#import <vector>
+
+// Binarizes an image as createBinarizedImage() does, but from rows pushed a band at a time, so that scans too large to be
+// resident can be processed. Only a window of bandHeight + 2 * overlap rows of the image and of the result is held, and
+// each band of binarized rows is emitted as soon as no later contour can write to it.
+//
+// Each band owns the contours whose bounding rects start within it, and finds them in a window extending overlap rows past
+// either side of it, so the window holds every owned contour at most overlap rows tall whole. Owned contours that continue
+// past the bottom of the window are rejected, so overlap should exceed the tallest text expected. The rects of accepted
+// contours that extend into the next band are carried forward, so that when such a contour is traced again in the next
+// window, its descendants are skipped as they would be on the whole image, and it is thresholded over the next band's
+// contours in the same order. The result differs from that of createBinarizedImage() only around contours that are too
+// tall, and where weak edges are connected to strong ones beyond the window.
+class StreamingBinarizer {
+public:
+    typedef void (*RowsFunction)(void* info, const IplImage* rows, int firstRow);
+    
+    // The image must have 1, 3 or 4 channels. output is called with each band of binarized rows, in order.
+    StreamingBinarizer(CvSize imageSize, int channels, RowsFunction output, void* info, int bandHeight = 512, int overlap = 128,
+                       double cannyLowThreshold = 50.0, double cannyHighThreshold = 100.0, int threadCount = 1);
+    ~StreamingBinarizer();
+    
+    // Appends the rows, which have the image's width and channels, binarizing and emitting every band that they complete
+    void pushRows(const IplImage* rows);
+    
+    bool finished() const { return rowsEmitted == imageSize.height; }
+    int rowsReceived() const { return windowTop + windowRowsFilled; }
+    
+private:
+    StreamingBinarizer(const StreamingBinarizer&);
+    StreamingBinarizer& operator=(const StreamingBinarizer&);
+    
+    void processWindow();
+    
+    CvSize imageSize;
+    RowsFunction output;
+    void* info;
+    int bandHeight;
+    int overlap;
+    double cannyLowThreshold;
+    double cannyHighThreshold;
+    int threadCount;
+    
+    IplImage* window;               // bandHeight + 2 * overlap rows of the image, starting at windowTop
+    IplImage* resultWindow;         // the binarized rows corresponding to window
+    IplImage* edges;
+    int windowTop;
+    int windowRowsFilled;
+    int rowsEmitted;                // the top of the current band
+    
+    CannyEdgeDetector cannyEdgeDetector;
+    CvMemStorage* storage;
+    ContourFeatureTable table;
+    std::vector<int> accepted;
+    std::vector<int> carriedContours;   // the contours of carriedRects traced again in this window
+    std::vector<CvRect> carriedRects;   // accepted rects extending below the previous band, in image coordinates
+};
@@ -0,0 +1,61 @@
+//
+//  TripleBuffer.hpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+// Hands the most recent of a stream of values from one producer thread to one consumer thread without either ever waiting.
+// The producer fills the back buffer and publishes it by atomically exchanging it with the middle buffer. The consumer takes
+// the middle buffer in exchange for its front buffer whenever a newer one has been published. Values that are published
+// twice before the consumer looks are dropped, and no buffer is ever touched by both threads at once.
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : back (0), middle (1), front (2), framesPublished (0), framesDropped (0) {
+        for (int i = 0; i < 3; i++) {
+            buffers[i] = T();
+        }
+    }
+    
+    // Producer only
+    T& backBuffer() { return buffers[back]; }
+    void publish() {
+        int previous = __atomic_exchange_n(&middle, back | freshFlag, __ATOMIC_ACQ_REL);
+        back = previous & indexMask;
+        __atomic_store_n(&framesPublished, framesPublished + 1, __ATOMIC_RELAXED);
+        if (previous & freshFlag) {
+            __atomic_store_n(&framesDropped, framesDropped + 1, __ATOMIC_RELAXED);
+        }
+    }
+    
+    // Consumer only. Returns true if a newer value was moved into the front buffer.
+    bool consumeLatest() {
+        if (!(__atomic_load_n(&middle, __ATOMIC_ACQUIRE) & freshFlag)) {
+            return false;
+        }
+        front = __atomic_exchange_n(&middle, front, __ATOMIC_ACQ_REL) & indexMask;
+        return true;
+    }
+    T& frontBuffer() { return buffers[front]; }
+    
+    // For cleanup once both threads are done
+    T& buffer(int i) { return buffers[i]; }
+    
+    int publishedCount() const { return __atomic_load_n(&framesPublished, __ATOMIC_RELAXED); }
+    int droppedCount() const { return __atomic_load_n(&framesDropped, __ATOMIC_RELAXED); }     // published but never consumed
+    
+private:
+    TripleBuffer(const TripleBuffer&);
+    TripleBuffer& operator=(const TripleBuffer&);
+    
+    enum { indexMask = 3, freshFlag = 4 };
+    
+    T buffers[3];
+    int back;           // owned by the producer
+    int middle;         // exchanged atomically, with freshFlag set if it has not been consumed
+    int front;          // owned by the consumer
+    int framesPublished;
+    int framesDropped;
+};
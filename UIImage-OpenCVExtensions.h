@@ -18,6 +18,16 @@
 - (id)initWithIplImage:(IplImage *)iplImage;
 - (id)initWithIplImage:(IplImage *)iplImage orientation:(UIImageOrientation)orientation;
 
+// Returns a UIImage that uses the IplImage's bitmap data in place. The image must be gray or BGRA with every alpha value 255,
+// and is owned by the returned UIImage, which will cvReleaseImage() it.
+- (id)initWithIplImageNoCopy:(IplImage *)iplImage;
+- (id)initWithIplImageNoCopy:(IplImage *)iplImage orientation:(UIImageOrientation)orientation;
+
+// As above, except that the image is not owned by the returned UIImage. Instead releaseDataCallback is called with info and
+// the image's data once the UIImage no longer needs it, e.g. to return the image to a pool.
+- (id)initWithIplImageNoCopy:(IplImage *)iplImage orientation:(UIImageOrientation)orientation
+         releaseDataCallback:(CGDataProviderReleaseDataCallback)releaseDataCallback info:(void *)info;
+
 // Returns an affine transform that takes into account the image orientation when drawing a scaled image
 - (CGAffineTransform)transformForOrientationDrawnTransposed:(BOOL *)drawTransposed;
 
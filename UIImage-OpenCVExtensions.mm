@@ -115,6 +115,46 @@ static void releaseImage(void *info, const void *data, size_t size);
     return self;
 }
 
+- (id)initWithIplImageNoCopy:(IplImage *)iplImage
+{
+    return [self initWithIplImageNoCopy:iplImage orientation:UIImageOrientationUp];
+}
+
+- (id)initWithIplImageNoCopy:(IplImage *)iplImage orientation:(UIImageOrientation)orientation
+{
+    return [self initWithIplImageNoCopy:iplImage orientation:orientation releaseDataCallback:releaseImage info:iplImage];
+}
+
+- (id)initWithIplImageNoCopy:(IplImage *)iplImage orientation:(UIImageOrientation)orientation
+         releaseDataCallback:(CGDataProviderReleaseDataCallback)releaseDataCallback info:(void *)info
+{
+    NSAssert(iplImage->depth == IPL_DEPTH_8U && (iplImage->nChannels == 1 || iplImage->nChannels == 4), @"Invalid image format");
+    
+    CGDataProviderRef provider = CGDataProviderCreateWithData(info, iplImage->imageData, iplImage->imageSize, releaseDataCallback);
+    
+    // Opaque BGRA is already premultiplied, and skipping the alpha channel lets the image be composited as opaque
+    CGBitmapInfo bitmapInfo = (iplImage->nChannels == 1) ? kCGImageAlphaNone : (kCGImageAlphaNoneSkipFirst | kCGBitmapByteOrder32Little);
+    CGColorSpaceRef colorSpace = (iplImage->nChannels == 1) ? CGColorSpaceCreateDeviceGray() : CGColorSpaceCreateDeviceRGB();
+    CGImageRef cgImage = CGImageCreate(iplImage->width,
+                                       iplImage->height,
+                                       iplImage->depth,
+                                       iplImage->depth * iplImage->nChannels,
+                                       iplImage->widthStep,
+                                       colorSpace,
+                                       bitmapInfo,
+                                       provider,
+                                       NULL,
+                                       false,
+                                       kCGRenderingIntentDefault);
+    CGColorSpaceRelease(colorSpace);
+    CGDataProviderRelease(provider);
+    
+    self = [self initWithCGImage:cgImage scale:1.0 orientation:orientation];
+    CGImageRelease(cgImage);
+    
+    return self;
+}
+
 static inline void premultiplyImage(IplImage *img, BOOL reverse)
 {
     NSCAssert(img->depth == IPL_DEPTH_8U, @"depth not IPL_DEPTH_8U");
@@ -0,0 +1,115 @@
+//
+//  WorkerPool.cpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import "WorkerPool.hpp"
+#import <unistd.h>
+
+WorkerPool::WorkerPool(int threadCount)
+    : generation (0), busyWorkers (0), stopping (false), function (NULL), context (NULL), taskCount (0), nextTask (0)
+{
+    if (threadCount <= 0) {
+        threadCount = processorCount();
+    }
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&workAvailable, NULL);
+    pthread_cond_init(&workFinished, NULL);
+    
+    threads.resize(threadCount - 1);
+    for (size_t i = 0; i < threads.size(); i++) {
+        pthread_create(&threads[i], NULL, runWorker, this);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    pthread_mutex_lock(&mutex);
+    stopping = true;
+    pthread_cond_broadcast(&workAvailable);
+    pthread_mutex_unlock(&mutex);
+    
+    for (size_t i = 0; i < threads.size(); i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_cond_destroy(&workFinished);
+    pthread_cond_destroy(&workAvailable);
+    pthread_mutex_destroy(&mutex);
+}
+
+int WorkerPool::processorCount()
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? (int)count : 1;
+}
+
+void WorkerPool::run(int taskCount, TaskFunction function, void* context)
+{
+    if (taskCount <= 0) {
+        return;
+    }
+    if (threads.empty() || taskCount == 1) {
+        for (int task = 0; task < taskCount; task++) {
+            function(context, task);
+        }
+        return;
+    }
+    
+    pthread_mutex_lock(&mutex);
+    this->function = function;
+    this->context = context;
+    this->taskCount = taskCount;
+    nextTask = 0;
+    busyWorkers = (int)threads.size();
+    generation++;
+    pthread_cond_broadcast(&workAvailable);
+    pthread_mutex_unlock(&mutex);
+    
+    runTasks();
+    
+    // The workers may still be running the last tasks they claimed
+    pthread_mutex_lock(&mutex);
+    while (busyWorkers > 0) {
+        pthread_cond_wait(&workFinished, &mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+void WorkerPool::runTasks()
+{
+    int task;
+    while ((task = __atomic_fetch_add(&nextTask, 1, __ATOMIC_RELAXED)) < taskCount) {
+        function(context, task);
+    }
+}
+
+void* WorkerPool::runWorker(void* pool)
+{
+    WorkerPool* self = (WorkerPool*)pool;
+    unsigned lastGeneration = 0;
+    
+    pthread_mutex_lock(&self->mutex);
+    while (true) {
+        while (!self->stopping && self->generation == lastGeneration) {
+            pthread_cond_wait(&self->workAvailable, &self->mutex);
+        }
+        if (self->stopping) {
+            break;
+        }
+        lastGeneration = self->generation;
+        pthread_mutex_unlock(&self->mutex);
+        
+        // The mutex orders the reads of function, context and taskCount after their writes in run()
+        self->runTasks();
+        
+        pthread_mutex_lock(&self->mutex);
+        if (--self->busyWorkers == 0) {
+            pthread_cond_signal(&self->workFinished);
+        }
+    }
+    pthread_mutex_unlock(&self->mutex);
+    return NULL;
+}
@@ -0,0 +1,48 @@
+//
+//  WorkerPool.hpp
+//  ImageProcessing
+//
+//  Created by Chris Marcellino on 10/17/26.
+//  Copyright 2026 Chris Marcellino. All rights reserved.
+//
+
+#import <pthread.h>
+#import <vector>
+
+// A fixed set of threads that run the tasks of parallel loops. The calling thread runs tasks too, so a pool of one thread
+// starts no threads and runs every task on the caller.
+class WorkerPool {
+public:
+    typedef void (*TaskFunction)(void* context, int task);
+    
+    // A threadCount of 0 uses one thread per online processor
+    explicit WorkerPool(int threadCount = 0);
+    ~WorkerPool();
+    
+    // Calls function(context, task) for every task in [0, taskCount) and returns once they have all completed. Tasks are
+    // claimed in increasing order but may complete in any order. Only one thread may call run() at a time.
+    void run(int taskCount, TaskFunction function, void* context);
+    
+    int threadCount() const { return (int)threads.size() + 1; }
+    static int processorCount();
+    
+private:
+    WorkerPool(const WorkerPool&);
+    WorkerPool& operator=(const WorkerPool&);
+    
+    static void* runWorker(void* pool);
+    void runTasks();
+    
+    std::vector<pthread_t> threads;
+    pthread_mutex_t mutex;
+    pthread_cond_t workAvailable;
+    pthread_cond_t workFinished;
+    unsigned generation;            // incremented for each call to run()
+    int busyWorkers;
+    bool stopping;
+    
+    TaskFunction function;
+    void* context;
+    int taskCount;
+    int nextTask;                   // claimed atomically
+};